@@ -0,0 +1,164 @@
+#pragma once
+
+#include <compare>
+#include <concepts>
+#include <cstddef>
+
+namespace binary_tree {
+
+/** @ingroup binary_tree
+ * @brief no_augment is the default augmentation policy of binary_tree::tree: nodes carry nothing extra.
+ *
+ * Augmentation policy keeps in every node some data that depends on the whole node subtree.
+ * The policy has two members:
+ *  - node is a base class of the tree nodes that holds the augmented data
+ *  - static void update(Node* node) recomputes the data of the node from its value and from its children.
+ *    Balancers call it after every structural change, children are always updated before the parent.
+ */
+struct no_augment {
+    struct node {};
+};
+
+/** @ingroup binary_tree
+ * @brief order_statistic stores the subtree size in every node.
+ *
+ * It makes tree::select and tree::rank available, both have logarithmic complexity.
+ */
+struct order_statistic {
+    struct node {
+        std::size_t subtree_size = 1;
+    };
+
+    template <typename Node>
+    static std::size_t size(const Node* node) noexcept {
+        return node == nullptr ? 0 : node->subtree_size;
+    }
+
+    template <typename Node>
+    static void update(Node* node) noexcept {
+        node->subtree_size = 1 + size(node->links[0]) + size(node->links[1]);
+    }
+};
+
+/** @ingroup binary_tree
+ * @brief aggregate stores in every node the aggregate of all values of its subtree.
+ *
+ * It makes tree::range_aggregate available, the query has logarithmic complexity.
+ * The aggregate is described by Monoid that has to provide:
+ *  - value_type is the type of the aggregate
+ *  - static value_type identity() returns the neutral element
+ *  - static value_type combine(const value_type& a, const value_type& b) has to be associative.
+ *    It doesn't have to be commutative, the values are always combined in the ascending order of keys.
+ *  - static value_type lift(const tree::value_type& v) makes the aggregate of the single tree value
+ *    (std::pair<const Key, T> for maps). Taking const auto& is the simplest way to not convert the value to a temporary.
+ *
+ * The aggregates are recomputed inside rotations, so these functions must not throw.
+ *
+ * As example the total size of the memory blocks that are stored as a map from the offset to the size:
+ * @code
+ * struct total_size {
+ *     using value_type = std::size_t;
+ *     static value_type identity() { return 0; }
+ *     static value_type combine(value_type a, value_type b) { return a + b; }
+ *     static value_type lift(const auto& v) { return v.second; }
+ * };
+ * binary_tree::tree<std::size_t, std::size_t, binary_tree::avl_balancer, std::compare_three_way,
+ *                   std::allocator, binary_tree::aggregate<total_size>> blocks;
+ * auto bytes = blocks.range_aggregate(0x1000, 0x2000);
+ * @endcode
+ */
+template <typename Monoid>
+struct aggregate {
+    using summary_type = typename Monoid::value_type;
+
+    struct node {
+        summary_type summary = Monoid::identity();
+    };
+
+    static summary_type identity() {
+        return Monoid::identity();
+    }
+
+    template <typename Node>
+    static summary_type summary(const Node* node) {
+        return node == nullptr ? Monoid::identity() : node->summary;
+    }
+
+    template <typename Node>
+    static summary_type lift(const Node* node) {
+        return Monoid::lift(node->value);
+    }
+
+    static summary_type combine(const summary_type& a, const summary_type& b) {
+        return Monoid::combine(a, b);
+    }
+
+    template <typename Node>
+    static void update(Node* node) {
+        node->summary = combine(combine(summary(node->links[0]), lift(node)), summary(node->links[1]));
+    }
+};
+
+/** @ingroup binary_tree
+ * @brief interval is the half-open range [low, high), it is the key of binary_tree::interval_tree.
+ *
+ * Intervals are ordered by low and then by high, so the tree can hold intervals with the same low.
+ */
+template <typename Bound>
+struct interval {
+    Bound low;
+    Bound high;
+
+    friend auto operator<=>(const interval&, const interval&) = default;
+    friend bool operator==(const interval&, const interval&) = default;
+};
+
+/** @ingroup binary_tree
+ * @brief interval_augment stores in every node the maximal high bound of the intervals of its subtree.
+ *
+ * It makes tree::enumerate_overlapping and tree::enumerate_stabbing available, the key must be binary_tree::interval.
+ * The bound is recomputed inside rotations, so comparing and copying of Bound must not throw.
+ */
+template <typename Bound>
+struct interval_augment {
+    struct node {
+        Bound max_high{};
+    };
+
+    template <typename Node>
+    static void update(Node* node) noexcept {
+        auto max_high = Node::get_key(node->value).high;
+        for (auto child : node->links) {
+            if (child != nullptr && max_high < child->max_high)
+                max_high = child->max_high;
+        }
+        node->max_high = max_high;
+    }
+};
+
+/**
+ * @brief sized_node is a node that knows its subtree size
+ */
+template <typename Node>
+concept sized_node = requires (const Node* node) {
+    { node->subtree_size } -> std::convertible_to<std::size_t>;
+};
+
+/**
+ * @brief summarized_node is a node that keeps the aggregate of its subtree
+ */
+template <typename Node>
+concept summarized_node = requires (const Node* node) {
+    node->summary;
+};
+
+/**
+ * @brief interval_node is a node that keeps the maximal high bound of the intervals of its subtree
+ */
+template <typename Node>
+concept interval_node = requires (const Node* node) {
+    node->max_high;
+    Node::get_key(node->value).low;
+};
+
+}
@@ -2,6 +2,13 @@
 
 #include "base.h"
 
+#include <algorithm>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
 namespace binary_tree {
 
 struct avl_balancer {
@@ -22,6 +29,15 @@ private:
     int8_t balance = -1;
 };
 
+/**
+ * @brief max_height
+ * @return the maximal height of the tree that contains count nodes
+ */
+static std::size_t max_height(std::size_t count) noexcept {
+    std::size_t bits = std::bit_width(count);
+    return bits + bits / 2;
+}
+
 private:
 template <typename Node>
 static Node* avl_rotate_2(Node** path_top, int dir) noexcept {
@@ -59,38 +75,143 @@ static Node* avl_rotate_3(Node** path_top, int dir, int third) noexcept {
     }
 }
 
+/**
+ * @brief link sets children of the node, their heights must differ by one at most.
+ * @param back child that goes to the opposite side of dir
+ * @param front child that goes to the dir side
+ * @return height of the node
+ */
+template <typename Node>
+static int link(Node* node, int dir, Node* back, int back_height, Node* front, int front_height) noexcept {
+    node->links[1 - dir] = back;
+    node->links[dir]     = front;
+    if (back_height == front_height)
+        node->set_balance(-1);
+    else
+        node->set_balance(front_height > back_height ? dir : 1 - dir);
+    update_augment(node);
+    return std::max(back_height, front_height) + 1;
+}
+
+/**
+ * @brief join_side goes down the dir spine of high to the node that has almost the same height as low,
+ * links middle and low there and rebalances the spine on the way back.
+ * @note high has to be higher than low by two at least.
+ */
+template <typename Node>
+static std::pair<Node*, int> join_side(Node* high, int high_height, Node* middle, Node* low, int low_height, int dir) noexcept {
+    auto back         = high->links[1 - dir];
+    auto back_height  = child_height(high, high_height, 1 - dir);
+    auto front        = high->links[dir];
+    auto front_height = child_height(high, high_height, dir);
+
+    auto [top, top_height] = front_height <= low_height + 1
+        ? std::pair{middle, link(middle, dir, front, front_height, low, low_height)}
+        : join_side(front, front_height, middle, low, low_height, dir);
+    if (top_height <= back_height + 1)
+        return {high, link(high, dir, back, back_height, top, top_height)};
+
+    // top is higher than back by two, so the subtree has to be rotated
+    auto inner         = top->links[1 - dir];
+    auto inner_height  = child_height(top, top_height, 1 - dir);
+    auto outer         = top->links[dir];
+    auto outer_height  = child_height(top, top_height, dir);
+    if (outer_height >= inner_height) {
+        auto height = link(high, dir, back, back_height, inner, inner_height);
+        return {top, link(top, dir, high, height, outer, outer_height)};
+    }
+    auto inner_back  = inner->links[1 - dir];
+    auto inner_front = inner->links[dir];
+    auto back_side   = link(high, dir, back, back_height, inner_back, child_height(inner, inner_height, 1 - dir));
+    auto front_side  = link(top, dir, inner_front, child_height(inner, inner_height, dir), outer, outer_height);
+    return {inner, link(inner, dir, high, back_side, top, front_side)};
+}
+
+/**
+ * @return height of the valid subtree or -1
+ */
+template <typename Node>
+static int checked_height(const Node* node) noexcept {
+    if (node == nullptr)
+        return 0;
+    auto left  = checked_height(node->links[0]);
+    auto right = checked_height(node->links[1]);
+    if (left < 0 || right < 0 || left - right > 1 || right - left > 1)
+        return -1;
+    auto balance = left == right ? -1 : (left < right ? 1 : 0);
+    if (node->get_balance() != balance)
+        return -1;
+    return std::max(left, right) + 1;
+}
+
 public:
-template<typename Node, typename C>
-static bool insert(Node** root, typename Node::value_type value, C create_node)
+/**
+ * @brief insert_by links a new node at the position chosen by the compare functor and rebalances the tree.
+ *
+ * The compare functor is called once per a visited node, directions of the path are remembered
+ * so rebalancing doesn't compare keys again.
+ * @param root pointer to the root link
+ * @param compare functor that returns std::strong_ordering of the new key relative to the given node key
+ * @param create_node functor that receives the link where the new node must be stored
+ * @return the new node and true or the node with an equivalent key and false
+ */
+template<typename Node, typename F, typename C>
+static std::pair<Node*, bool> insert_by(Node** root, F compare, C create_node)
 {
     //Stage 1. Find a position in the tree and link a new node
     // by the way find and remember a node where the tree starts to be unbalanced.
-    const auto& key = Node::get_key(value);
+    // Directions of the path are stored as bits (AVL tree with 64 levels has more than 2^44 nodes).
+    // Updates of path_top must stay branchless, the balance of the path nodes is unpredictable.
+    // Augmented nodes of the path are remembered to be updated after linking.
     auto node_ptr   = root;
     auto path_top   = root;
     auto node       = *root;
+    uint64_t directions = 0;
+    int depth = 0;
+    int top_depth = 0;
+    [[maybe_unused]] Node* ancestors[augmented_node<Node> ? 64 : 1];
     while (node != nullptr) [[likely]] {
-        auto cmp = node->compare(key);
+        auto cmp = compare(node);
         if (cmp == std::strong_ordering::equivalent) [[unlikely]]
-            return false;
-        if (!node->is_balanced()) [[unlikely]]
-            path_top = node_ptr;
-        node_ptr = &(node->links[node->get_direction(cmp)]);
+            return {node, false};
+        if (!node->is_balanced()) [[unlikely]] {
+            path_top  = node_ptr;
+            top_depth = depth;
+        }
+        if constexpr (augmented_node<Node>) {
+            ancestors[depth] = node;
+        }
+        auto dir = node->get_direction(cmp);
+        directions |= static_cast<uint64_t>(dir) << depth++;
+        node_ptr = &(node->links[dir]);
         node = *node_ptr;
     }
+    directions >>= top_depth;
 
-    create_node(node_ptr, value);
+    create_node(node_ptr);
+    auto new_node = *node_ptr;
+    if constexpr (augmented_node<Node>) {
+        // rotations keep the set of nodes in the rotated subtree, so ancestors can be updated before them
+        update_augment(new_node);
+        while (depth > 0) {
+            update_augment(ancestors[--depth]);
+        }
+    }
 
     //Stage 2. Rebalance
-    //rebalance_insert(path_top, key);
+    auto step = [&directions]() {
+        int dir = directions & 1;
+        directions >>= 1;
+        return dir;
+    };
     auto path = *path_top;
-    int first, second, third;
     if (!path->is_balanced()) {
-        if (path->get_balance() != (first = path->get_direction(key))) {
+        int first = step();
+        if (path->get_balance() != first) {
             /* took the shorter path */
             path->set_balance(-1);
             path = path->links[first];
-        } else if (first == (second = path->links[first]->get_direction(key))) {
+        } else if (int second = step(); first == second) {
             /* just a two-point rotate */
             path = avl_rotate_2(path_top, first);
         } else {
@@ -100,53 +221,131 @@ static bool insert(Node** root, typename Node::value_type value, C create_node)
              * the third step as NEITHER
              */
             path = path->links[first]->links[second];
-            if (key == Node::get_key(path->value))
-                third = -1;
-            else
-                third = path->get_direction(key);
-
+            int third = path == new_node ? -1 : step();
             path = avl_rotate_3(path_top, first, third);
         }
     }
 
     //Stage 3. Update balance info in the each node
-    while (path != nullptr) [[likely]] {
-        auto cmp = path->compare(key);
-        if (cmp == std::strong_ordering::equivalent)
-            break;
-        auto direction = path->get_direction(cmp);
+    while (path != nullptr && path != new_node) [[likely]] {
+        auto direction = step();
         path->set_balance(direction);
         path = path->links[direction];
     }
-    return  true;
+    return {new_node, true};
+}
+
+template<typename Node, typename C>
+static bool insert(Node** root, const typename Node::value_type& value, C create_node)
+{
+    const auto& key = Node::get_key(value);
+    return insert_by(root, [&key](Node* node) {
+        return node->compare(key);
+    }, [&value, &create_node](Node** link) {
+        create_node(link, value);
+    }).second;
+}
+
+/**
+ * @brief init_built_node sets the balance of the node that has been linked by the bulk tree construction.
+ * @param left_height, right_height heights of the node subtrees
+ * @param depth, height node depth and the whole tree height (AVL doesn't need them)
+ */
+template<typename Node>
+static void init_built_node(Node* node, int left_height, int right_height, int /*depth*/, int /*height*/) noexcept {
+    if (left_height == right_height)
+        node->set_balance(-1);
+    else
+        node->set_balance(left_height < right_height ? 1 : 0);
+}
+
+/**
+ * @brief height computes the subtree height in O(log n) going down via the higher child.
+ */
+template<typename Node>
+static int height(const Node* node) noexcept {
+    int result = 0;
+    for (; node != nullptr; ++result) {
+        node = node->links[node->is_balanced() ? 0 : node->get_balance()];
+    }
+    return result;
+}
+
+/**
+ * @brief child_height
+ * @return height of the child dir of the node that has the given height
+ */
+template<typename Node>
+static int child_height(const Node* node, int height, int dir) noexcept {
+    return node->is_balanced() || node->get_balance() == dir ? height - 1 : height - 2;
+}
+
+/**
+ * @brief join links middle between left and right subtrees and rebalances the result in O(|left_height - right_height|).
+ * @note all keys of left must be less than the middle key, all keys of right must be greater.
+ * @return root and height of the joined tree
+ */
+template<typename Node>
+static std::pair<Node*, int> join(Node* left, int left_height, Node* middle, Node* right, int right_height) noexcept {
+    if (left_height > right_height + 1)
+        return join_side(left, left_height, middle, right, right_height, 1);
+    if (right_height > left_height + 1)
+        return join_side(right, right_height, middle, left, left_height, 0);
+    return {middle, link(middle, 1, left, left_height, right, right_height)};
+}
+
+/**
+ * @brief verify checks heights and balance info of the tree (for testing purposes)
+ */
+template<typename Node>
+static bool verify(const Node* root) noexcept {
+    return checked_height(root) >= 0;
 }
 
 template<typename Node>
 static Node* erase(Node** root, const typename Node::key_type& key) noexcept
 {
     //Stage 1. lookup for the node that contain a key
+    // Augmented nodes get updated at the end, so ancestors of the removed position are remembered.
+    // Stage 2 adds at most one extra node per a level.
     auto node                  = *root;
     auto nodep                 = root;
     auto path_top              = root;
     decltype(path_top) targetp = nullptr;
     int dir = 0;
+    [[maybe_unused]] Node* ancestors[augmented_node<Node> ? 128 : 1];
+    [[maybe_unused]] int depth = 0;
+    [[maybe_unused]] int top_depth = 0;
 
     while (node) [[likely]] {
         auto cmp = node->compare(key);
-        dir = node->get_direction(key);
+        dir = node->get_direction(cmp);
         if (cmp == std::strong_ordering::equivalent)
             targetp = nodep;
         if (node->links[dir] == nullptr)
             break;
         if (node->is_balanced()
             || (node->get_balance() == (1-dir) && node->links[1-dir]->is_balanced())
-            ) path_top = nodep;
+            ) {
+            path_top = nodep;
+            if constexpr (augmented_node<Node>) {
+                top_depth = depth;
+            }
+        }
+        if constexpr (augmented_node<Node>) {
+            ancestors[depth++] = node;
+        }
         nodep = &node->links[dir];
         node = *nodep;
     }
     if (targetp == nullptr) [[unlikely]]
         return nullptr; //key not found nothing to remove
 
+    // nodes from path_top down can be moved by rotations, stage 2 records them again
+    if constexpr (augmented_node<Node>) {
+        depth = top_depth;
+    }
+
     /*
      * Stage 2.
      * adjust balance, but don't lose 'targetp'.
@@ -179,6 +378,13 @@ static Node* erase(Node** root, const typename Node::key_type& key) noexcept
             if (tree == targetn) {
                 targetp = &(*treep)->links[bdir];
             }
+            if constexpr (augmented_node<Node>) {
+                // the new top of the rotated subtree is an ancestor too
+                ancestors[depth++] = *treep;
+            }
+        }
+        if constexpr (augmented_node<Node>) {
+            ancestors[depth++] = tree;
         }
         treep = &(tree->links[bdir]);
     }
@@ -197,6 +403,13 @@ static Node* erase(Node** root, const typename Node::key_type& key) noexcept
     tree->links[1] = targetn->links[1];
     tree->set_balance(targetn->get_balance());
 
+    if constexpr (augmented_node<Node>) {
+        // the end of the path has taken the place of the removed node
+        while (depth > 0) {
+            auto ancestor = ancestors[--depth];
+            update_augment(ancestor == targetn ? tree : ancestor);
+        }
+    }
     return targetn;
 }
 };
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <type_traits>
@@ -8,6 +9,101 @@
 
 namespace binary_tree {
 
+/**
+ * @brief prefetch asks the CPU to load the cache line of the node, it is a hint that never faults
+ */
+inline void prefetch([[maybe_unused]] const void* node) noexcept {
+#if defined(__GNUC__)
+    __builtin_prefetch(node);
+#endif
+}
+
+/**
+ * Nodes can carry an augmentation: data that depends on the node subtree (as example its size).
+ * Such node provides update_augment() that recomputes the data from the node value and its children.
+ */
+template <typename Node>
+concept augmented_node = requires (Node* node) {
+    node->update_augment();
+};
+
+template <typename Node>
+inline void update_augment(Node* node) noexcept {
+    if constexpr (augmented_node<Node>) {
+        node->update_augment();
+    }
+}
+
+/**
+ * @brief node_path keeps the nodes from the root and the directions taken from them.
+ *
+ * Nodes have no link to the parent, so balancers that rebalance bottom-up walk this path back.
+ * @tparam Capacity maximal height of the tree
+ */
+template <typename Node, int Capacity>
+struct node_path {
+    Node**  root;
+    int     depth = 0;
+    Node*   nodes[Capacity];
+    int8_t  dirs[Capacity];
+
+    explicit node_path(Node** r) noexcept
+        : root(r)
+    {}
+
+    void push(Node* node, int dir) noexcept {
+        nodes[depth] = node;
+        dirs[depth++] = static_cast<int8_t>(dir);
+    }
+
+    /**
+     * @return the link that points to nodes[level], it is the root link for the level 0
+     */
+    Node** link(int level) noexcept {
+        return level == 0 ? root : &nodes[level - 1]->links[dirs[level - 1]];
+    }
+
+    /**
+     * @brief update_augment updates the path nodes bottom-up
+     */
+    void update_augment() noexcept {
+        if constexpr (augmented_node<Node>) {
+            for (auto level = depth; level-- > 0;) {
+                binary_tree::update_augment(nodes[level]);
+            }
+        }
+    }
+};
+
+/**
+ * @brief unlink removes the target node from the tree, the path has to lead to the target (the target isn't in the path).
+ *
+ * When the target has two children it is replaced by its successor, the successor takes the target links
+ * and the target place in the path. The caller copies the balance info of the target to the successor.
+ * At the end the path leads to the position where a node has been removed.
+ * @return the node that has left its position: the target itself or its successor
+ */
+template <typename Node, int Capacity>
+Node* unlink(node_path<Node, Capacity>& path, Node* target) noexcept {
+    auto target_level = path.depth;
+    if (target->links[0] == nullptr || target->links[1] == nullptr) {
+        *path.link(target_level) = target->links[target->links[0] == nullptr ? 1 : 0];
+        return target;
+    }
+
+    path.push(target, 1);
+    auto successor = target->links[1];
+    for (; successor->links[0] != nullptr; successor = successor->links[0]) {
+        path.push(successor, 0);
+    }
+    *path.link(path.depth) = successor->links[1];
+    successor->links[0] = target->links[0];
+    successor->links[1] = target->links[1];
+    *path.link(target_level) = successor;
+    path.nodes[target_level] = successor;
+    return successor;
+}
+
 template <typename Node>
 Node* rotate_2(Node** path_top, int dir) noexcept {
     auto node_B = *path_top;
@@ -19,6 +115,8 @@ Node* rotate_2(Node** path_top, int dir) noexcept {
     node_D->links[1 - dir] = node_B;
     node_B->links[dir]     = node_C;
 
+    update_augment(node_B);
+    update_augment(node_D);
     return node_E;
 }
 
@@ -35,6 +133,10 @@ void rotate_3(Node** path_top, int dir) noexcept {
     node_D->links[dir]     = node_F;
     node_B->links[dir]     = node_C;
     node_F->links[1 - dir] = node_E;
+
+    update_augment(node_B);
+    update_augment(node_F);
+    update_augment(node_D);
 }
 
 }
@@ -1,15 +1,27 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
+#include <cassert>
 #include <compare>
+#include <exception>
 #include <functional>
+#include <future>
+#include <iterator>
 #include <limits>
 #include <memory>
+#include <system_error>
+#include <thread>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 #include <iostream>
 
+#include "augment.h"
 #include "avl_balancer.h"
+#include "frozen_tree.h"
 #include "util/stack_adaptor.h"
+#include "util/work_stealing_pool.h"
 
 /** @defgroup binary_tree binary_tree
  * @brief Self balanced binary tree (AVL, RB, etc)
@@ -30,12 +42,28 @@
  *    binary_tree::binary_tree<int, std::string> my_map; //this is a map where key has type int and maped value is std::string
  *    @endcode
  *  - This implementaion uses only two links per node. It helps to reduce memory usage and I hope it helps to improve performance.
- *    But without a link to the parent node impossible to implement iterator based acces. So it isn't present.
- *    Instead you can use enumerators.
- *  - balancer type can be customized via template parameter B. But now only avl_balancer is implemented.
+ *    Without a link to the parent node an iterator has to keep the whole path from the root,
+ *    so iterators are big and any modification of the tree invalidates them.
+ *    enumerate() is the cheapest way to visit the whole tree.
+ *  - nodes can be augmented via template parameter A with data that summarizes the node subtree.
+ *    binary_tree::order_statistic provides select() and rank(),
+ *    binary_tree::aggregate provides range_aggregate() for a user-defined associative operation (sum, min, max, etc).
+ *    binary_tree::interval_augment makes binary_tree::interval_tree that finds overlapping intervals.
+ *  - split(), join(), the set operations (set_union(), set_intersection(), set_difference()), erase_range() and erase_if()
+ *    relink nodes of the trees instead of copying them. The set operations can use several threads. They need avl_balancer.
+ *  - parallel_for_each() and parallel_reduce() process subtrees as tasks of util::work_stealing_pool.
+ *  - freeze() makes the read-only copy (binary_tree::frozen_tree) that keeps keys in one array
+ *    in Eytzinger order, it is the fastest way to look up a tree that isn't modified any more.
+ *    binary_tree::mapped_tree saves the same layout to a file and looks it up from the memory mapping.
+ *  - binary_tree::concurrent_tree lets readers go without locks, the writer copies the changed path
+ *    instead of changing the nodes that readers can see.
+ *  - binary_tree::persistent_tree makes O(1) snapshots, every change copies its path, so old versions stay intact.
+ *  - balancer type can be customized via template parameter B: avl_balancer (default), rb_balancer or wavl_balancer.
  *
  *  avl_balancer provides <a href="https://en.wikipedia.org/wiki/AVL_tree">AVL tree</a>.
  *  Most implementations of AVL tree are recursive. But this library contains iterative inserting and removing.
+ *  AVL tree is the lowest one, so it is the best for lookups. rb_balancer (include rb_balancer.h) and
+ *  wavl_balancer (include wavl_balancer.h) do less rotations while erasing.
  */
 
 namespace binary_tree {
@@ -61,22 +89,28 @@ namespace binary_tree {
  * This defaults to less<T>, which returns the same as applying the less-than operator (a<b). Aliased as member type tree::key_compare.
  * @tparam Alloc Type of the allocator object used to define the storage allocation model.
  * By default, the allocator class template is used, which defines the simplest memory allocation model and is value-independent.
+ * When the allocator has reset() method (as example util::arena_allocator) clear() releases all nodes by the one reset() call.
+ * Nodes are not visited at all if value_type is trivially destructible.
+ * @tparam A augmentation policy, it adds to every node data that depends on the node subtree.
+ * By default nodes aren't augmented. binary_tree::order_statistic enables select() and rank(),
+ * binary_tree::aggregate enables range_aggregate(), binary_tree::interval_augment enables enumerate_overlapping().
  */
 template<typename Key, typename T = void,
          typename B = binary_tree::avl_balancer,
          typename Compare = std::compare_three_way,
-         template<typename X> typename Alloc = std::allocator>
+         template<typename X> typename Alloc = std::allocator,
+         typename A = binary_tree::no_augment>
 class tree
 {
 private:
-    struct Node  : public B::Node {
+    struct Node  : public B::Node, public A::node {
         using key_type      = Key;
         using mapped_type   = T;
 
         using value_type = typename std::conditional<
             std::is_void<mapped_type>::value,
             key_type,
-            std::pair<key_type, mapped_type>>::type;
+            std::pair<const key_type, mapped_type>>::type;
 
         Node* links[2] = {nullptr, nullptr};
         value_type  value;
@@ -85,9 +119,18 @@ private:
             : value(v)
         {}
 
+        Node(value_type&& v)
+            : value(std::move(v))
+        {}
+
+        template<typename... Args>
+        Node(std::in_place_t, Args&&... args)
+            : value(std::forward<Args>(args)...)
+        {}
+
         template<typename K>
         auto compare(const K& key) {
-            return key_compare{}(key, value);
+            return key_compare{}(key, get_key(value));
         }
 
         int get_direction(const std::strong_ordering ord) {
@@ -118,6 +161,10 @@ private:
             return get_key_impl(v, std::is_void<mapped_type>());
         }
 
+        void update_augment() noexcept requires (!std::is_same_v<A, no_augment>) {
+            A::update(this);
+        }
+
         //For test/debug purpose
         static int get_height(Node* n) {
             if (n == nullptr)
@@ -130,14 +177,22 @@ private:
     using node_pointer    = node_type*;
     using Node_alloc_type = Alloc<node_type>;
 
+    static constexpr bool is_resettable_allocator = requires (Node_alloc_type& a) { a.reset(); };
+    static constexpr bool is_bulk_releasable = is_resettable_allocator && std::is_trivially_destructible_v<node_type>;
+    /// Nodes can be moved between trees when any allocator instance can free them
+    static constexpr bool is_transferable = std::allocator_traits<Node_alloc_type>::is_always_equal::value;
+    /// split and join need also the balancer that can join subtrees
+    static constexpr bool is_joinable = is_transferable
+        && requires (node_pointer node) { B::join(node, 0, node, node, 0); };
+
 public:
     ///Alias for Key
     using key_type       = typename Node::key_type;
     ///Alias for T
     using mapped_type    = typename Node::mapped_type;
     /**
-     * When T isn't void value_type is std::pair<Key,T>.
-     * In the other case it is alias for Key
+     * When T isn't void value_type is std::pair<const Key,T> like in std::map, so the key of a stored element
+     * can't be changed. In the other case it is alias for Key
      */
     using value_type     = typename  Node::value_type;
     /// Alias for Compare
@@ -150,6 +205,221 @@ public:
         DESCENDING = 1,
     };
 
+    /**
+     * SEQUENTIAL runs the set operations in the calling thread.
+     * PARALLEL runs the independent halves of big subtrees in other threads.
+     */
+    enum class ExecutionPolicy : int{
+        SEQUENTIAL = 0,
+        PARALLEL   = 1,
+    };
+
+    /**
+     * @brief node_handle owns the node that has been extracted from the tree.
+     *
+     * The node can be inserted into this or another tree of the same type without any allocation,
+     * its key can be changed while the node is out of the tree.
+     * The node is destroyed with the handle unless it has been inserted.
+     */
+    class node_handle {
+    public:
+        node_handle() noexcept = default;
+
+        node_handle(node_handle&& other) noexcept
+            : node(std::exchange(other.node, nullptr))
+        {}
+
+        node_handle& operator=(node_handle&& other) noexcept {
+            if (this != &other) {
+                reset();
+                node = std::exchange(other.node, nullptr);
+            }
+            return *this;
+        }
+
+        ~node_handle() {
+            reset();
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return node == nullptr;
+        }
+
+        explicit operator bool() const noexcept {
+            return node != nullptr;
+        }
+
+        ///The value of the set node
+        value_type& value() const noexcept requires std::is_void_v<T> {
+            return node->value;
+        }
+
+        ///The key of the map node, it is const in the tree but the node is out of any tree here
+        key_type& key() const noexcept requires (!std::is_void_v<T>) {
+            return const_cast<key_type&>(node->value.first);
+        }
+
+        ///The mapped value of the map node
+        auto& mapped() const noexcept requires (!std::is_void_v<T>) {
+            return node->value.second;
+        }
+
+    private:
+        friend class tree;
+
+        node_pointer node = nullptr;
+
+        explicit node_handle(node_pointer n) noexcept
+            : node(n)
+        {}
+
+        void reset() noexcept {
+            if (node != nullptr) {
+                Node_alloc_type allocator;
+                std::allocator_traits<Node_alloc_type>::destroy(allocator, node);
+                allocator.deallocate(node, 1);
+                node = nullptr;
+            }
+        }
+    };
+
+    /**
+     * @brief max_depth is the capacity of the iterator path.
+     *
+     * Nodes have no link to the parent, so an iterator keeps the whole path from the root.
+     * 96 levels are enough for AVL tree of any size and for RB tree that has up to 2^48 nodes.
+     */
+    static constexpr unsigned max_depth = 96;
+
+    ///Size of the one node in bytes without the allocator overhead
+    static constexpr size_type node_size = sizeof(node_type);
+
+private:
+    template <bool Const>
+    class iterator_impl {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type        = tree::value_type;
+        using difference_type   = std::ptrdiff_t;
+        using reference         = std::conditional_t<Const, const value_type&, value_type&>;
+        using pointer           = std::conditional_t<Const, const value_type*, value_type*>;
+
+        iterator_impl() noexcept {}
+
+        iterator_impl(const iterator_impl& other) noexcept {
+            *this = other;
+        }
+
+        template <bool C> requires (Const && !C)
+        iterator_impl(const iterator_impl<C>& other) noexcept {
+            root  = other.root;
+            depth = other.depth;
+            std::copy_n(other.path, depth, path);
+        }
+
+        iterator_impl& operator=(const iterator_impl& other) noexcept {
+            // only the used part of the path is copied
+            root  = other.root;
+            depth = other.depth;
+            std::copy_n(other.path, depth, path);
+            return *this;
+        }
+
+        reference operator*() const noexcept {
+            return path[depth - 1]->value;
+        }
+
+        pointer operator->() const noexcept {
+            return &path[depth - 1]->value;
+        }
+
+        iterator_impl& operator++() noexcept {
+            step(1);
+            return *this;
+        }
+
+        iterator_impl operator++(int) noexcept {
+            auto result = *this;
+            step(1);
+            return result;
+        }
+
+        iterator_impl& operator--() noexcept {
+            step(0);
+            return *this;
+        }
+
+        iterator_impl operator--(int) noexcept {
+            auto result = *this;
+            step(0);
+            return result;
+        }
+
+        template <bool C>
+        bool operator==(const iterator_impl<C>& other) const noexcept {
+            return node() == other.node();
+        }
+
+    private:
+        friend class tree;
+        template <bool C> friend class iterator_impl;
+
+        node_pointer root  = nullptr;
+        unsigned     depth = 0;
+        node_pointer path[max_depth];
+
+        explicit iterator_impl(node_pointer r) noexcept
+            : root(r)
+        {}
+
+        node_pointer node() const noexcept {
+            return depth == 0 ? nullptr : path[depth - 1];
+        }
+
+        void push(node_pointer node) noexcept {
+            assert(depth < max_depth);
+            path[depth++] = node;
+        }
+
+        void descend(node_pointer node, int dir) noexcept {
+            for (; node != nullptr; node = node->links[dir]) {
+                push(node);
+            }
+        }
+
+        /**
+         * @brief step goes to the next node in the direction dir (1 is ascending order).
+         * Stepping from the end goes to the outermost node in the opposite direction.
+         */
+        void step(int dir) noexcept {
+            if (depth == 0) {
+                descend(root, 1 - dir);
+                return;
+            }
+            if (auto next = path[depth - 1]->links[dir]; next != nullptr) {
+                push(next);
+                descend(next->links[1 - dir], 1 - dir);
+                return;
+            }
+            // Going up while we come from the dir side
+            node_pointer child;
+            do {
+                child = path[--depth];
+            } while (depth > 0 && path[depth - 1]->links[dir] == child);
+        }
+    };
+
+public:
+    /**
+     * Bidirectional iterator. It keeps the path from the root, so it is rather big (see max_depth).
+     * @note any modification of the tree invalidates all iterators.
+     * Iterator of the set doesn't allow to modify values, iterator of the map allows to modify the mapped value only.
+     */
+    using iterator               = iterator_impl<std::is_void_v<T>>;
+    using const_iterator         = iterator_impl<true>;
+    using reverse_iterator       = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
     //Construct
     /**
      * @brief tree creates empty tree
@@ -157,6 +427,16 @@ public:
      */
     tree() noexcept;
 
+    /**
+     * @brief tree creates a tree from the sorted range [first, last) in O(n).
+     *
+     * The tree is built perfectly balanced without any rotations and comparisons.
+     * @note the range must be sorted in ascending order and must not contain equivalent keys.
+     * @param first, last the range of elements to insert
+     */
+    template <std::forward_iterator It>
+    tree(It first, It last);
+
     /**
      * @brief tree not impl yet
      * TODO: impl
@@ -181,6 +461,14 @@ public:
     ///TODO: impl
     tree& operator=(std::initializer_list<value_type> ilist) = delete;
 
+    /**
+     * @brief assign replaces the contents with the elements of the sorted range [first, last) in O(n).
+     * @note the range must be sorted in ascending order and must not contain equivalent keys.
+     * @param first, last the range of elements to insert
+     */
+    template <std::forward_iterator It>
+    void assign(It first, It last);
+
     //Capacity
     /**
      * @brief empty
@@ -208,6 +496,89 @@ public:
      */
     bool insert(const value_type& value);
 
+    /**
+     * @brief Inserts element into the container, if the container doesn't already contain an element with an equivalent key.
+     *
+     * The value is moved into the new node only when it is inserted.
+     * @param value element value to insert
+     * @return true when an element was inserted otherwise false
+     */
+    bool insert(value_type&& value);
+
+    /**
+     * @brief insert links the node of the handle into the tree without any allocation.
+     *
+     * The handle is empty after the node has been inserted.
+     * When the tree already contains an equivalent key the node stays in the handle.
+     * @return true when the node was inserted otherwise false
+     */
+    bool insert(node_handle&& handle) requires is_transferable;
+
+    /**
+     * @brief emplace constructs the element in a new node from args and inserts it.
+     *
+     * The key is known only after the construction, so the node is destroyed when the key is in the tree.
+     * Use try_emplace to avoid it.
+     * @return true when an element was inserted otherwise false
+     */
+    template <typename... Args>
+    bool emplace(Args&&... args);
+
+    /**
+     * @brief try_emplace inserts the element constructed from key and args when the tree doesn't contain the key.
+     *
+     * Nothing is constructed or moved from key and args when the key is in the tree.
+     * Is available for the map only.
+     * @return true when an element was inserted otherwise false
+     */
+    template <typename... Args>
+    bool try_emplace(const key_type& key, Args&&... args) requires (!std::is_void_v<T>) {
+        return try_emplace_impl(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    bool try_emplace(key_type&& key, Args&&... args) requires (!std::is_void_v<T>) {
+        return try_emplace_impl(std::move(key), std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief insert inserts element as close as possible to the position just prior to hint.
+     *
+     * The path of the hint is used as a finger: the search goes up from the hint node
+     * to the lowest node whose subtree can contain the key, the part of the path above is passed
+     * without comparisons. So a key which is d positions away from the hint needs O(log d) comparisons.
+     * @param hint iterator to the position before which the new element would be inserted
+     * @param value element value to insert
+     * @return true when an element was inserted otherwise false
+     */
+    bool insert(const_iterator hint, const value_type& value);
+
+    /**
+     * @brief insert_back is insert optimized for keys that are greater or a bit less than the maximal key in the tree.
+     *
+     * The tree keeps a finger to the maximal node, so a key greater than the maximum
+     * is compared once and linked by going along the right spine without comparisons.
+     * Otherwise the search goes up the right spine from the maximal node
+     * and the descent starts at the lowest spine node where the key can be placed,
+     * so a key which is d positions before the end needs O(log d) comparisons.
+     * Any key can be passed here, the worst case is the same as insert() has.
+     * @note any other modification of the tree drops the finger, the next insert_back restores it in O(log n) steps.
+     * @param value element value to insert
+     * @return true when an element was inserted otherwise false
+     */
+    bool insert_back(const value_type& value) {
+        return insert_near_end<1>(value);
+    }
+
+    /**
+     * @brief insert_front is the mirror of insert_back for keys that are less or a bit greater than the minimal key in the tree.
+     * @param value element value to insert
+     * @return true when an element was inserted otherwise false
+     */
+    bool insert_front(const value_type& value) {
+        return insert_near_end<0>(value);
+    }
+
     /**
      * @brief erase Removes specified elements from the container.
      * @param key
@@ -215,22 +586,122 @@ public:
      */
     size_type erase(const key_type& key);
 
+    /**
+     * @brief erase Removes the element at pos.
+     * @param pos iterator to the element to remove
+     * @return Iterator following the removed element.
+     */
+    iterator erase(const_iterator pos);
+
+    /**
+     * @brief extract unlinks the element from the tree without destroying it.
+     * @return the handle that owns the node or the empty handle when there is no such key
+     */
+    node_handle extract(const key_type& key) requires is_transferable;
+
+    node_handle extract(const_iterator pos) requires is_transferable {
+        return extract(Node::get_key(pos.node()->value));
+    }
+
     /**
      * @brief swap Exchanges the contents of the container with those of other.
      *
      * Does not invoke any move, copy, or swap operations on individual elements.
      * @param other container to exchange the contents with
      */
-    void swap(tree<Key, T, B, Compare, Alloc>& other);
+    void swap(tree<Key, T, B, Compare, Alloc, A>& other);
 
     /**
      * @brief clear Erases all elements from the container.
      *
      * After this call, size() returns zero.
+     * Complexity is O(1) for util::arena_allocator and trivially destructible value_type otherwise O(n).
      */
     void clear() noexcept;
-//    template <class... Args>
-//    bool emplace (Args&&... args);
+
+    //Split & join
+    /**
+     * @brief split moves the elements that are not less than x into right.
+     *
+     * The previous content of right is erased. The tree is split in O(log n), then the parts are counted
+     * in O(k) where k is the size of the smaller part, so size() stays O(1).
+     * When nodes are augmented with binary_tree::order_statistic the parts aren't walked and split() is O(log n).
+     * @param x the key to split by
+     * @param right the tree that receives the greater part
+     */
+    template <typename K>
+    void split(const K& x, tree& right) requires is_joinable;
+
+    /**
+     * @brief join moves all elements of right to the end of this tree in O(log n).
+     * @note all keys of right must be greater than the keys of this tree.
+     * @param right the tree to append, it becomes empty
+     */
+    void join(tree& right) requires is_joinable;
+
+    //Bulk erase
+    /**
+     * @brief erase_range removes the elements with keys in [lo, hi).
+     *
+     * The range is detached by two splits and the rest is joined back, so the tree is rebalanced
+     * along two paths only and the removed nodes are freed at once like clear() does.
+     * Complexity is O(k + log n) where k is the number of removed elements.
+     * An empty or inverted range (hi isn't greater than lo) removes nothing.
+     * @return number of removed elements
+     */
+    template <typename K>
+    size_type erase_range(const K& lo, const K& hi) requires is_joinable;
+
+    /**
+     * @brief erase_if removes all elements that satisfy the predicate.
+     *
+     * The tree is rebuilt bottom-up by joins in one pass: kept nodes are relinked and erased ones are freed,
+     * so there are no rotations per removed element. Complexity is O(n).
+     * The predicate is called once per element in ascending order.
+     * If it throws the elements that have been checked before stay removed and the tree remains valid.
+     * @param pred functor that takes const value_type& and returns true for the elements to remove
+     * @return number of removed elements
+     */
+    template <typename Pred>
+    size_type erase_if(Pred pred) requires is_joinable;
+
+    //Set operations
+    /*
+     * Set operations are join-based: the other tree is split by the root key of this tree
+     * and both halves are processed recursively. It takes O(m log(n/m + 1)) comparisons
+     * where m is the size of the smaller tree, the halves are independent and can run in parallel.
+     * Nodes of other are moved into this tree or destroyed, other becomes empty.
+     * PARALLEL policy requires an allocator that can be used from several threads.
+     */
+
+    /**
+     * @brief set_union adds all elements of other that aren't in this tree.
+     *
+     * Elements of this tree win over equivalent elements of other.
+     * @param other the tree to merge, it becomes empty
+     * @param policy runs the work in the calling thread or in several threads
+     */
+    void set_union(tree& other, ExecutionPolicy policy = ExecutionPolicy::SEQUENTIAL) requires is_joinable {
+        set_operation<set_rule<true, true, true>>(other, policy);
+    }
+
+    /**
+     * @brief set_intersection keeps only the elements that have equivalent keys in other.
+     * @param other the tree to intersect with, it becomes empty
+     * @param policy runs the work in the calling thread or in several threads
+     */
+    void set_intersection(tree& other, ExecutionPolicy policy = ExecutionPolicy::SEQUENTIAL) requires is_joinable {
+        set_operation<set_rule<true, false, false>>(other, policy);
+    }
+
+    /**
+     * @brief set_difference removes the elements that have equivalent keys in other.
+     * @param other the tree to subtract, it becomes empty
+     * @param policy runs the work in the calling thread or in several threads
+     */
+    void set_difference(tree& other, ExecutionPolicy policy = ExecutionPolicy::SEQUENTIAL) requires is_joinable {
+        set_operation<set_rule<false, true, false>>(other, policy);
+    }
 
     //Lookup
     /**
@@ -247,146 +718,1286 @@ public:
     }
 
     /**
-     * @brief calls functor f for every element in the tree
-     * @tparam F functional object type
+     * @brief contains_batch looks up many keys at once: result[i] is true when the tree contains first[i].
+     *
+     * Descents of up to batch_width keys are interleaved: every round moves each of them one level down
+     * and prefetches the next node, so cache misses of different keys overlap instead of waiting one by one.
+     * It pays off for big batches of random keys in the tree that doesn't fit in cache.
+     * @param first, last the keys to look up
+     * @param result the beginning of the output range that has last - first elements
      */
-    template <typename F>
-    void enumerate(F visitor, EnumerationOrder order = EnumerationOrder::ASCENDING);
+    template <std::random_access_iterator KeyIt, std::random_access_iterator OutIt>
+    void contains_batch(KeyIt first, KeyIt last, OutIt result) const {
+        batch_lookup(first, last, [&result](std::size_t i, node_pointer node) {
+            result[i] = node != nullptr;
+        });
+    }
 
-    //Test & debug
     /**
-     * @brief check_height_test for testing purposes only!
+     * @brief find_batch is contains_batch that stores pointers to the found elements or nullptr.
      */
-    template<typename F>
-    void check_height_test(F check_height) const {
-        recursive_check_height(root, check_height);
+    template <std::random_access_iterator KeyIt, std::random_access_iterator OutIt>
+    void find_batch(KeyIt first, KeyIt last, OutIt result) const {
+        batch_lookup(first, last, [&result](std::size_t i, node_pointer node) {
+            result[i] = node == nullptr ? nullptr : &std::as_const(node->value);
+        });
     }
 
     /**
-     * @brief dump_tree dumps tree content into graphviz BST format
-     * @param ss
+     * @brief find finds an element with key equivalent to x.
+     * @return Iterator to the found element or end().
      */
-    void dump_tree (std::ostream& ss) const {
-        ss << "digraph BST {\n";
-        recursive_dump(root, ss);
-        ss << "}\n";
+    template <typename K>
+    [[nodiscard]] iterator find(const K& x) {
+        return find_impl<iterator>(x);
     }
 
-private:
-    Node_alloc_type  node_allocator;
-    node_pointer     root = nullptr;
-    size_t           node_count = 0;
+    template <typename K>
+    [[nodiscard]] const_iterator find(const K& x) const {
+        return find_impl<const_iterator>(x);
+    }
 
-    template<typename K>
-    static node_pointer lookup(node_pointer node, const K& key) {
-        while (node != nullptr && key != Node::get_key(node->value))
-            node = node->get_next(key);
-        return node;
+    /**
+     * @brief lower_bound finds the first element that is not less than x in O(log n).
+     * @return Iterator to the found element or end().
+     */
+    template <typename K>
+    [[nodiscard]] iterator lower_bound(const K& x) {
+        return bound_impl<iterator, false>(x);
     }
 
-    template <typename F>
-    static void enumerate_impl(node_pointer root, unsigned node_count, int dir, F f);
+    template <typename K>
+    [[nodiscard]] const_iterator lower_bound(const K& x) const {
+        return bound_impl<const_iterator, false>(x);
+    }
 
-    //For testing
-    template<typename F>
-    static void recursive_check_height(node_pointer node, F check_height) {
-        if (node == nullptr) return;
-        recursive_check_height(node->links[0], check_height);
-        recursive_check_height(node->links[1], check_height);
-        check_height(node_type::get_height(node->links[0]), node_type::get_height(node->links[1]));
+    /**
+     * @brief upper_bound finds the first element that is greater than x in O(log n).
+     * @return Iterator to the found element or end().
+     */
+    template <typename K>
+    [[nodiscard]] iterator upper_bound(const K& x) {
+        return bound_impl<iterator, true>(x);
     }
 
-    static void recursive_dump(node_pointer node, std::ostream& ss) {
-        if (node != nullptr) {
-            ss << '"' << Node::get_key(node->value) << "\" -> { " ;
-            if (node->links[0] != nullptr) {
-                ss << '"' << Node::get_key(node->links[0]->value) << "\" ";
-            }
-            if (node->links[1] != nullptr) {
-                ss << '"' << Node::get_key(node->links[1]->value) << "\" ";
-            }
-            ss << "}\n";
-            recursive_dump(node->links[0], ss);
-            recursive_dump(node->links[1], ss);
-        }
+    template <typename K>
+    [[nodiscard]] const_iterator upper_bound(const K& x) const {
+        return bound_impl<const_iterator, true>(x);
     }
-};
 
-template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc>
-tree<Key, T, B, Compare, Alloc>::tree() noexcept
-{}
+    /**
+     * @brief equal_range returns a range containing all elements with key equivalent to x (it is one element at most).
+     * @return pair of lower_bound(x) and upper_bound(x)
+     */
+    template <typename K>
+    [[nodiscard]] std::pair<iterator, iterator> equal_range(const K& x) {
+        return equal_range_impl<iterator>(x);
+    }
 
-template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc>
-tree<Key, T, B, Compare, Alloc>::~tree() {
-    clear();
-}
+    template <typename K>
+    [[nodiscard]] std::pair<const_iterator, const_iterator> equal_range(const K& x) const {
+        return equal_range_impl<const_iterator>(x);
+    }
 
-template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc>
-bool tree<Key, T, B, Compare, Alloc>::empty() const noexcept {
-    return size() == 0;
-}
+    //Order statistic
+    /**
+     * @brief select finds the element that has the given position in the ascending order in O(log n).
+     *
+     * Is available when the tree is augmented with binary_tree::order_statistic.
+     * @param index zero based position of the element
+     * @return Iterator to the found element or end() when index >= size()
+     */
+    [[nodiscard]] iterator select(size_type index) requires sized_node<Node> {
+        return select_impl<iterator>(index);
+    }
 
-template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc>
-typename tree<Key, T, B, Compare, Alloc>::size_type tree<Key, T, B, Compare, Alloc>::size() const noexcept {
-    return node_count;
-}
+    [[nodiscard]] const_iterator select(size_type index) const requires sized_node<Node> {
+        return select_impl<const_iterator>(index);
+    }
 
-template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc>
-typename tree<Key, T, B, Compare, Alloc>::size_type tree<Key, T, B, Compare, Alloc>::max_size() const noexcept {
-    return std::numeric_limits<size_t>::max()/sizeof(tree<Key, T, B, Compare, Alloc>::node_type);
-}
+    /**
+     * @brief rank counts elements that are less than x in O(log n).
+     *
+     * Is available when the tree is augmented with binary_tree::order_statistic.
+     * @return number of elements less than x, it is the position of x when the tree contains x.
+     */
+    template <typename K>
+    [[nodiscard]] size_type rank(const K& x) const requires sized_node<Node>;
+
+    /**
+     * @brief range_aggregate combines the values that have keys in [lo, hi) in O(log n).
+     *
+     * Is available when the tree is augmented with binary_tree::aggregate.
+     * @return aggregate of the values in the ascending order of keys or the identity when there are no such values
+     */
+    template <typename K>
+    [[nodiscard]] auto range_aggregate(const K& lo, const K& hi) const requires summarized_node<Node>;
+
+    //Interval queries
+    /**
+     * @brief enumerate_overlapping calls visitor(value) for every interval that overlaps [lo, hi)
+     * in the ascending order while visitor returns true.
+     *
+     * Is available when the tree is augmented with binary_tree::interval_augment.
+     * Subtrees that end before lo are skipped and the walk stops at the first interval that starts at hi,
+     * so it visits O(log n) nodes for the first overlapping interval and O(log n) at most for each next one.
+     */
+    template <typename Bound, typename F>
+    void enumerate_overlapping(const Bound& lo, const Bound& hi, F visitor) const requires interval_node<Node> {
+        enumerate_overlapping_impl(lo, hi, false, visitor);
+    }
+
+    /**
+     * @brief enumerate_stabbing calls visitor(value) for every interval that contains the point x
+     * in the ascending order while visitor returns true.
+     *
+     * Is available when the tree is augmented with binary_tree::interval_augment.
+     */
+    template <typename Bound, typename F>
+    void enumerate_stabbing(const Bound& x, F visitor) const requires interval_node<Node> {
+        enumerate_overlapping_impl(x, x, true, visitor);
+    }
+
+    /**
+     * @brief freeze copies the elements into binary_tree::frozen_tree in O(n).
+     *
+     * The copy is immutable, its lookups need no pointer chasing and are faster than count() of this tree.
+     */
+    [[nodiscard]] frozen_tree<Key, T, Compare> freeze() const {
+        return frozen_tree<Key, T, Compare>(begin(), end());
+    }
+
+    //Iterators
+    [[nodiscard]] iterator begin() noexcept {
+        return outermost<iterator>(0);
+    }
+    [[nodiscard]] const_iterator begin() const noexcept {
+        return outermost<const_iterator>(0);
+    }
+    [[nodiscard]] const_iterator cbegin() const noexcept {
+        return begin();
+    }
+    [[nodiscard]] iterator end() noexcept {
+        return iterator(root);
+    }
+    [[nodiscard]] const_iterator end() const noexcept {
+        return const_iterator(root);
+    }
+    [[nodiscard]] const_iterator cend() const noexcept {
+        return end();
+    }
+    [[nodiscard]] reverse_iterator rbegin() noexcept {
+        return reverse_iterator(end());
+    }
+    [[nodiscard]] const_reverse_iterator rbegin() const noexcept {
+        return const_reverse_iterator(end());
+    }
+    [[nodiscard]] reverse_iterator rend() noexcept {
+        return reverse_iterator(begin());
+    }
+    [[nodiscard]] const_reverse_iterator rend() const noexcept {
+        return const_reverse_iterator(begin());
+    }
+
+    /**
+     * @brief calls functor f for every element in the tree
+     * @tparam F functional object type
+     */
+    template <typename F>
+    void enumerate(F visitor, EnumerationOrder order = EnumerationOrder::ASCENDING);
+
+    /**
+     * @brief parallel_for_each calls f(value) for every element in the tree, the order isn't defined.
+     *
+     * The top levels of the tree are split into subtrees that become tasks of the work-stealing pool,
+     * idle threads steal the biggest pending subtrees, so uneven work spreads over the threads too.
+     * f is called concurrently for different elements with value_type&, the key of a map element is const there.
+     * f must not change the tree.
+     */
+    template <typename F>
+    void parallel_for_each(F f, util::work_stealing_pool& pool = util::work_stealing_pool::shared());
+
+    /**
+     * @brief parallel_reduce combines map(value) of all elements in the ascending order of keys in parallel.
+     *
+     * The subtrees are reduced by tasks of the work-stealing pool and merged in order: left, node, right.
+     * So combine has to be associative but doesn't have to be commutative.
+     * @return identity when the tree is empty
+     */
+    template <typename R, typename Map, typename Combine>
+    [[nodiscard]] R parallel_reduce(R identity, Map map, Combine combine,
+                                    util::work_stealing_pool& pool = util::work_stealing_pool::shared()) const;
 
-template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc>
-bool tree<Key, T, B, Compare, Alloc>::insert(const tree<Key, T, B, Compare, Alloc>::value_type& value) {
-    return B::insert(&root, value, [this](tree<Key, T, B, Compare, Alloc>::Node** parent_ptr, const tree<Key, T, B, Compare, Alloc>::value_type& value){
+    //Test & debug
+    /**
+     * @brief check_height_test for testing purposes only!
+     */
+    template<typename F>
+    void check_height_test(F check_height) const {
+        recursive_check_height(root, check_height);
+    }
+
+    /**
+     * @brief verify_test checks the balancer rules for the whole tree, for testing purposes only!
+     */
+    bool verify_test() const {
+        return B::verify(root);
+    }
+
+    /**
+     * @brief dump_tree dumps tree content into graphviz BST format
+     * @param ss
+     */
+    void dump_tree (std::ostream& ss) const {
+        ss << "digraph BST {\n";
+        recursive_dump(root, ss);
+        ss << "}\n";
+    }
+
+private:
+    Node_alloc_type  node_allocator;
+    node_pointer     root = nullptr;
+    /// The number of elements, split() counts the smaller part, so it is always valid
+    size_t           node_count = 0;
+    /**
+     * Cached outermost nodes (minimum and maximum) for insert_front and insert_back.
+     * Only these methods keep them, any other modification drops them.
+     */
+    node_pointer     finger[2] = {nullptr, nullptr};
+
+    template<typename K>
+    static node_pointer lookup(node_pointer node, const K& key) {
+        while (node != nullptr && key != Node::get_key(node->value))
+            node = node->get_next(key);
+        return node;
+    }
+
+    ///Number of interleaved descents of contains_batch and find_batch
+    static constexpr int batch_width = 16;
+
+    /**
+     * @brief batch_lookup calls found(i, node) for every key first[i], node is nullptr when the key isn't found
+     */
+    template <typename KeyIt, typename F>
+    void batch_lookup(KeyIt first, KeyIt last, F found) const;
+
+    template <typename F>
+    static void enumerate_impl(node_pointer root, unsigned node_count, int dir, F f);
+
+    /**
+     * @brief parallel_depth
+     * @return depth of the subtrees that aren't split any more, it gives about 8 tasks per thread
+     * and doesn't split subtrees of less than 2^12 nodes
+     */
+    int parallel_depth(const util::work_stealing_pool& pool) const noexcept {
+        int depth = std::bit_width(pool.concurrency()) + 3;
+        return std::min(depth, std::max(static_cast<int>(std::bit_width(node_count)) - 12, 0));
+    }
+
+    template <typename F>
+    static void for_each_subtree(node_pointer node, int depth, F& f, util::work_stealing_pool& pool);
+
+    template <typename R, typename Map, typename Combine>
+    static R reduce_subtree(node_pointer node, int depth, const R& identity, Map& map, Combine& combine,
+                            util::work_stealing_pool& pool);
+
+    template <typename Bound, typename F>
+    void enumerate_overlapping_impl(const Bound& lo, const Bound& hi, bool includes_hi, F& visitor) const;
+
+    template <typename It>
+    It outermost(int dir) const noexcept {
+        It it(root);
+        it.descend(root, dir);
+        return it;
+    }
+
+    template <typename It, typename K>
+    It find_impl(const K& key) const {
+        It it(root);
+        for (auto node = root; node != nullptr;) {
+            it.push(node);
+            auto cmp = node->compare(key);
+            if (cmp == std::strong_ordering::equivalent)
+                return it;
+            node = node->get_next(cmp);
+        }
+        return It(root);
+    }
+
+    /**
+     * @brief bound_impl finds the first node that is greater (upper) or not less (!upper) than the key.
+     */
+    template <typename It, bool upper, typename K>
+    It bound_impl(const K& key) const {
+        It it(root);
+        unsigned found = 0;
+        for (auto node = root; node != nullptr;) {
+            it.push(node);
+            auto cmp = node->compare(key);
+            if (std::is_lt(cmp) || (!upper && cmp == std::strong_ordering::equivalent)) {
+                found = it.depth;
+                if (cmp == std::strong_ordering::equivalent)
+                    break;
+                node = node->links[0];
+            } else {
+                node = node->links[1];
+            }
+        }
+        // the path above the found node is its ancestors
+        it.depth = found;
+        return it;
+    }
+
+    template <typename It>
+    It select_impl(size_type index) const {
+        It it(root);
+        for (auto node = root; node != nullptr;) {
+            it.push(node);
+            auto left = order_statistic::size(node->links[0]);
+            if (index == left)
+                return it;
+            if (index < left) {
+                node = node->links[0];
+            } else {
+                index -= left + 1;
+                node = node->links[1];
+            }
+        }
+        return It(root);
+    }
+
+    template <typename It, typename K>
+    std::pair<It, It> equal_range_impl(const K& key) const {
+        auto first = bound_impl<It, false>(key);
+        auto last = first;
+        if (first.depth != 0 && first.node()->compare(key) == std::strong_ordering::equivalent) {
+            ++last;
+        }
+        return {first, last};
+    }
+
+    /**
+     * @brief height_limit
+     * @return the maximal height of the tree that contains count nodes
+     */
+    static size_type height_limit(size_type count) noexcept {
+        return B::max_height(count);
+    }
+
+    /**
+     * @brief height_bound
+     * @return the maximal height of this tree
+     */
+    size_type height_bound() const noexcept {
+        return height_limit(node_count);
+    }
+
+    /**
+     * Root and height of a subtree, the height is measured by the balancer.
+     * The height of a child is known from the height of its parent,
+     * so join-based algorithms compute the height only once at the root.
+     */
+    struct subtree {
+        node_pointer root   = nullptr;
+        int          height = 0;
+    };
+
+    subtree whole() const noexcept {
+        return {root, B::height(root)};
+    }
+
+    static subtree child(subtree t, int dir) noexcept {
+        return {t.root->links[dir], B::child_height(t.root, t.height, dir)};
+    }
+
+    static subtree join(subtree left, node_pointer middle, subtree right) noexcept {
+        auto [node, height] = B::join(left.root, left.height, middle, right.root, right.height);
+        return {node, height};
+    }
+
+    static subtree join(subtree left, subtree right) noexcept;
+
+    static subtree split_last(subtree t, node_pointer& last) noexcept;
+
+    template <typename K>
+    static std::pair<subtree, subtree> split(subtree t, const K& key, node_pointer& found) noexcept;
+
+    /**
+     * @return the subtree without the nodes that satisfy pred, removed is increased by the number of destroyed nodes.
+     * The predicate isn't called after error has been set.
+     */
+    template <typename Pred>
+    subtree erase_if(subtree t, Pred& pred, size_type& removed, std::exception_ptr& error) noexcept;
+
+    /// Tells which nodes are kept by the set operation: found in both trees, only in this one, only in other
+    template <bool Common, bool This, bool Other>
+    struct set_rule {
+        static constexpr bool keep_common = Common;
+        static constexpr bool keep_this   = This;
+        static constexpr bool keep_other  = Other;
+    };
+
+    /**
+     * Subtrees that are lower than parallel_height are processed in the same thread,
+     * AVL subtree of this height has at least 2^(parallel_height/1.44) nodes.
+     */
+    static constexpr int parallel_height = 16;
+
+    /**
+     * @brief set_operation is the common part of set_union, set_intersection and set_difference
+     * @tparam Op set_rule of the operation
+     */
+    template <typename Op>
+    void set_operation(tree& other, ExecutionPolicy policy);
+
+    /**
+     * @return the result of the operation on a and b, removed is increased by the number of destroyed nodes
+     */
+    template <typename Op>
+    subtree set_operation(subtree a, subtree b, size_type& removed, int spawn_depth) noexcept;
+
+    /**
+     * @brief take puts the root that has been built by join-based operations.
+     * @param count the number of nodes, it is ignored when the nodes keep subtree sizes
+     */
+    void take(subtree t, size_type count) noexcept;
+
+    template <int dir>
+    bool insert_near_end(const value_type& value);
+
+    void drop_fingers() noexcept {
+        finger[0] = finger[1] = nullptr;
+    }
+
+    template <typename... Args>
+    node_pointer create_node(Args&&... args) {
         auto new_node = node_allocator.allocate(1);
-        std::allocator_traits<Node_alloc_type>::construct(node_allocator, new_node, value);
+        try {
+            std::allocator_traits<Node_alloc_type>::construct(node_allocator, new_node, std::forward<Args>(args)...);
+        } catch (...) {
+            node_allocator.deallocate(new_node, 1);
+            throw;
+        }
+        return new_node;
+    }
+
+    /**
+     * @brief link_node inserts the node that has been created or extracted before
+     * @return true when the node was linked, false when the tree contains an equivalent key
+     */
+    bool link_node(node_pointer new_node) {
+        drop_fingers();
+        const auto& key = Node::get_key(new_node->value);
+        return B::insert_by(&root, [&key](node_pointer node) {
+            return node->compare(key);
+        }, [this, new_node](node_pointer* link) {
+            *link = new_node;
+            ++node_count;
+        }).second;
+    }
+
+    template <typename K, typename... Args>
+    bool try_emplace_impl(K&& key, Args&&... args);
+
+    void destroy_node(node_pointer node) noexcept {
+        std::allocator_traits<Node_alloc_type>::destroy(node_allocator, node);
+        node_allocator.deallocate(node, 1);
+    }
+
+    /**
+     * @brief free_subtree destroys and deallocates all nodes of the subtree
+     * @param subtree root of the subtree
+     * @param count number of nodes in the subtree (is used to estimate the subtree height)
+     */
+    size_type free_subtree(node_pointer subtree, size_type count) noexcept;
+
+    template <typename It>
+    node_pointer build_sorted(It& it, size_type count, int depth, int height);
+
+    //For testing
+    template<typename F>
+    static void recursive_check_height(node_pointer node, F check_height) {
+        if (node == nullptr) return;
+        recursive_check_height(node->links[0], check_height);
+        recursive_check_height(node->links[1], check_height);
+        check_height(node_type::get_height(node->links[0]), node_type::get_height(node->links[1]));
+    }
+
+    static void recursive_dump(node_pointer node, std::ostream& ss) {
+        if (node != nullptr) {
+            ss << '"' << Node::get_key(node->value) << "\" -> { " ;
+            if (node->links[0] != nullptr) {
+                ss << '"' << Node::get_key(node->links[0]->value) << "\" ";
+            }
+            if (node->links[1] != nullptr) {
+                ss << '"' << Node::get_key(node->links[1]->value) << "\" ";
+            }
+            ss << "}\n";
+            recursive_dump(node->links[0], ss);
+            recursive_dump(node->links[1], ss);
+        }
+    }
+};
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+tree<Key, T, B, Compare, Alloc, A>::tree() noexcept
+{}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template <std::forward_iterator It>
+tree<Key, T, B, Compare, Alloc, A>::tree(It first, It last)
+{
+    assign(first, last);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+tree<Key, T, B, Compare, Alloc, A>::~tree() {
+    clear();
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template <std::forward_iterator It>
+void tree<Key, T, B, Compare, Alloc, A>::assign(It first, It last) {
+    assert(std::adjacent_find(first, last, [](const value_type& a, const value_type& b){
+        return !std::is_lt(key_compare{}(Node::get_key(a), Node::get_key(b)));
+    }) == last);
+
+    clear();
+    auto count = static_cast<size_type>(std::distance(first, last));
+    root = build_sorted(first, count, 0, std::bit_width(count));
+    node_count = count;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+bool tree<Key, T, B, Compare, Alloc, A>::empty() const noexcept {
+    return root == nullptr;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+typename tree<Key, T, B, Compare, Alloc, A>::size_type tree<Key, T, B, Compare, Alloc, A>::size() const noexcept {
+    return node_count;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+typename tree<Key, T, B, Compare, Alloc, A>::size_type tree<Key, T, B, Compare, Alloc, A>::max_size() const noexcept {
+    return std::numeric_limits<size_t>::max()/sizeof(tree<Key, T, B, Compare, Alloc, A>::node_type);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+bool tree<Key, T, B, Compare, Alloc, A>::insert(const tree<Key, T, B, Compare, Alloc, A>::value_type& value) {
+    drop_fingers();
+    return B::insert(&root, value, [this](tree<Key, T, B, Compare, Alloc, A>::Node** parent_ptr, const tree<Key, T, B, Compare, Alloc, A>::value_type& value){
+        *parent_ptr = create_node(value);
         ++node_count;
-        *parent_ptr = new_node;
     });
 }
 
-template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc>
-typename tree<Key, T, B, Compare, Alloc>::size_type tree<Key, T, B, Compare, Alloc>::erase(const tree<Key, T, B, Compare, Alloc>::key_type& key) {
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+bool tree<Key, T, B, Compare, Alloc, A>::insert(value_type&& value) {
+    drop_fingers();
+    const auto& key = Node::get_key(value);
+    return B::insert_by(&root, [&key](node_pointer node) {
+        return node->compare(key);
+    }, [this, &value](node_pointer* link) {
+        *link = create_node(std::move(value));
+        ++node_count;
+    }).second;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+bool tree<Key, T, B, Compare, Alloc, A>::insert(node_handle&& handle) requires is_transferable {
+    if (handle.empty() || !link_node(handle.node))
+        return false;
+    handle.node = nullptr;
+    return true;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template <typename... Args>
+bool tree<Key, T, B, Compare, Alloc, A>::emplace(Args&&... args) {
+    auto new_node = create_node(std::in_place, std::forward<Args>(args)...);
+    if (link_node(new_node))
+        return true;
+    destroy_node(new_node);
+    return false;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template <typename K, typename... Args>
+bool tree<Key, T, B, Compare, Alloc, A>::try_emplace_impl(K&& key, Args&&... args) {
+    drop_fingers();
+    return B::insert_by(&root, [&key](node_pointer node) {
+        return node->compare(key);
+    }, [&](node_pointer* link) {
+        *link = create_node(std::in_place, std::piecewise_construct,
+                            std::forward_as_tuple(std::forward<K>(key)),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+        ++node_count;
+    }).second;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+bool tree<Key, T, B, Compare, Alloc, A>::insert(const_iterator hint, const value_type& value) {
+    if (hint.depth == 0)
+        return insert_back(value);
+
+    // Looking for the lowest path node whose subtree can contain the key.
+    // Subtree of path[i] is limited by the nearest ancestors where the path turns left (hi) and right (lo).
+    const auto& key = Node::get_key(value);
+    const auto& path = hint.path;
+    auto top = hint.depth - 1;
+    for (bool inside = false; !inside;) {
+        int hi = -1;
+        int lo = -1;
+        for (auto i = top; i-- > 0 && (hi < 0 || lo < 0);) {
+            if (path[i]->links[0] == path[i + 1]) {
+                hi = hi < 0 ? i : hi;
+            } else {
+                lo = lo < 0 ? i : lo;
+            }
+        }
+        inside = true;
+        for (auto [bound, dir] : {std::pair{hi, 0}, std::pair{lo, 1}}) {
+            if (bound < 0)
+                continue;
+            auto cmp = path[bound]->compare(key);
+            if (cmp == std::strong_ordering::equivalent)
+                return false;
+            if (path[bound]->get_direction(cmp) != dir) {
+                top = bound;
+                inside = false;
+                break;
+            }
+        }
+    }
+
+    // The descent repeats the hint path down to path[top] without comparisons
+    drop_fingers();
+    return B::insert_by(&root, [&path, top, &key, i = 0u](node_pointer node) mutable {
+        if (i < top) {
+            ++i;
+            return path[i - 1]->links[1] == path[i] ? std::strong_ordering::greater : std::strong_ordering::less;
+        }
+        return node->compare(key);
+    }, [this, &value](node_pointer* link) {
+        *link = create_node(value);
+        ++node_count;
+    }).second;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template <int dir>
+bool tree<Key, T, B, Compare, Alloc, A>::insert_near_end(const value_type& value) {
+    const auto& key = Node::get_key(value);
+    static constexpr auto outside = dir == 1 ? std::strong_ordering::greater : std::strong_ordering::less;
+    static constexpr auto opposite_outside = dir == 1 ? std::strong_ordering::less : std::strong_ordering::greater;
+    auto create = [this, &value](node_pointer* link) {
+        *link = create_node(value);
+        ++node_count;
+    };
+
+    // Fast path: the finger points to the outermost node and the key is beyond it.
+    // The descent goes along the spine without any comparisons.
+    if (auto outermost = finger[dir]; outermost != nullptr) [[likely]] {
+        auto cmp = outermost->compare(key);
+        if (cmp == std::strong_ordering::equivalent)
+            return false;
+        if (cmp == outside) {
+            finger[dir] = B::insert_by(&root, [](node_pointer) {
+                return outside;
+            }, create).first;
+            return true;
+        }
+    }
+
+    // Collect the spine that goes from the root to the outermost node
+    auto tree_height = height_bound();
+    node_pointer spine[tree_height + 1];
+    size_type depth = 0;
+    for (auto node = root; node != nullptr; node = node->links[dir]) {
+        spine[depth++] = node;
+    }
+    finger[dir] = depth > 0 ? spine[depth - 1] : nullptr;
+
+    // Going up while the key is inside the spine node subtree.
+    // Every spine node above the found one sends the key to the same direction.
+    auto skip = depth;
+    for (; skip > 0; --skip) {
+        auto cmp = spine[skip - 1]->compare(key);
+        if (cmp == std::strong_ordering::equivalent)
+            return false;
+        if (spine[skip - 1]->get_direction(cmp) == dir)
+            break;
+    }
+
+    auto beyond = skip == depth;
+    auto [node, inserted] = B::insert_by(&root, [skip, &key](node_pointer node) mutable {
+        if (skip > 0) {
+            --skip;
+            return outside;
+        }
+        return node->compare(key);
+    }, create);
+    if (beyond) {
+        finger[dir] = node;
+    }
+    // the key can be beyond the other end too, then the other finger has to move to the new node
+    if (inserted) {
+        auto& other_end = finger[1 - dir];
+        if (depth == 0 || (other_end != nullptr && other_end->compare(key) == opposite_outside)) {
+            other_end = node;
+        }
+    }
+    return inserted;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+typename tree<Key, T, B, Compare, Alloc, A>::size_type tree<Key, T, B, Compare, Alloc, A>::erase(const tree<Key, T, B, Compare, Alloc, A>::key_type& key) {
     auto targetn = B::erase(&root, key);
     if (targetn != nullptr) {
-        std::allocator_traits<Node_alloc_type>::destroy(node_allocator, targetn);
-        node_allocator.deallocate(targetn, 1);
+        drop_fingers();
+        destroy_node(targetn);
         --node_count;
         return 1;
     }
     return 0;
 }
 
-template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc>
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+typename tree<Key, T, B, Compare, Alloc, A>::node_handle tree<Key, T, B, Compare, Alloc, A>::extract(const key_type& key) requires is_transferable {
+    auto node = B::erase(&root, key);
+    if (node == nullptr)
+        return {};
+    drop_fingers();
+    --node_count;
+    // the node becomes the same as a new one: without links, balance info and augmentation
+    node->links[0] = node->links[1] = nullptr;
+    static_cast<typename B::Node&>(*node) = typename B::Node{};
+    static_cast<typename A::node&>(*node) = typename A::node{};
+    return node_handle(node);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+typename tree<Key, T, B, Compare, Alloc, A>::iterator tree<Key, T, B, Compare, Alloc, A>::erase(const_iterator pos) {
+    auto next = pos;
+    ++next;
+    auto next_node = next.node();
+    erase(Node::get_key(pos.node()->value));
+    // Nodes keep their values while erasing, but the path to the next node could be changed by rotations
+    return next_node == nullptr ? end() : find(Node::get_key(next_node->value));
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template <typename KeyIt, typename F>
+void tree<Key, T, B, Compare, Alloc, A>::batch_lookup(KeyIt first, KeyIt last, F found) const {
+    // Every lane is a state of one descent: the next node to compare and the key index.
+    // A finished lane takes the next key, so the lanes stay busy until the keys run out.
+    struct lane {
+        node_pointer node;
+        std::size_t  index;
+    };
+    lane lanes[batch_width];
+    auto count = static_cast<std::size_t>(last - first);
+    std::size_t next = 0;
+    int width = 0;
+    for (; width < batch_width && next < count; ++width) {
+        lanes[width] = {root, next++};
+    }
+
+    while (width > 0) {
+        for (int i = 0; i < width;) {
+            auto& current = lanes[i];
+            auto node = current.node;
+            auto cmp = node == nullptr ? std::strong_ordering::equivalent : node->compare(first[current.index]);
+            if (cmp != std::strong_ordering::equivalent) {
+                current.node = node->get_next(cmp);
+                prefetch(current.node);
+                ++i;
+                continue;
+            }
+            found(current.index, node);
+            if (next < count) {
+                current = {root, next++};
+                ++i;
+            } else {
+                // the last lane takes this place, it is handled in this round too
+                current = lanes[--width];
+            }
+        }
+    }
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename K>
+typename tree<Key, T, B, Compare, Alloc, A>::size_type tree<Key, T, B, Compare, Alloc, A>::count(const K& x) const
+{
+    return tree<Key, T, B, Compare, Alloc, A>::lookup(root, x) == nullptr? 0 : 1;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename K>
+typename tree<Key, T, B, Compare, Alloc, A>::size_type tree<Key, T, B, Compare, Alloc, A>::rank(const K& x) const requires sized_node<Node>
+{
+    size_type result = 0;
+    for (auto node = root; node != nullptr;) {
+        auto cmp = node->compare(x);
+        if (std::is_lt(cmp)) {
+            node = node->links[0];
+            continue;
+        }
+        result += order_statistic::size(node->links[0]);
+        if (cmp == std::strong_ordering::equivalent)
+            break;
+        ++result;
+        node = node->links[1];
+    }
+    return result;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename K>
+auto tree<Key, T, B, Compare, Alloc, A>::range_aggregate(const K& lo, const K& hi) const requires summarized_node<Node>
+{
+    // find the topmost node inside the range, the paths to both bounds split there
+    auto split = root;
+    while (split != nullptr) {
+        if (std::is_gt(split->compare(lo))) {
+            split = split->links[1];
+        } else if (std::is_lteq(split->compare(hi))) {
+            split = split->links[0];
+        } else {
+            break;
+        }
+    }
+    if (split == nullptr)
+        return A::identity();
+
+    // left side: every node >= lo brings itself and its right subtree
+    auto left = A::identity();
+    for (auto node = split->links[0]; node != nullptr;) {
+        if (std::is_gt(node->compare(lo))) {
+            node = node->links[1];
+        } else {
+            left = A::combine(A::combine(A::lift(node), A::summary(node->links[1])), left);
+            node = node->links[0];
+        }
+    }
+
+    // right side: every node < hi brings itself and its left subtree
+    auto right = A::identity();
+    for (auto node = split->links[1]; node != nullptr;) {
+        if (std::is_lteq(node->compare(hi))) {
+            node = node->links[0];
+        } else {
+            right = A::combine(right, A::combine(A::summary(node->links[0]), A::lift(node)));
+            node = node->links[1];
+        }
+    }
+    return A::combine(A::combine(left, A::lift(split)), right);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename Bound, typename F>
+void tree<Key, T, B, Compare, Alloc, A>::enumerate_overlapping_impl(const Bound& lo, const Bound& hi, bool includes_hi, F& visitor) const
+{
+    node_pointer stack[max_depth];
+    unsigned depth = 0;
+    for (auto node = root; node != nullptr || depth > 0;) {
+        // the subtree that has no interval ending after lo is skipped
+        for (; node != nullptr && lo < node->max_high; node = node->links[0]) {
+            stack[depth++] = node;
+        }
+        if (depth == 0)
+            return;
+        node = stack[--depth];
+        const auto& key = Node::get_key(node->value);
+        // the intervals are ordered by low, all next ones start after the query too
+        if (includes_hi ? hi < key.low : !(key.low < hi))
+            return;
+        if (lo < key.high && !visitor(std::as_const(node->value)))
+            return;
+        node = node->links[1];
+    }
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename F>
+void tree<Key, T, B, Compare, Alloc, A>::parallel_for_each(F f, util::work_stealing_pool& pool)
+{
+    for_each_subtree(root, parallel_depth(pool), f, pool);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename F>
+void tree<Key, T, B, Compare, Alloc, A>::for_each_subtree(node_pointer node, int depth, F& f, util::work_stealing_pool& pool)
+{
+    if (node == nullptr)
+        return;
+    if (depth == 0) {
+        node_pointer stack[max_depth];
+        unsigned stack_depth = 0;
+        for (stack[stack_depth++] = node; stack_depth > 0;) {
+            node = stack[--stack_depth];
+            f(node->value);
+            for (auto child : node->links) {
+                if (child != nullptr)
+                    stack[stack_depth++] = child;
+            }
+        }
+        return;
+    }
+
+    util::work_stealing_pool::task_group group;
+    pool.spawn(group, [&] {
+        for_each_subtree(node->links[0], depth - 1, f, pool);
+    });
+    try {
+        f(node->value);
+        for_each_subtree(node->links[1], depth - 1, f, pool);
+    } catch (...) {
+        // the task refers to this frame, so it has to be finished before unwinding
+        try {
+            pool.wait(group);
+        } catch (...) {
+        }
+        throw;
+    }
+    pool.wait(group);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename R, typename Map, typename Combine>
+R tree<Key, T, B, Compare, Alloc, A>::parallel_reduce(R identity, Map map, Combine combine, util::work_stealing_pool& pool) const
+{
+    return reduce_subtree(root, parallel_depth(pool), identity, map, combine, pool);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename R, typename Map, typename Combine>
+R tree<Key, T, B, Compare, Alloc, A>::reduce_subtree(node_pointer node, int depth, const R& identity, Map& map, Combine& combine,
+                                                     util::work_stealing_pool& pool)
+{
+    if (node == nullptr)
+        return identity;
+    if (depth == 0) {
+        auto result = identity;
+        node_pointer stack[max_depth];
+        unsigned stack_depth = 0;
+        while (node != nullptr || stack_depth > 0) {
+            for (; node != nullptr; node = node->links[0]) {
+                stack[stack_depth++] = node;
+            }
+            node = stack[--stack_depth];
+            result = combine(std::move(result), map(std::as_const(node->value)));
+            node = node->links[1];
+        }
+        return result;
+    }
+
+    auto left = identity;
+    util::work_stealing_pool::task_group group;
+    pool.spawn(group, [&] {
+        left = reduce_subtree(node->links[0], depth - 1, identity, map, combine, pool);
+    });
+    auto right = identity;
+    try {
+        right = combine(map(std::as_const(node->value)), reduce_subtree(node->links[1], depth - 1, identity, map, combine, pool));
+    } catch (...) {
+        // the task refers to this frame, so it has to be finished before unwinding
+        try {
+            pool.wait(group);
+        } catch (...) {
+        }
+        throw;
+    }
+    pool.wait(group);
+    return combine(std::move(left), std::move(right));
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
 template<typename K>
-typename tree<Key, T, B, Compare, Alloc>::size_type tree<Key, T, B, Compare, Alloc>::count(const K& x) const
+void tree<Key, T, B, Compare, Alloc, A>::split(const K& x, tree& right) requires is_joinable
 {
-    return tree<Key, T, B, Compare, Alloc>::lookup(root, x) == nullptr? 0 : 1;
+    if (this == &right)
+        return;
+    right.clear();
+    node_pointer found = nullptr;
+    auto [left_part, right_part] = split(whole(), x, found);
+    if (found != nullptr) {
+        right_part = join(subtree{}, found, right_part);
+    }
+    auto count = node_count;
+    take(left_part, count);
+    right.take(right_part, 0);
+    if constexpr (!sized_node<Node>) {
+        // the parts are walked together, so only the smaller one is walked to the end
+        auto l = begin();
+        auto r = right.begin();
+        size_type smaller = 0;
+        for (; l != end() && r != right.end(); ++l, ++r) {
+            ++smaller;
+        }
+        node_count = l == end() ? smaller : count - smaller;
+        right.node_count = count - node_count;
+    }
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+void tree<Key, T, B, Compare, Alloc, A>::join(tree& right) requires is_joinable
+{
+    if (this == &right || right.root == nullptr)
+        return;
+    assert(root == nullptr || std::is_lt(key_compare{}(Node::get_key(*rbegin()), Node::get_key(*right.begin()))));
+
+    auto count = node_count + right.node_count;
+    auto joined = join(whole(), right.whole());
+    right.take(subtree{}, 0);
+    take(joined, count);
 }
 
-template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc>
-void tree<Key, T, B, Compare, Alloc>::swap(tree<Key, T, B, Compare, Alloc>& other) {
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename K>
+typename tree<Key, T, B, Compare, Alloc, A>::size_type
+tree<Key, T, B, Compare, Alloc, A>::erase_range(const K& lo, const K& hi) requires is_joinable
+{
+    constexpr auto unknown_count = std::numeric_limits<size_type>::max();
+    // the first split takes out the node equal to lo, so the range must not be empty
+    if (!std::is_lt(key_compare{}(lo, hi)))
+        return 0;
+    node_pointer first = nullptr;
+    auto [left, rest] = split(whole(), lo, first);
+    node_pointer last = nullptr;
+    auto [middle, right] = split(rest, hi, last);
+
+    // the node equal to lo is the first removed one, the node equal to hi is kept
+    size_type removed = free_subtree(middle.root, unknown_count);
+    if (first != nullptr) {
+        destroy_node(first);
+        ++removed;
+    }
+    auto joined = last != nullptr ? join(left, last, right) : join(left, right);
+    take(joined, node_count - removed);
+    return removed;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename Pred>
+typename tree<Key, T, B, Compare, Alloc, A>::size_type
+tree<Key, T, B, Compare, Alloc, A>::erase_if(Pred pred) requires is_joinable
+{
+    size_type removed = 0;
+    std::exception_ptr error;
+    auto result = erase_if(whole(), pred, removed, error);
+    take(result, node_count - removed);
+    if (error)
+        std::rethrow_exception(error);
+    return removed;
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename Pred>
+typename tree<Key, T, B, Compare, Alloc, A>::subtree
+tree<Key, T, B, Compare, Alloc, A>::erase_if(subtree t, Pred& pred, size_type& removed, std::exception_ptr& error) noexcept
+{
+    if (t.root == nullptr)
+        return t;
+    auto node = t.root;
+    // join relinks the node, so the children are taken first
+    auto right_child = child(t, 1);
+    auto left = erase_if(child(t, 0), pred, removed, error);
+    bool erase = false;
+    if (!error) {
+        try {
+            erase = pred(std::as_const(node->value));
+        } catch (...) {
+            error = std::current_exception();
+        }
+    }
+    auto right = erase_if(right_child, pred, removed, error);
+    if (!erase)
+        return join(left, node, right);
+    destroy_node(node);
+    ++removed;
+    return join(left, right);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename Op>
+void tree<Key, T, B, Compare, Alloc, A>::set_operation(tree& other, ExecutionPolicy policy)
+{
+    if (this == &other) {
+        if constexpr (!Op::keep_common) {
+            clear();
+        }
+        return;
+    }
+    // every spawning level doubles the number of threads, so the number of threads doesn't exceed the number of cores
+    static const int max_spawn_depth = std::max(static_cast<int>(std::bit_width(std::thread::hardware_concurrency())) - 1, 0);
+    int spawn_depth = policy == ExecutionPolicy::PARALLEL ? max_spawn_depth : 0;
+    auto count = node_count + other.node_count;
+    size_type removed = 0;
+    auto result = set_operation<Op>(whole(), other.whole(), removed, spawn_depth);
+    other.take(subtree{}, 0);
+    take(result, count - removed);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename Op>
+typename tree<Key, T, B, Compare, Alloc, A>::subtree
+tree<Key, T, B, Compare, Alloc, A>::set_operation(subtree a, subtree b, size_type& removed, int spawn_depth) noexcept
+{
+    constexpr auto unknown_count = std::numeric_limits<size_type>::max();
+    if (a.root == nullptr) {
+        if constexpr (Op::keep_other) {
+            return b;
+        }
+        removed += free_subtree(b.root, unknown_count);
+        return {};
+    }
+    if (b.root == nullptr) {
+        if constexpr (Op::keep_this) {
+            return a;
+        }
+        removed += free_subtree(a.root, unknown_count);
+        return {};
+    }
+
+    node_pointer found = nullptr;
+    auto [b_left, b_right] = split(b, Node::get_key(a.root->value), found);
+    auto a_left  = child(a, 0);
+    auto a_right = child(a, 1);
+
+    subtree left;
+    subtree right;
+    size_type removed_right = 0;
+    auto run_right = [&]() noexcept {
+        right = set_operation<Op>(a_right, b_right, removed_right, spawn_depth - 1);
+    };
+    std::future<void> right_task;
+    if (spawn_depth > 0 && a.height >= parallel_height) {
+        try {
+            right_task = std::async(std::launch::async, run_right);
+        } catch (...) {
+            // no more threads or memory, the work is done here
+        }
+    }
+    left = set_operation<Op>(a_left, b_left, removed, spawn_depth - 1);
+    if (right_task.valid()) {
+        right_task.get();
+    } else {
+        run_right();
+    }
+    removed += removed_right;
+
+    if (found != nullptr) {
+        destroy_node(found);
+        ++removed;
+    }
+    if (found != nullptr ? Op::keep_common : Op::keep_this) {
+        return join(left, a.root, right);
+    }
+    destroy_node(a.root);
+    ++removed;
+    return join(left, right);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+typename tree<Key, T, B, Compare, Alloc, A>::subtree
+tree<Key, T, B, Compare, Alloc, A>::join(subtree left, subtree right) noexcept
+{
+    if (left.root == nullptr)
+        return right;
+    if (right.root == nullptr)
+        return left;
+    node_pointer last;
+    auto rest = split_last(left, last);
+    return join(rest, last, right);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+typename tree<Key, T, B, Compare, Alloc, A>::subtree
+tree<Key, T, B, Compare, Alloc, A>::split_last(subtree t, node_pointer& last) noexcept
+{
+    if (t.root->links[1] == nullptr) {
+        last = t.root;
+        return child(t, 0);
+    }
+    auto right = split_last(child(t, 1), last);
+    return join(child(t, 0), t.root, right);
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template<typename K>
+std::pair<typename tree<Key, T, B, Compare, Alloc, A>::subtree, typename tree<Key, T, B, Compare, Alloc, A>::subtree>
+tree<Key, T, B, Compare, Alloc, A>::split(subtree t, const K& key, node_pointer& found) noexcept
+{
+    if (t.root == nullptr)
+        return {};
+    auto cmp = t.root->compare(key);
+    if (cmp == std::strong_ordering::equivalent) {
+        found = t.root;
+        return {child(t, 0), child(t, 1)};
+    }
+    if (std::is_lt(cmp)) {
+        auto [left, right] = split(child(t, 0), key, found);
+        return {left, join(right, t.root, child(t, 1))};
+    }
+    auto [left, right] = split(child(t, 1), key, found);
+    return {join(child(t, 0), t.root, left), right};
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+void tree<Key, T, B, Compare, Alloc, A>::take(subtree t, size_type count) noexcept
+{
+    root = t.root;
+    drop_fingers();
+    if constexpr (sized_node<Node>) {
+        node_count = order_statistic::size(root);
+    } else {
+        node_count = root == nullptr ? 0 : count;
+    }
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+void tree<Key, T, B, Compare, Alloc, A>::swap(tree<Key, T, B, Compare, Alloc, A>& other) {
     std::swap(node_count, other.node_count);
     std::swap(root, other.root);
+    std::swap(finger, other.finger);
     std::swap(node_allocator, other.node_allocator);
 }
 
-template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc>
-void tree<Key, T, B, Compare, Alloc>::clear() noexcept
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+void tree<Key, T, B, Compare, Alloc, A>::clear() noexcept
 {
-    //TODO: is possible to improve preformance via custom memory pool
-
     if(root == nullptr)
         return;
 
-    auto tree_height = 8 * sizeof (unsigned long long) - __builtin_clzll(node_count);
-    tree_height += tree_height/2;
+    // The arena releases all nodes at once, so trivial nodes don't need to be visited
+    if constexpr (!is_bulk_releasable) {
+        free_subtree(root, node_count);
+    }
+    if constexpr (is_resettable_allocator) {
+        node_allocator.reset();
+    }
+    root = nullptr;
+    node_count = 0;
+    drop_fingers();
+}
+
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+typename tree<Key, T, B, Compare, Alloc, A>::size_type
+tree<Key, T, B, Compare, Alloc, A>::free_subtree(node_pointer subtree, size_type count) noexcept
+{
+    size_type removed = 0;
+    if(subtree == nullptr)
+        return removed;
+
+    auto tree_height = height_limit(count);
     util::stack_adaptor<node_pointer> stack;
     node_pointer stack_buff[tree_height];
     stack.set_buffer(std::span(&stack_buff[0], &stack_buff[tree_height]));
 
-    for (auto node = root; true;) {
+    for (auto node = subtree; true;) {
         // Going down as deep as possible
         for (; node->links[0] != nullptr; node = node->links[0]) {
             stack.push(node);
@@ -402,8 +2013,8 @@ void tree<Key, T, B, Compare, Alloc>::clear() noexcept
 
     remove_node:
         // node is leaf
-        std::allocator_traits<Node_alloc_type>::destroy(node_allocator, node);
-        node_allocator.deallocate(node, 1);
+        destroy_node(node);
+        ++removed;
 
         if (!stack.empty()) {
             // going up
@@ -417,20 +2028,53 @@ void tree<Key, T, B, Compare, Alloc>::clear() noexcept
         // clearing is done
         break;
     }
+    return removed;
+}
 
-    root = nullptr;
-    node_count = 0;
+template<typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
+template <typename It>
+typename tree<Key, T, B, Compare, Alloc, A>::node_pointer
+tree<Key, T, B, Compare, Alloc, A>::build_sorted(It& it, size_type count, int depth, int height)
+{
+    if (count == 0)
+        return nullptr;
+
+    // The left subtree gets the bigger half, so both heights are known in advance
+    auto left_count  = count / 2;
+    auto right_count = count - 1 - left_count;
+
+    auto left = build_sorted(it, left_count, depth + 1, height);
+    node_pointer node;
+    try {
+        node = create_node(*it);
+    } catch (...) {
+        free_subtree(left, left_count);
+        throw;
+    }
+    ++it;
+    node_pointer right;
+    try {
+        right = build_sorted(it, right_count, depth + 1, height);
+    } catch (...) {
+        free_subtree(left, left_count);
+        destroy_node(node);
+        throw;
+    }
+    node->links[0] = left;
+    node->links[1] = right;
+    B::init_built_node(node, std::bit_width(left_count), std::bit_width(right_count), depth, height);
+    update_augment(node);
+    return node;
 }
 
-template <typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc>
+template <typename Key, typename T, typename B, typename Compare, template<typename X> typename Alloc, typename A>
 template <typename F>
-void tree<Key, T, B, Compare, Alloc>::enumerate(F visitor, EnumerationOrder o) {
+void tree<Key, T, B, Compare, Alloc, A>::enumerate(F visitor, EnumerationOrder o) {
     auto order = static_cast<int>(o);
     if(root == nullptr)
         return;
 
-    auto tree_height = 8 * sizeof (unsigned long long) - __builtin_clzll(node_count);
-    tree_height += tree_height/2;
+    auto tree_height = height_bound();
     util::stack_adaptor<node_pointer> stack;
     node_pointer stack_buff[tree_height];
     stack.set_buffer(std::span(&stack_buff[0], &stack_buff[tree_height]));
@@ -460,4 +2104,19 @@ void tree<Key, T, B, Compare, Alloc>::enumerate(F visitor, EnumerationOrder o) {
     }
 }
 
+/** @ingroup binary_tree
+ * @brief interval_tree keeps half-open intervals [low, high) and finds the ones that overlap a range or contain a point.
+ *
+ * It is binary_tree::tree with binary_tree::interval keys augmented with binary_tree::interval_augment.
+ * @code
+ * binary_tree::interval_tree<uint64_t, std::string> regions;
+ * regions.insert({{0x1000, 0x2000}, "heap"});
+ * regions.enumerate_stabbing(uint64_t{0x1800}, [](const auto& region) { ... return true; });
+ * @endcode
+ */
+template<typename Bound, typename T = void,
+         typename B = avl_balancer,
+         template<typename X> typename Alloc = std::allocator>
+using interval_tree = tree<interval<Bound>, T, B, std::compare_three_way, Alloc, interval_augment<Bound>>;
+
 }
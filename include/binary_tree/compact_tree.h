@@ -0,0 +1,464 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace binary_tree {
+
+/** @ingroup binary_tree
+ * @brief compact_tree is AVL tree set that keeps nodes in one array and links them by 32-bit indices.
+ *
+ * The node is the key and two 32-bit links. The highest bit of each link tells that the subtree on this side
+ * is higher, so the balance info doesn't take a separate byte. As example the node of compact_tree<int>
+ * takes 12 bytes while the node of tree<int> takes 32 bytes (two pointers, the key and the balance padded
+ * to 8 bytes) plus the allocator overhead, avl_performance_test prints both sizes.
+ * The array has no per-node allocations and keeps more nodes of the search path in cache.
+ *
+ * Differences from binary_tree::tree:
+ *  - the tree is a set of trivially copyable keys (integers as example), it can keep up to 2^31 - 1 keys
+ *  - only AVL balancing and no augmentation
+ *  - erased nodes go to the free list and are reused by the next inserts, clear() keeps the array capacity
+ *  - there are no iterators: the array can be reallocated by any insert, enumerate() visits the keys
+ * @tparam Key key type
+ * @tparam Compare three-way comparison functor
+ */
+template <typename Key, typename Compare = std::compare_three_way>
+class compact_tree {
+    static_assert(std::is_trivially_copyable_v<Key>, "compact_tree keeps keys of erased nodes, so they must be trivially copyable");
+
+public:
+    using key_type    = Key;
+    using value_type  = Key;
+    using key_compare = Compare;
+    using size_type   = std::size_t;
+    using index_type  = uint32_t;
+
+    enum class EnumerationOrder : int{
+        ASCENDING  = 0,
+        DESCENDING = 1,
+    };
+
+    ///The maximal number of keys
+    static constexpr size_type max_nodes = (size_type(1) << 31) - 1;
+
+private:
+    struct node {
+        Key        key;
+        index_type links[2];
+    };
+
+public:
+    ///Size of the one node in bytes
+    static constexpr size_type node_size = sizeof(node);
+
+    compact_tree() noexcept = default;
+
+    /**
+     * @brief compact_tree creates a tree from the sorted range [first, last) in O(n).
+     * @note the range must be sorted in ascending order and must not contain equivalent keys.
+     */
+    template <std::forward_iterator It>
+    compact_tree(It first, It last) {
+        assign(first, last);
+    }
+
+    /**
+     * @brief assign replaces the contents with the keys of the sorted range [first, last) in O(n).
+     *
+     * Nodes are stored in the ascending order, so the array is dense and enumeration goes through it sequentially.
+     * @note the range must be sorted in ascending order and must not contain equivalent keys.
+     */
+    template <std::forward_iterator It>
+    void assign(It first, It last);
+
+    [[nodiscard]] bool empty() const noexcept {
+        return root == nil;
+    }
+
+    [[nodiscard]] size_type size() const noexcept {
+        return node_count;
+    }
+
+    [[nodiscard]] size_type max_size() const noexcept {
+        return max_nodes;
+    }
+
+    /**
+     * @brief capacity
+     * @return the number of nodes that can be stored without reallocation of the array
+     */
+    [[nodiscard]] size_type capacity() const noexcept {
+        return nodes.capacity();
+    }
+
+    void reserve(size_type count) {
+        nodes.reserve(count);
+    }
+
+    /**
+     * @brief insert inserts the key if the tree doesn't contain an equivalent one.
+     * @return true when the key was inserted otherwise false
+     * @throw std::length_error when the tree has max_nodes keys
+     */
+    bool insert(const Key& key);
+
+    /**
+     * @brief erase removes the key
+     * @return number of removed keys (0 or 1)
+     */
+    size_type erase(const Key& key) noexcept;
+
+    /**
+     * @brief clear erases all keys in O(1), the array capacity is kept
+     */
+    void clear() noexcept {
+        nodes.clear();
+        root       = nil;
+        free_list  = nil;
+        node_count = 0;
+    }
+
+    void swap(compact_tree& other) noexcept {
+        nodes.swap(other.nodes);
+        std::swap(root, other.root);
+        std::swap(free_list, other.free_list);
+        std::swap(node_count, other.node_count);
+    }
+
+    template <typename K>
+    [[nodiscard]] size_type count(const K& x) const {
+        for (auto n = root; n != nil;) {
+            auto cmp = Compare{}(x, at(n).key);
+            if (cmp == 0)
+                return 1;
+            n = child(n, std::is_lt(cmp) ? 0 : 1);
+        }
+        return 0;
+    }
+
+    template <typename K>
+    [[nodiscard]] bool contains(const K& x) const {
+        return count(x) != 0;
+    }
+
+    /**
+     * @brief calls functor f for every key in the tree while f returns true
+     */
+    template <typename F>
+    void enumerate(F visitor, EnumerationOrder order = EnumerationOrder::ASCENDING) const;
+
+    /**
+     * @brief verify_test checks the order of keys and AVL rules, for testing purposes only!
+     */
+    bool verify_test() const {
+        return checked_height(root) >= 0;
+    }
+
+private:
+    static constexpr index_type nil        = 0;
+    static constexpr index_type higher_bit = index_type(1) << 31;
+    static constexpr index_type index_mask = higher_bit - 1;
+    /// AVL tree with 2^31 nodes is not higher than 45
+    static constexpr int max_height = 48;
+
+    /// nodes[i - 1] has index i, so index 0 is nil
+    std::vector<node> nodes;
+    index_type        root       = nil;
+    index_type        free_list  = nil;
+    size_type         node_count = 0;
+
+    node& at(index_type n) noexcept {
+        return nodes[n - 1];
+    }
+    const node& at(index_type n) const noexcept {
+        return nodes[n - 1];
+    }
+
+    index_type child(index_type n, int dir) const noexcept {
+        return at(n).links[dir] & index_mask;
+    }
+
+    void set_child(index_type n, int dir, index_type c) noexcept {
+        auto& link = at(n).links[dir];
+        link = (link & higher_bit) | c;
+    }
+
+    /**
+     * @return -1 when the left subtree is higher, 1 when the right one is higher and 0 when they are equal
+     */
+    int balance(index_type n) const noexcept {
+        const auto& links = at(n).links;
+        return static_cast<int>(links[1] >> 31) - static_cast<int>(links[0] >> 31);
+    }
+
+    void set_balance(index_type n, int b) noexcept {
+        auto& links = at(n).links;
+        links[0] = (links[0] & index_mask) | (b < 0 ? higher_bit : 0);
+        links[1] = (links[1] & index_mask) | (b > 0 ? higher_bit : 0);
+    }
+
+    /// replaces the link of parent (or the root when parent is nil) to c
+    void relink(index_type parent, int dir, index_type c) noexcept {
+        if (parent == nil)
+            root = c;
+        else
+            set_child(parent, dir, c);
+    }
+
+    index_type rotate(index_type n, int dir) noexcept {
+        auto c = child(n, dir);
+        set_child(n, dir, child(c, 1 - dir));
+        set_child(c, 1 - dir, n);
+        return c;
+    }
+
+    /**
+     * @brief rotate_double lifts the inner grandchild of n that is in the subtree dir and rebalances three nodes.
+     * @return the new top of the subtree
+     */
+    index_type rotate_double(index_type n, int dir) noexcept {
+        auto c = child(n, dir);
+        auto g = child(c, 1 - dir);
+        auto side = dir == 1 ? 1 : -1;
+        auto g_balance = balance(g);
+        set_child(c, 1 - dir, child(g, dir));
+        set_child(n, dir, child(g, 1 - dir));
+        set_child(g, dir, c);
+        set_child(g, 1 - dir, n);
+        set_balance(n, g_balance == side ? -side : 0);
+        set_balance(c, g_balance == -side ? side : 0);
+        set_balance(g, 0);
+        return g;
+    }
+
+    index_type allocate(const Key& key);
+
+    template <typename It>
+    index_type build_sorted(It& it, size_type count);
+
+    int checked_height(index_type n) const noexcept;
+};
+
+template <typename Key, typename Compare>
+template <std::forward_iterator It>
+void compact_tree<Key, Compare>::assign(It first, It last) {
+    assert(std::adjacent_find(first, last, [](const Key& a, const Key& b){
+        return !std::is_lt(Compare{}(a, b));
+    }) == last);
+
+    auto count = static_cast<size_type>(std::distance(first, last));
+    if (count > max_nodes)
+        throw std::length_error("compact_tree: too many keys");
+    clear();
+    nodes.reserve(count);
+    root = build_sorted(first, count);
+    node_count = count;
+}
+
+template <typename Key, typename Compare>
+template <typename It>
+typename compact_tree<Key, Compare>::index_type compact_tree<Key, Compare>::build_sorted(It& it, size_type count) {
+    if (count == 0)
+        return nil;
+    // The left subtree gets the bigger half, so it is higher when the halves differ
+    auto left_count  = count / 2;
+    auto right_count = count - 1 - left_count;
+    auto left = build_sorted(it, left_count);
+    auto n = allocate(*it);
+    ++it;
+    auto right = build_sorted(it, right_count);
+    at(n).links[0] = left;
+    at(n).links[1] = right;
+    set_balance(n, std::bit_width(left_count) == std::bit_width(right_count) ? 0 : -1);
+    return n;
+}
+
+template <typename Key, typename Compare>
+typename compact_tree<Key, Compare>::index_type compact_tree<Key, Compare>::allocate(const Key& key) {
+    if (free_list != nil) {
+        auto n = free_list;
+        free_list = at(n).links[0];
+        at(n) = node{key, {nil, nil}};
+        return n;
+    }
+    if (nodes.size() >= max_nodes)
+        throw std::length_error("compact_tree: too many keys");
+    nodes.push_back(node{key, {nil, nil}});
+    return static_cast<index_type>(nodes.size());
+}
+
+template <typename Key, typename Compare>
+bool compact_tree<Key, Compare>::insert(const Key& key) {
+    index_type path[max_height];
+    int8_t     dirs[max_height];
+    int depth = 0;
+    for (auto n = root; n != nil;) {
+        auto cmp = Compare{}(key, at(n).key);
+        if (cmp == 0)
+            return false;
+        auto dir = std::is_lt(cmp) ? 0 : 1;
+        path[depth] = n;
+        dirs[depth++] = static_cast<int8_t>(dir);
+        n = child(n, dir);
+    }
+
+    // allocation can move the array, indices stay valid
+    auto new_node = allocate(key);
+    ++node_count;
+    if (depth == 0) {
+        root = new_node;
+        return true;
+    }
+    set_child(path[depth - 1], dirs[depth - 1], new_node);
+
+    // Going up while the subtree grows
+    for (auto level = depth; level-- > 0;) {
+        auto n    = path[level];
+        int  dir  = dirs[level];
+        auto side = dir == 1 ? 1 : -1;
+        auto b    = balance(n);
+        if (b == 0) {
+            set_balance(n, side);
+            continue;
+        }
+        if (b == -side) {
+            set_balance(n, 0);
+            break;
+        }
+        index_type top;
+        if (balance(child(n, dir)) == side) {
+            top = rotate(n, dir);
+            set_balance(n, 0);
+            set_balance(top, 0);
+        } else {
+            top = rotate_double(n, dir);
+        }
+        relink(level > 0 ? path[level - 1] : nil, level > 0 ? dirs[level - 1] : 0, top);
+        break;
+    }
+    return true;
+}
+
+template <typename Key, typename Compare>
+typename compact_tree<Key, Compare>::size_type compact_tree<Key, Compare>::erase(const Key& key) noexcept {
+    index_type path[max_height];
+    int8_t     dirs[max_height];
+    int depth = 0;
+    auto target = root;
+    while (target != nil) {
+        auto cmp = Compare{}(key, at(target).key);
+        if (cmp == 0)
+            break;
+        auto dir = std::is_lt(cmp) ? 0 : 1;
+        path[depth] = target;
+        dirs[depth++] = static_cast<int8_t>(dir);
+        target = child(target, dir);
+    }
+    if (target == nil)
+        return 0;
+
+    auto parent_of = [&](int level) {
+        return level > 0 ? path[level - 1] : nil;
+    };
+    auto dir_of = [&](int level) {
+        return level > 0 ? dirs[level - 1] : 0;
+    };
+    auto target_level = depth;
+    if (child(target, 0) == nil || child(target, 1) == nil) {
+        relink(parent_of(target_level), dir_of(target_level), child(target, child(target, 0) == nil ? 1 : 0));
+    } else {
+        // the successor takes the target place with its links and balance
+        path[depth] = target;
+        dirs[depth++] = 1;
+        auto successor = child(target, 1);
+        for (; child(successor, 0) != nil; successor = child(successor, 0)) {
+            path[depth] = successor;
+            dirs[depth++] = 0;
+        }
+        relink(parent_of(depth), dir_of(depth), child(successor, 1));
+        at(successor).links[0] = at(target).links[0];
+        at(successor).links[1] = at(target).links[1];
+        relink(parent_of(target_level), dir_of(target_level), successor);
+        path[target_level] = successor;
+    }
+    at(target).links[0] = free_list;
+    free_list = target;
+    --node_count;
+
+    // Going up while the subtree shrinks
+    for (auto level = depth; level-- > 0;) {
+        auto n    = path[level];
+        int  dir  = dirs[level];
+        auto side = dir == 1 ? 1 : -1;
+        auto b    = balance(n);
+        if (b == 0) {
+            set_balance(n, -side);
+            break;
+        }
+        if (b == side) {
+            set_balance(n, 0);
+            continue;
+        }
+        // the other side is higher by two
+        auto other = child(n, 1 - dir);
+        auto other_balance = balance(other);
+        index_type top;
+        if (other_balance == side) {
+            top = rotate_double(n, 1 - dir);
+        } else {
+            top = rotate(n, 1 - dir);
+            set_balance(n, other_balance == 0 ? -side : 0);
+            set_balance(top, other_balance == 0 ? side : 0);
+        }
+        relink(parent_of(level), dir_of(level), top);
+        if (other_balance == 0)
+            break;
+    }
+    return 1;
+}
+
+template <typename Key, typename Compare>
+template <typename F>
+void compact_tree<Key, Compare>::enumerate(F visitor, EnumerationOrder o) const {
+    auto order = static_cast<int>(o);
+    index_type stack[max_height];
+    int depth = 0;
+    for (auto n = root; n != nil || depth > 0;) {
+        // Going down as deep as possible
+        for (; n != nil; n = child(n, order)) {
+            stack[depth++] = n;
+        }
+        n = stack[--depth];
+        if (!visitor(at(n).key))
+            return;
+        n = child(n, 1 - order);
+    }
+}
+
+template <typename Key, typename Compare>
+int compact_tree<Key, Compare>::checked_height(index_type n) const noexcept {
+    if (n == nil)
+        return 0;
+    for (int dir : {0, 1}) {
+        auto c = child(n, dir);
+        if (c != nil && std::is_lt(Compare{}(at(c).key, at(n).key)) != (dir == 0))
+            return -1;
+    }
+    auto left  = checked_height(child(n, 0));
+    auto right = checked_height(child(n, 1));
+    if (left < 0 || right < 0 || left - right > 1 || right - left > 1)
+        return -1;
+    if (balance(n) != right - left)
+        return -1;
+    return (left > right ? left : right) + 1;
+}
+
+}
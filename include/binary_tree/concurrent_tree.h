@@ -0,0 +1,560 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "base.h"
+
+namespace binary_tree {
+
+/** @ingroup binary_tree
+ * @brief concurrent_tree is AVL tree for read-mostly workloads: readers take no locks and writers are serialized.
+ *
+ * Nodes are never changed after they have been published. A writer copies the path from the root to the changed
+ * position (and the nodes that rotations touch), rebalances the copies and publishes the new root atomically.
+ * A reader loads the root once and walks the snapshot, so contains() and enumerate() see a consistent tree.
+ *
+ * The nodes that writers have replaced are reclaimed RCU-style. Readers mark the epoch they started in
+ * with counters that are striped over cache lines by the thread, so readers of different threads don't share
+ * a cache line. When enough nodes have been replaced, the writer advances the epoch and frees the nodes
+ * once the readers of the previous epoch have finished. Nobody waits for them: while they are active the nodes
+ * are kept and later writes retry. So a long enumerate() delays reclamation, not readers or writers.
+ * @tparam Key key type
+ * @tparam T mapped type, void for the set
+ * @tparam Compare three-way comparison functor
+ * @tparam Alloc allocator template, it is used by writers only
+ */
+template<typename Key, typename T = void,
+         typename Compare = std::compare_three_way,
+         template<typename X> typename Alloc = std::allocator>
+class concurrent_tree
+{
+public:
+    using key_type    = Key;
+    using mapped_type = T;
+    using value_type  = std::conditional_t<std::is_void_v<T>, Key, std::pair<Key, T>>;
+    using key_compare = Compare;
+    using size_type   = std::size_t;
+
+    enum class EnumerationOrder : int{
+        ASCENDING  = 0,
+        DESCENDING = 1,
+    };
+
+    ///Number of replaced nodes that makes the writer reclaim them
+    static constexpr size_type reclaim_threshold = 1024;
+
+    concurrent_tree() = default;
+
+    concurrent_tree(const concurrent_tree&) = delete;
+    concurrent_tree& operator=(const concurrent_tree&) = delete;
+
+    /**
+     * @note there must be no readers and writers while the tree is destroyed
+     */
+    ~concurrent_tree();
+
+    [[nodiscard]] bool empty() const noexcept {
+        return size() == 0;
+    }
+
+    [[nodiscard]] size_type size() const noexcept {
+        return item_count.load(std::memory_order_relaxed);
+    }
+
+    //Modifiers, writers are serialized
+    /**
+     * @brief insert inserts the value when the tree doesn't contain an equivalent key
+     * @return true when the value was inserted otherwise false
+     */
+    bool insert(const value_type& value);
+
+    /**
+     * @brief erase removes the element with the key
+     * @return number of removed elements (0 or 1)
+     */
+    size_type erase(const key_type& key);
+
+    /**
+     * @brief clear removes all elements, readers that have started before keep their snapshot
+     */
+    void clear();
+
+    /**
+     * @brief reclaim frees the replaced nodes that no reader can see any more.
+     *
+     * Writers call it when reclaim_threshold nodes are waiting. It doesn't wait for readers: the nodes that readers
+     * of the previous epoch can still walk stay until a later write or reclaim(). It takes the writer lock,
+     * so it waits for a running writer.
+     */
+    void reclaim();
+
+    //Lookup, readers don't lock
+    template <typename K>
+    [[nodiscard]] size_type count(const K& x) const {
+        read_guard guard(*this);
+        return lookup(root.load(std::memory_order_acquire), x) != nullptr ? 1 : 0;
+    }
+
+    template <typename K>
+    [[nodiscard]] bool contains(const K& x) const {
+        return count(x) != 0;
+    }
+
+    /**
+     * @brief visit calls f(value) for the element with key x
+     *
+     * The value can be used only inside f, the node can be freed after f returns.
+     * f can modify this tree, the changes are not visible to f's own lookup.
+     * @return true when the element was found
+     */
+    template <typename K, typename F>
+    bool visit(const K& x, F f) const {
+        read_guard guard(*this);
+        auto node = lookup(root.load(std::memory_order_acquire), x);
+        if (node == nullptr)
+            return false;
+        f(std::as_const(node->value));
+        return true;
+    }
+
+    /**
+     * @brief calls functor f for every element of the snapshot while f returns true
+     *
+     * The visitor can modify this tree, it keeps walking the snapshot. Writers are not blocked by the enumeration.
+     */
+    template <typename F>
+    void enumerate(F visitor, EnumerationOrder order = EnumerationOrder::ASCENDING) const;
+
+    /**
+     * @brief verify_test checks the key order and AVL heights, for testing purposes only!
+     */
+    bool verify_test() const {
+        read_guard guard(*this);
+        return checked_height(root.load(std::memory_order_acquire)) >= 0;
+    }
+
+private:
+    struct node {
+        node*      links[2] = {nullptr, nullptr};
+        value_type value;
+        /// the writer can change the node only in the write that has created it
+        uint64_t   version;
+        int8_t     height = 1;
+
+        node(const value_type& v, uint64_t created)
+            : value(v)
+            , version(created)
+        {}
+
+        node(const node& other, uint64_t created)
+            : links{other.links[0], other.links[1]}
+            , value(other.value)
+            , version(created)
+            , height(other.height)
+        {}
+    };
+
+    using node_pointer     = node*;
+    using node_alloc_type  = Alloc<node>;
+    using node_alloc_trait = std::allocator_traits<node_alloc_type>;
+
+    /// AVL tree with 2^64 nodes is not higher than 93
+    static constexpr int max_height  = 96;
+    /// the write creates two nodes per level at most
+    static constexpr int max_created = 2 * max_height + 2;
+    static constexpr size_type reader_slot_count = 64;
+
+    struct alignas(64) reader_slot {
+        std::atomic<size_type> active[2] = {0, 0};
+    };
+
+    /**
+     * @brief read_guard marks the reader active in the current epoch while it is alive
+     */
+    class read_guard {
+    public:
+        explicit read_guard(const concurrent_tree& tree) noexcept
+            : slot(tree.reader_slots[slot_index()])
+        {
+            // the writer could advance the epoch between the load and the mark, then the mark is repeated
+            for (;;) {
+                auto e = tree.epoch.load();
+                parity = static_cast<int>(e & 1);
+                slot.active[parity].fetch_add(1);
+                if (tree.epoch.load() == e)
+                    break;
+                slot.active[parity].fetch_sub(1);
+            }
+        }
+
+        ~read_guard() {
+            slot.active[parity].fetch_sub(1, std::memory_order_release);
+        }
+
+        read_guard(const read_guard&) = delete;
+        read_guard& operator=(const read_guard&) = delete;
+
+    private:
+        reader_slot& slot;
+        int          parity = 0;
+    };
+
+    std::atomic<node_pointer>   root = nullptr;
+    std::atomic<size_type>      item_count = 0;
+    std::atomic<uint64_t>       epoch = 0;
+    mutable reader_slot         reader_slots[reader_slot_count];
+
+    // The writer state, it is guarded by writer_mutex
+    std::mutex                  writer_mutex;
+    uint64_t                    version = 0;
+    std::vector<node_pointer>   created;
+    std::vector<node_pointer>   replaced;
+    std::vector<node_pointer>   retired;
+    // retired nodes of the previous epoch, they are freed when its readers have finished
+    std::vector<node_pointer>   pending;
+    int                         pending_parity = 0;
+    [[no_unique_address]] node_alloc_type node_allocator;
+
+    static size_type slot_index() noexcept {
+        static std::atomic<size_type> next_slot = 0;
+        thread_local const size_type index = next_slot.fetch_add(1, std::memory_order_relaxed) % reader_slot_count;
+        return index;
+    }
+
+    static const key_type& get_key(const value_type& value) noexcept {
+        if constexpr (std::is_void_v<T>) {
+            return value;
+        } else {
+            return value.first;
+        }
+    }
+
+    template <typename K>
+    static node_pointer lookup(node_pointer n, const K& x) {
+        while (n != nullptr) {
+            auto cmp = Compare{}(x, get_key(n->value));
+            if (cmp == 0)
+                return n;
+            n = n->links[std::is_lt(cmp) ? 0 : 1];
+        }
+        return nullptr;
+    }
+
+    static int height(node_pointer n) noexcept {
+        return n == nullptr ? 0 : n->height;
+    }
+
+    static void update_height(node_pointer n) noexcept {
+        n->height = static_cast<int8_t>(std::max(height(n->links[0]), height(n->links[1])) + 1);
+    }
+
+    template <typename... Args>
+    node_pointer create(Args&&... args) {
+        auto n = node_alloc_trait::allocate(node_allocator, 1);
+        try {
+            node_alloc_trait::construct(node_allocator, n, std::forward<Args>(args)..., version);
+        } catch (...) {
+            node_alloc_trait::deallocate(node_allocator, n, 1);
+            throw;
+        }
+        created.push_back(n);
+        return n;
+    }
+
+    void destroy(node_pointer n) noexcept {
+        node_alloc_trait::destroy(node_allocator, n);
+        node_alloc_trait::deallocate(node_allocator, n, 1);
+    }
+
+    /**
+     * @return the node itself when it has been created by this write, otherwise its copy
+     */
+    node_pointer writable(node_pointer n) {
+        if (n->version == version)
+            return n;
+        auto copy = create(*n);
+        replaced.push_back(n);
+        return copy;
+    }
+
+    node_pointer rotate(node_pointer n, int dir);
+    node_pointer rebalance(node_pointer n);
+    node_pointer insert_into(node_pointer n, const value_type& value, bool& inserted);
+    node_pointer erase_from(node_pointer n, const key_type& key, bool& erased);
+    node_pointer erase_min(node_pointer n, node_pointer& min);
+
+    template <typename F>
+    void write(F change);
+
+    /// reclaim() for the thread that holds writer_mutex
+    void reclaim_locked() noexcept;
+
+    bool readers_active(int parity) const noexcept {
+        for (auto& slot : reader_slots) {
+            if (slot.active[parity].load() != 0)
+                return true;
+        }
+        return false;
+    }
+
+    int checked_height(node_pointer n) const;
+};
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+concurrent_tree<Key, T, Compare, Alloc>::~concurrent_tree() {
+    if (auto r = root.load(std::memory_order_relaxed); r != nullptr) {
+        std::vector<node_pointer> stack{r};
+        while (!stack.empty()) {
+            auto n = stack.back();
+            stack.pop_back();
+            for (auto child : n->links) {
+                if (child != nullptr)
+                    stack.push_back(child);
+            }
+            destroy(n);
+        }
+    }
+    for (auto n : retired) {
+        destroy(n);
+    }
+    for (auto n : pending) {
+        destroy(n);
+    }
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+template <typename F>
+void concurrent_tree<Key, T, Compare, Alloc>::write(F change) {
+    std::lock_guard lock(writer_mutex);
+    ++version;
+    created.clear();
+    replaced.clear();
+    // the bookkeeping never allocates after the nodes have been created
+    created.reserve(max_created);
+    replaced.reserve(max_created);
+    node_pointer new_root;
+    try {
+        new_root = change(root.load(std::memory_order_relaxed));
+        retired.reserve(retired.size() + replaced.size());
+    } catch (...) {
+        // nothing has been published yet
+        for (auto n : created) {
+            destroy(n);
+        }
+        throw;
+    }
+    root.store(new_root, std::memory_order_release);
+    retired.insert(retired.end(), replaced.begin(), replaced.end());
+    if (retired.size() >= reclaim_threshold) {
+        reclaim_locked();
+    }
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+bool concurrent_tree<Key, T, Compare, Alloc>::insert(const value_type& value) {
+    bool inserted = false;
+    write([&](node_pointer r) {
+        return insert_into(r, value, inserted);
+    });
+    if (inserted)
+        item_count.fetch_add(1, std::memory_order_relaxed);
+    return inserted;
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+typename concurrent_tree<Key, T, Compare, Alloc>::size_type concurrent_tree<Key, T, Compare, Alloc>::erase(const key_type& key) {
+    bool erased = false;
+    write([&](node_pointer r) {
+        return erase_from(r, key, erased);
+    });
+    if (!erased)
+        return 0;
+    item_count.fetch_sub(1, std::memory_order_relaxed);
+    return 1;
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+void concurrent_tree<Key, T, Compare, Alloc>::clear() {
+    std::lock_guard lock(writer_mutex);
+    auto r = root.load(std::memory_order_relaxed);
+    if (r == nullptr)
+        return;
+    std::vector<node_pointer> nodes{r};
+    for (size_type i = 0; i < nodes.size(); ++i) {
+        for (auto child : nodes[i]->links) {
+            if (child != nullptr)
+                nodes.push_back(child);
+        }
+    }
+    retired.reserve(retired.size() + nodes.size());
+    root.store(nullptr, std::memory_order_release);
+    item_count.store(0, std::memory_order_relaxed);
+    retired.insert(retired.end(), nodes.begin(), nodes.end());
+    reclaim_locked();
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+void concurrent_tree<Key, T, Compare, Alloc>::reclaim() {
+    // retired is the writer state
+    std::lock_guard lock(writer_mutex);
+    reclaim_locked();
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+void concurrent_tree<Key, T, Compare, Alloc>::reclaim_locked() noexcept {
+    auto free_pending = [this] {
+        for (auto n : pending) {
+            destroy(n);
+        }
+        pending.clear();
+    };
+    // The epoch can't advance again while readers of the previous one are active,
+    // the readers of the next epoch would share their counters.
+    if (!pending.empty()) {
+        if (readers_active(pending_parity))
+            return;
+        free_pending();
+    }
+    if (retired.empty())
+        return;
+    // Readers of the new epoch have loaded the root after the nodes were replaced.
+    // Readers of the previous epoch can still walk them.
+    pending.swap(retired);
+    pending_parity = static_cast<int>(epoch.fetch_add(1) & 1);
+    if (!readers_active(pending_parity)) {
+        free_pending();
+    }
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+typename concurrent_tree<Key, T, Compare, Alloc>::node_pointer concurrent_tree<Key, T, Compare, Alloc>::rotate(node_pointer n, int dir) {
+    // the child on the dir side becomes the top, n must be writable
+    auto child = writable(n->links[dir]);
+    n->links[dir] = child->links[1 - dir];
+    child->links[1 - dir] = n;
+    update_height(n);
+    update_height(child);
+    return child;
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+typename concurrent_tree<Key, T, Compare, Alloc>::node_pointer concurrent_tree<Key, T, Compare, Alloc>::rebalance(node_pointer n) {
+    auto balance = height(n->links[1]) - height(n->links[0]);
+    if (balance < -1 || balance > 1) {
+        auto dir = balance > 1 ? 1 : 0;
+        auto child = n->links[dir];
+        if (height(child->links[1 - dir]) > height(child->links[dir])) {
+            n->links[dir] = rotate(writable(child), 1 - dir);
+        }
+        return rotate(n, dir);
+    }
+    update_height(n);
+    return n;
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+typename concurrent_tree<Key, T, Compare, Alloc>::node_pointer
+concurrent_tree<Key, T, Compare, Alloc>::insert_into(node_pointer n, const value_type& value, bool& inserted) {
+    if (n == nullptr) {
+        inserted = true;
+        return create(value);
+    }
+    auto cmp = Compare{}(get_key(value), get_key(n->value));
+    if (cmp == 0)
+        return n;
+    auto dir = std::is_lt(cmp) ? 0 : 1;
+    auto child = insert_into(n->links[dir], value, inserted);
+    if (!inserted)
+        return n;
+    n = writable(n);
+    n->links[dir] = child;
+    return rebalance(n);
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+typename concurrent_tree<Key, T, Compare, Alloc>::node_pointer
+concurrent_tree<Key, T, Compare, Alloc>::erase_min(node_pointer n, node_pointer& min) {
+    if (n->links[0] == nullptr) {
+        min = n;
+        return n->links[1];
+    }
+    auto child = erase_min(n->links[0], min);
+    n = writable(n);
+    n->links[0] = child;
+    return rebalance(n);
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+typename concurrent_tree<Key, T, Compare, Alloc>::node_pointer
+concurrent_tree<Key, T, Compare, Alloc>::erase_from(node_pointer n, const key_type& key, bool& erased) {
+    if (n == nullptr)
+        return nullptr;
+    auto cmp = Compare{}(key, get_key(n->value));
+    if (cmp != 0) {
+        auto dir = std::is_lt(cmp) ? 0 : 1;
+        auto child = erase_from(n->links[dir], key, erased);
+        if (!erased)
+            return n;
+        n = writable(n);
+        n->links[dir] = child;
+        return rebalance(n);
+    }
+
+    erased = true;
+    replaced.push_back(n);
+    if (n->links[0] == nullptr || n->links[1] == nullptr)
+        return n->links[n->links[0] == nullptr ? 1 : 0];
+    // the successor takes the place of the node
+    node_pointer successor = nullptr;
+    auto right = erase_min(n->links[1], successor);
+    successor = writable(successor);
+    successor->links[0] = n->links[0];
+    successor->links[1] = right;
+    return rebalance(successor);
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+template <typename F>
+void concurrent_tree<Key, T, Compare, Alloc>::enumerate(F visitor, EnumerationOrder o) const {
+    auto order = static_cast<int>(o);
+    read_guard guard(*this);
+    node_pointer stack[max_height];
+    int depth = 0;
+    for (auto n = root.load(std::memory_order_acquire); n != nullptr || depth > 0;) {
+        // Going down as deep as possible
+        for (; n != nullptr; n = n->links[order]) {
+            stack[depth++] = n;
+        }
+        n = stack[--depth];
+        if (!visitor(std::as_const(n->value)))
+            return;
+        n = n->links[1 - order];
+    }
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc>
+int concurrent_tree<Key, T, Compare, Alloc>::checked_height(node_pointer n) const {
+    if (n == nullptr)
+        return 0;
+    for (int dir : {0, 1}) {
+        auto child = n->links[dir];
+        if (child != nullptr && std::is_lt(Compare{}(get_key(child->value), get_key(n->value))) != (dir == 0))
+            return -1;
+    }
+    auto left  = checked_height(n->links[0]);
+    auto right = checked_height(n->links[1]);
+    if (left < 0 || right < 0 || left - right > 1 || right - left > 1 || n->height != std::max(left, right) + 1)
+        return -1;
+    return n->height;
+}
+
+}
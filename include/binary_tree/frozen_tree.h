@@ -0,0 +1,214 @@
+#pragma once
+
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace binary_tree {
+
+namespace detail {
+
+/**
+ * @brief eytzinger_positions
+ * @return positions[k] is the sorted position of the node k of the implicit tree with count nodes,
+ * positions[0] is 0
+ */
+inline std::vector<std::size_t> eytzinger_positions(std::size_t count) {
+    // in-order traversal of the implicit tree gives the sorted position of every node
+    std::vector<std::size_t> positions(count + 1);
+    std::size_t next = 0;
+    auto place = [&](auto& self, std::size_t k) -> void {
+        if (k > count)
+            return;
+        self(self, 2 * k);
+        positions[k] = next++;
+        self(self, 2 * k + 1);
+    };
+    place(place, 1);
+    return positions;
+}
+
+/**
+ * @brief eytzinger_lower_bound searches keys[1..count] that are in Eytzinger order
+ * @return index of the first key that is not less than x, 0 when all keys are less
+ */
+template <typename Compare, typename Key, typename K>
+std::size_t eytzinger_lower_bound(const Key* keys, std::size_t count, const K& x) noexcept {
+    /// children of the node k that are log2(prefetch_stride) levels down start at k * prefetch_stride
+    constexpr std::size_t prefetch_stride = sizeof(Key) < 64 ? std::bit_floor(64 / sizeof(Key)) : 1;
+    std::size_t k = 1;
+    while (k <= count) {
+#if defined(__GNUC__)
+        __builtin_prefetch(keys + k * prefetch_stride);
+#endif
+        k = 2 * k + (std::is_lt(Compare{}(keys[k], x)) ? 1 : 0);
+    }
+    // the last step to the left was made from the answer, it is dropped with the right steps after it
+    return k >> (std::countr_one(k) + 1);
+}
+
+/**
+ * @brief eytzinger_enumerate calls visit(k) for nodes of the subtree k in the sorted order while it returns true
+ * @param order 0 is ascending, 1 is descending
+ */
+template <typename F>
+bool eytzinger_enumerate(std::size_t k, std::size_t count, F& visit, int order) {
+    if (k > count)
+        return true;
+    if (!eytzinger_enumerate(2 * k + order, count, visit, order))
+        return false;
+    if (!visit(k))
+        return false;
+    return eytzinger_enumerate(2 * k + 1 - order, count, visit, order);
+}
+
+}
+
+/** @ingroup binary_tree
+ * @brief frozen_tree is the read-only copy of the tree that keeps keys in one array in
+ * <a href="https://en.wikipedia.org/wiki/Binary_heap">Eytzinger (breadth-first) order</a>.
+ *
+ * The node k has children 2k and 2k+1, so the search computes the next index instead of loading a link.
+ * The descent has no branches that depend on keys, the comparison result is added to the index.
+ * Descendants of the node four levels down (for 4-byte keys) share a cache line,
+ * so the search prefetches that line while it goes through the levels between.
+ * Use tree::freeze() or the constructor from a sorted range to create it.
+ * @tparam Key key type
+ * @tparam T mapped type, void for the set
+ * @tparam Compare three-way comparison functor
+ */
+template <typename Key, typename T = void, typename Compare = std::compare_three_way>
+class frozen_tree {
+public:
+    using key_type    = Key;
+    using mapped_type = T;
+    using value_type  = std::conditional_t<std::is_void_v<T>, Key, std::pair<Key, T>>;
+    using key_compare = Compare;
+    using size_type   = std::size_t;
+
+    enum class EnumerationOrder : int{
+        ASCENDING  = 0,
+        DESCENDING = 1,
+    };
+
+    frozen_tree() = default;
+
+    /**
+     * @brief frozen_tree copies the elements of the sorted range [first, last)
+     * @note the range must be sorted in ascending order and must not contain equivalent keys.
+     */
+    template <std::forward_iterator It>
+    frozen_tree(It first, It last);
+
+    [[nodiscard]] bool empty() const noexcept {
+        return item_count == 0;
+    }
+
+    [[nodiscard]] size_type size() const noexcept {
+        return item_count;
+    }
+
+    template <typename K>
+    [[nodiscard]] size_type count(const K& x) const noexcept {
+        auto k = lower_bound_index(x);
+        return k != 0 && Compare{}(x, keys[k]) == 0 ? 1 : 0;
+    }
+
+    template <typename K>
+    [[nodiscard]] bool contains(const K& x) const noexcept {
+        return count(x) != 0;
+    }
+
+    /**
+     * @brief lower_bound
+     * @return pointer to the first key that is not less than x or nullptr
+     */
+    template <typename K>
+    [[nodiscard]] const Key* lower_bound(const K& x) const noexcept {
+        auto k = lower_bound_index(x);
+        return k == 0 ? nullptr : &keys[k];
+    }
+
+    /**
+     * @brief at returns the mapped value of the key (the map only)
+     * @throw std::out_of_range when the tree doesn't contain the key
+     */
+    template <typename K>
+    const auto& at(const K& x) const requires (!std::is_void_v<T>) {
+        auto k = lower_bound_index(x);
+        if (k == 0 || Compare{}(x, keys[k]) != 0)
+            throw std::out_of_range("binary_tree::frozen_tree::at: the key is not found");
+        return values[k];
+    }
+
+    /**
+     * @brief calls functor f for every element in the tree while f returns true
+     *
+     * The set passes const Key&, the map passes std::pair<const Key&, const T&>.
+     */
+    template <typename F>
+    void enumerate(F visitor, EnumerationOrder order = EnumerationOrder::ASCENDING) const {
+        auto visit = [this, &visitor](size_type k) {
+            if constexpr (is_set) {
+                return visitor(keys[k]);
+            } else {
+                std::pair<const Key&, const T&> item(keys[k], values[k]);
+                return visitor(item);
+            }
+        };
+        detail::eytzinger_enumerate(1, item_count, visit, static_cast<int>(order));
+    }
+
+private:
+    static constexpr bool is_set = std::is_void_v<T>;
+
+    /// keys[k] is the node k, keys[0] is a copy of the minimal key that is never compared
+    std::vector<Key> keys;
+    [[no_unique_address]] std::conditional_t<is_set, std::tuple<>, std::vector<std::conditional_t<is_set, char, T>>> values;
+    size_type item_count = 0;
+
+    /**
+     * @return index of the first key that is not less than x, 0 when all keys are less
+     */
+    template <typename K>
+    size_type lower_bound_index(const K& x) const noexcept {
+        return detail::eytzinger_lower_bound<Compare>(keys.data(), item_count, x);
+    }
+};
+
+template <typename Key, typename T, typename Compare>
+template <std::forward_iterator It>
+frozen_tree<Key, T, Compare>::frozen_tree(It first, It last) {
+    // iterators of the tree are big, so the elements are referred by pointers
+    std::vector<const std::iter_value_t<It>*> sorted;
+    for (; first != last; ++first) {
+        sorted.push_back(std::addressof(*first));
+    }
+    item_count = sorted.size();
+    if (item_count == 0)
+        return;
+
+    auto positions = detail::eytzinger_positions(item_count);
+    keys.reserve(item_count + 1);
+    if constexpr (!is_set) {
+        values.reserve(item_count + 1);
+    }
+    for (size_type k = 0; k <= item_count; ++k) {
+        const auto& value = *sorted[k == 0 ? 0 : positions[k]];
+        if constexpr (is_set) {
+            keys.push_back(value);
+        } else {
+            keys.push_back(value.first);
+            values.push_back(value.second);
+        }
+    }
+}
+
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#include "frozen_tree.h"
+
+#include <cerrno>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace binary_tree {
+
+/**
+ * @brief mapped_tree_header starts the file of mapped_tree.
+ *
+ * The file contains offsets only, so it can be mapped at any address:
+ * | header | keys[0..count] | values[0..count] (the map only) |
+ * Both arrays are in Eytzinger order like frozen_tree, slot 0 is a placeholder that is never compared.
+ * The arrays start at multiples of 64 bytes.
+ */
+struct mapped_tree_header {
+    static constexpr char     expected_magic[8] = {'F', 'U', 'T', 'I', 'L', 'B', 'T', '\0'};
+    static constexpr uint32_t current_format = 1;
+    /// it is read back in other byte order when the file has been written by other endianness
+    static constexpr uint32_t byte_order_mark = 0x01020304;
+
+    char     magic[8];
+    uint32_t format;
+    uint32_t byte_order;
+    uint32_t key_size;
+    uint32_t key_alignment;
+    uint32_t mapped_size;
+    uint32_t mapped_alignment;
+    uint64_t count;
+    uint64_t keys_offset;
+    uint64_t values_offset;
+    uint64_t file_size;
+};
+
+/** @ingroup binary_tree
+ * @brief mapped_tree answers lookups directly from the memory mapped file that save() has written.
+ *
+ * Opening doesn't read or convert elements, so it takes the same time for any element count,
+ * the pages are loaded by the first lookups that touch them. The search is the same as frozen_tree does.
+ * The file is valid on machines with the same byte order and the same Key and T layout.
+ * @tparam Key trivially copyable key type
+ * @tparam T trivially copyable mapped type, void for the set
+ * @tparam Compare three-way comparison functor
+ */
+template <typename Key, typename T = void, typename Compare = std::compare_three_way>
+class mapped_tree {
+    static constexpr bool is_set = std::is_void_v<T>;
+    using stored_mapped_type = std::conditional_t<is_set, char, T>;
+
+    static_assert(std::is_trivially_copyable_v<Key>, "mapped_tree keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable_v<stored_mapped_type>, "mapped_tree values must be trivially copyable");
+    static_assert(alignof(Key) <= 64 && alignof(stored_mapped_type) <= 64);
+
+public:
+    using key_type    = Key;
+    using mapped_type = T;
+    using value_type  = std::conditional_t<is_set, Key, std::pair<Key, T>>;
+    using key_compare = Compare;
+    using size_type   = std::size_t;
+
+    enum class EnumerationOrder : int{
+        ASCENDING  = 0,
+        DESCENDING = 1,
+    };
+
+    /**
+     * @brief save writes the sorted range [first, last) to the file
+     * @note the range must be sorted in ascending order and must not contain equivalent keys
+     * @throw std::runtime_error when the file can't be written
+     */
+    template <std::forward_iterator It>
+    static void save(It first, It last, const std::string& path);
+
+    /**
+     * @brief save writes the elements of the sorted container (binary_tree::tree, std::set, std::map etc.) to the file
+     */
+    template <typename Tree>
+    static void save(const Tree& tree, const std::string& path) {
+        save(std::begin(tree), std::end(tree), path);
+    }
+
+    mapped_tree() = default;
+
+    /**
+     * @brief mapped_tree maps the file read-only
+     * @throw std::system_error when the file can't be opened or mapped
+     * @throw std::runtime_error when the file isn't valid for Key and T
+     */
+    explicit mapped_tree(const std::string& path);
+
+    mapped_tree(const mapped_tree&) = delete;
+    mapped_tree& operator=(const mapped_tree&) = delete;
+
+    mapped_tree(mapped_tree&& other) noexcept {
+        swap(other);
+    }
+
+    mapped_tree& operator=(mapped_tree&& other) noexcept {
+        mapped_tree(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~mapped_tree() {
+        if (mapping != nullptr)
+            munmap(mapping, mapping_size);
+    }
+
+    void swap(mapped_tree& other) noexcept {
+        std::swap(mapping, other.mapping);
+        std::swap(mapping_size, other.mapping_size);
+        std::swap(keys, other.keys);
+        std::swap(values, other.values);
+        std::swap(item_count, other.item_count);
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return item_count == 0;
+    }
+
+    [[nodiscard]] size_type size() const noexcept {
+        return item_count;
+    }
+
+    template <typename K>
+    [[nodiscard]] size_type count(const K& x) const noexcept {
+        auto k = detail::eytzinger_lower_bound<Compare>(keys, item_count, x);
+        return k != 0 && Compare{}(x, keys[k]) == 0 ? 1 : 0;
+    }
+
+    template <typename K>
+    [[nodiscard]] bool contains(const K& x) const noexcept {
+        return count(x) != 0;
+    }
+
+    /**
+     * @brief lower_bound
+     * @return pointer to the first key that is not less than x or nullptr
+     */
+    template <typename K>
+    [[nodiscard]] const Key* lower_bound(const K& x) const noexcept {
+        auto k = detail::eytzinger_lower_bound<Compare>(keys, item_count, x);
+        return k == 0 ? nullptr : &keys[k];
+    }
+
+    /**
+     * @brief at returns the mapped value of the key (the map only)
+     * @throw std::out_of_range when the tree doesn't contain the key
+     */
+    template <typename K>
+    const auto& at(const K& x) const requires (!is_set) {
+        auto k = detail::eytzinger_lower_bound<Compare>(keys, item_count, x);
+        if (k == 0 || Compare{}(x, keys[k]) != 0)
+            throw std::out_of_range("binary_tree::mapped_tree::at: the key is not found");
+        return values[k];
+    }
+
+    /**
+     * @brief calls functor f for every element in the tree while f returns true
+     *
+     * The set passes const Key&, the map passes std::pair<const Key&, const T&>.
+     */
+    template <typename F>
+    void enumerate(F visitor, EnumerationOrder order = EnumerationOrder::ASCENDING) const {
+        auto visit = [this, &visitor](size_type k) {
+            if constexpr (is_set) {
+                return visitor(keys[k]);
+            } else {
+                std::pair<const Key&, const T&> item(keys[k], values[k]);
+                return visitor(item);
+            }
+        };
+        detail::eytzinger_enumerate(1, item_count, visit, static_cast<int>(order));
+    }
+
+private:
+    void*                     mapping = nullptr;
+    size_type                 mapping_size = 0;
+    const Key*                keys = nullptr;
+    const stored_mapped_type* values = nullptr;
+    size_type                 item_count = 0;
+
+    static uint64_t align_up(uint64_t offset) noexcept {
+        return (offset + 63) & ~uint64_t{63};
+    }
+
+    static mapped_tree_header make_header(size_type count) noexcept {
+        mapped_tree_header header{};
+        std::memcpy(header.magic, mapped_tree_header::expected_magic, sizeof(header.magic));
+        header.format           = mapped_tree_header::current_format;
+        header.byte_order       = mapped_tree_header::byte_order_mark;
+        header.key_size         = sizeof(Key);
+        header.key_alignment    = alignof(Key);
+        header.mapped_size      = is_set ? 0 : sizeof(stored_mapped_type);
+        header.mapped_alignment = is_set ? 0 : alignof(stored_mapped_type);
+        header.count            = count;
+        header.keys_offset      = align_up(sizeof(mapped_tree_header));
+        auto keys_end           = header.keys_offset + (count + 1) * sizeof(Key);
+        // the set has no values array
+        header.values_offset    = is_set ? 0 : align_up(keys_end);
+        header.file_size        = is_set ? keys_end : header.values_offset + (count + 1) * sizeof(stored_mapped_type);
+        return header;
+    }
+};
+
+template <typename Key, typename T, typename Compare>
+template <std::forward_iterator It>
+void mapped_tree<Key, T, Compare>::save(It first, It last, const std::string& path) {
+    std::vector<const std::iter_value_t<It>*> sorted;
+    for (; first != last; ++first) {
+        sorted.push_back(std::addressof(*first));
+    }
+    auto count = sorted.size();
+    auto positions = detail::eytzinger_positions(count);
+    auto header = make_header(count);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    auto write = [&file](const void* data, size_type size) {
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    };
+    auto pad_to = [&file, &write](uint64_t offset) {
+        static constexpr char zeros[64] = {};
+        write(zeros, offset - static_cast<uint64_t>(file.tellp()));
+    };
+    write(&header, sizeof(header));
+    pad_to(header.keys_offset);
+    for (size_type k = 0; k <= count; ++k) {
+        // the placeholder is zeroed for the empty tree
+        Key key{};
+        if (count != 0) {
+            const auto& value = *sorted[positions[k]];
+            if constexpr (is_set) {
+                key = value;
+            } else {
+                key = value.first;
+            }
+        }
+        write(&key, sizeof(key));
+    }
+    if constexpr (!is_set) {
+        pad_to(header.values_offset);
+        for (size_type k = 0; k <= count; ++k) {
+            stored_mapped_type mapped{};
+            if (count != 0)
+                mapped = sorted[positions[k]]->second;
+            write(&mapped, sizeof(mapped));
+        }
+    }
+    file.close();
+    if (!file)
+        throw std::runtime_error("binary_tree::mapped_tree::save: can't write " + path);
+}
+
+template <typename Key, typename T, typename Compare>
+mapped_tree<Key, T, Compare>::mapped_tree(const std::string& path) {
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "binary_tree::mapped_tree: can't open " + path);
+    struct stat info{};
+    if (::fstat(fd, &info) != 0) {
+        auto error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), "binary_tree::mapped_tree: can't stat " + path);
+    }
+    auto file_size = static_cast<size_type>(info.st_size);
+    if (file_size < sizeof(mapped_tree_header)) {
+        ::close(fd);
+        throw std::runtime_error("binary_tree::mapped_tree: " + path + " is too short");
+    }
+    auto address = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    auto error = errno;
+    // the mapping keeps the file
+    ::close(fd);
+    if (address == MAP_FAILED)
+        throw std::system_error(error, std::generic_category(), "binary_tree::mapped_tree: can't map " + path);
+    mapping = address;
+    mapping_size = file_size;
+
+    const auto& header = *static_cast<const mapped_tree_header*>(mapping);
+    // the count of the damaged file can overflow offsets
+    auto expected = make_header(header.count <= file_size ? header.count : 0);
+    const char* problem = nullptr;
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0)
+        problem = " isn't mapped_tree file";
+    else if (header.format != expected.format)
+        problem = " has unsupported format";
+    else if (header.byte_order != expected.byte_order)
+        problem = " has other byte order";
+    else if (header.key_size != expected.key_size || header.key_alignment != expected.key_alignment
+             || header.mapped_size != expected.mapped_size || header.mapped_alignment != expected.mapped_alignment)
+        problem = " has other key or mapped type";
+    else if (header.count != expected.count || header.keys_offset != expected.keys_offset
+             || header.values_offset != expected.values_offset || header.file_size != expected.file_size
+             || file_size < header.file_size)
+        problem = " is damaged";
+    if (problem != nullptr) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        throw std::runtime_error("binary_tree::mapped_tree: " + path + problem);
+    }
+
+    auto bytes = static_cast<const std::byte*>(mapping);
+    item_count = header.count;
+    keys = reinterpret_cast<const Key*>(bytes + header.keys_offset);
+    if constexpr (!is_set) {
+        values = reinterpret_cast<const stored_mapped_type*>(bytes + header.values_offset);
+    }
+}
+
+}
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace binary_tree {
+
+/** @ingroup binary_tree
+ * @brief persistent_tree is <a href="https://en.wikipedia.org/wiki/Persistent_data_structure">persistent</a> AVL tree,
+ * its versions share nodes.
+ *
+ * Copying the tree is O(1) snapshot: the copy refers to the same root. A change of a version copies
+ * only the shared nodes on the path from the root to the changed position (and the nodes that rotations touch),
+ * so other versions don't see it and the memory grows with the changes, not the size.
+ * Nodes that are referred by this version only are changed in place, so a tree without snapshots
+ * doesn't copy anything. Nodes count their references and are freed when no version refers to them.
+ *
+ * Different versions can be used and destroyed by different threads,
+ * one version object must not be changed concurrently with any other use of it.
+ * @tparam Key key type
+ * @tparam T mapped type, void for the set
+ * @tparam Compare three-way comparison functor
+ * @note value_type must be copy constructible and move assignable
+ */
+template<typename Key, typename T = void, typename Compare = std::compare_three_way>
+class persistent_tree
+{
+public:
+    using key_type    = Key;
+    using mapped_type = T;
+    using value_type  = std::conditional_t<std::is_void_v<T>, Key, std::pair<Key, T>>;
+    using key_compare = Compare;
+    using size_type   = std::size_t;
+
+    enum class EnumerationOrder : int{
+        ASCENDING  = 0,
+        DESCENDING = 1,
+    };
+
+    persistent_tree() = default;
+
+    template <std::input_iterator It>
+    persistent_tree(It first, It last) {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    persistent_tree(const persistent_tree& other) noexcept
+        : root(acquire(other.root))
+        , item_count(other.item_count)
+    {}
+
+    persistent_tree(persistent_tree&& other) noexcept
+        : root(std::exchange(other.root, nullptr))
+        , item_count(std::exchange(other.item_count, 0))
+    {}
+
+    persistent_tree& operator=(const persistent_tree& other) noexcept {
+        persistent_tree(other).swap(*this);
+        return *this;
+    }
+
+    persistent_tree& operator=(persistent_tree&& other) noexcept {
+        persistent_tree(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~persistent_tree() {
+        release(root);
+    }
+
+    void swap(persistent_tree& other) noexcept {
+        std::swap(root, other.root);
+        std::swap(item_count, other.item_count);
+    }
+
+    /**
+     * @brief snapshot returns the version that keeps the current state, it is the same as copying
+     */
+    [[nodiscard]] persistent_tree snapshot() const noexcept {
+        return *this;
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return item_count == 0;
+    }
+
+    [[nodiscard]] size_type size() const noexcept {
+        return item_count;
+    }
+
+    //Modifiers
+    /**
+     * @brief insert inserts the value when this version doesn't contain an equivalent key
+     * @return true when the value was inserted otherwise false
+     */
+    bool insert(const value_type& value);
+
+    /**
+     * @brief erase removes the element with the key from this version
+     * @return number of removed elements (0 or 1)
+     */
+    size_type erase(const key_type& key);
+
+    void clear() noexcept {
+        release(std::exchange(root, nullptr));
+        item_count = 0;
+    }
+
+    //Lookup
+    template <typename K>
+    [[nodiscard]] size_type count(const K& x) const {
+        return lookup(x) != nullptr ? 1 : 0;
+    }
+
+    template <typename K>
+    [[nodiscard]] bool contains(const K& x) const {
+        return count(x) != 0;
+    }
+
+    /**
+     * @brief find
+     * @return pointer to the element with key x or nullptr, it is valid while a version refers to the node
+     */
+    template <typename K>
+    [[nodiscard]] const value_type* find(const K& x) const {
+        auto n = lookup(x);
+        return n == nullptr ? nullptr : &n->value;
+    }
+
+    /**
+     * @brief at returns the mapped value of the key (the map only)
+     * @throw std::out_of_range when the tree doesn't contain the key
+     */
+    template <typename K>
+    const auto& at(const K& x) const requires (!std::is_void_v<T>) {
+        auto n = lookup(x);
+        if (n == nullptr)
+            throw std::out_of_range("binary_tree::persistent_tree::at: the key is not found");
+        return n->value.second;
+    }
+
+    /**
+     * @brief calls functor f for every element in the tree while f returns true
+     */
+    template <typename F>
+    void enumerate(F visitor, EnumerationOrder order = EnumerationOrder::ASCENDING) const;
+
+    /**
+     * @brief shares_root_test checks that both versions refer to the same root, for testing purposes only!
+     */
+    bool shares_root_test(const persistent_tree& other) const noexcept {
+        return root == other.root;
+    }
+
+    /**
+     * @brief verify_test checks the key order, AVL heights and reference counts, for testing purposes only!
+     */
+    bool verify_test() const {
+        return checked_height(root) >= 0;
+    }
+
+private:
+    struct node {
+        node*                 links[2] = {nullptr, nullptr};
+        value_type            value;
+        /// number of links and versions that refer to the node
+        std::atomic<uint32_t> references = 1;
+        int8_t                height = 1;
+
+        explicit node(const value_type& v)
+            : value(v)
+        {}
+
+        node(const node& other)
+            : links{other.links[0], other.links[1]}
+            , value(other.value)
+            , height(other.height)
+        {
+            // the children are shared after the value has been copied
+            acquire(links[0]);
+            acquire(links[1]);
+        }
+    };
+
+    using node_pointer = node*;
+
+    /// AVL tree with 2^64 nodes is not higher than 93
+    static constexpr int max_height = 96;
+
+    node_pointer root = nullptr;
+    size_type    item_count = 0;
+
+    static const key_type& get_key(const value_type& value) noexcept {
+        if constexpr (std::is_void_v<T>) {
+            return value;
+        } else {
+            return value.first;
+        }
+    }
+
+    static node_pointer acquire(node_pointer n) noexcept {
+        if (n != nullptr)
+            n->references.fetch_add(1, std::memory_order_relaxed);
+        return n;
+    }
+
+    static void release(node_pointer n) noexcept {
+        if (n != nullptr && n->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release(n->links[0]);
+            release(n->links[1]);
+            delete n;
+        }
+    }
+
+    /**
+     * @brief writable returns the node that the link refers to, it copies the node when another version can see it
+     * @note the link must belong to this version only
+     */
+    static node_pointer writable(node_pointer* link) {
+        auto n = *link;
+        if (n->references.load(std::memory_order_acquire) == 1)
+            return n;
+        auto copy = new node(*n);
+        *link = copy;
+        release(n);
+        return copy;
+    }
+
+    static int height(node_pointer n) noexcept {
+        return n == nullptr ? 0 : n->height;
+    }
+
+    static void update_height(node_pointer n) noexcept {
+        n->height = static_cast<int8_t>(std::max(height(n->links[0]), height(n->links[1])) + 1);
+    }
+
+    static void rotate(node_pointer* link, int dir);
+    static void rebalance(node_pointer* link);
+
+    template <typename K>
+    node_pointer lookup(const K& x) const {
+        for (auto n = root; n != nullptr;) {
+            auto cmp = Compare{}(x, get_key(n->value));
+            if (cmp == 0)
+                return n;
+            n = n->links[std::is_lt(cmp) ? 0 : 1];
+        }
+        return nullptr;
+    }
+
+    static int checked_height(node_pointer n);
+};
+
+template<typename Key, typename T, typename Compare>
+void persistent_tree<Key, T, Compare>::rotate(node_pointer* link, int dir) {
+    // the child on the dir side becomes the top, the node must be writable
+    auto n = *link;
+    auto child = writable(&n->links[dir]);
+    n->links[dir] = child->links[1 - dir];
+    child->links[1 - dir] = n;
+    *link = child;
+    update_height(n);
+    update_height(child);
+}
+
+template<typename Key, typename T, typename Compare>
+void persistent_tree<Key, T, Compare>::rebalance(node_pointer* link) {
+    auto n = *link;
+    auto balance = height(n->links[1]) - height(n->links[0]);
+    if (balance < -1 || balance > 1) {
+        auto dir = balance > 1 ? 1 : 0;
+        auto child = n->links[dir];
+        if (height(child->links[1 - dir]) > height(child->links[dir])) {
+            writable(&n->links[dir]);
+            rotate(&n->links[dir], 1 - dir);
+        }
+        rotate(link, dir);
+        return;
+    }
+    update_height(n);
+}
+
+template<typename Key, typename T, typename Compare>
+bool persistent_tree<Key, T, Compare>::insert(const value_type& value) {
+    const auto& key = get_key(value);
+    // nothing is copied when the key is in the tree
+    if (lookup(key) != nullptr)
+        return false;
+
+    node_pointer* path[max_height];
+    int depth = 0;
+    auto link = &root;
+    for (; *link != nullptr; ++depth) {
+        auto n = writable(link);
+        path[depth] = link;
+        link = &n->links[std::is_lt(Compare{}(key, get_key(n->value))) ? 0 : 1];
+    }
+    *link = new node(value);
+    while (depth > 0) {
+        rebalance(path[--depth]);
+    }
+    ++item_count;
+    return true;
+}
+
+template<typename Key, typename T, typename Compare>
+typename persistent_tree<Key, T, Compare>::size_type persistent_tree<Key, T, Compare>::erase(const key_type& key) {
+    if (lookup(key) == nullptr)
+        return 0;
+
+    node_pointer* path[max_height];
+    int depth = 0;
+    auto link = &root;
+    auto target = writable(link);
+    for (auto cmp = Compare{}(key, get_key(target->value)); cmp != 0; cmp = Compare{}(key, get_key(target->value))) {
+        path[depth++] = link;
+        link = &target->links[std::is_lt(cmp) ? 0 : 1];
+        target = writable(link);
+    }
+
+    if (target->links[0] != nullptr && target->links[1] != nullptr) {
+        // the successor value moves to the target and the successor node is removed instead
+        path[depth++] = link;
+        link = &target->links[1];
+        auto successor = writable(link);
+        while (successor->links[0] != nullptr) {
+            path[depth++] = link;
+            link = &successor->links[0];
+            successor = writable(link);
+        }
+        target->value = std::move(successor->value);
+        target = successor;
+    }
+    // the link takes over the reference of the only child
+    auto dir = target->links[0] == nullptr ? 1 : 0;
+    *link = std::exchange(target->links[dir], nullptr);
+    release(target);
+
+    while (depth > 0) {
+        rebalance(path[--depth]);
+    }
+    --item_count;
+    return 1;
+}
+
+template<typename Key, typename T, typename Compare>
+template <typename F>
+void persistent_tree<Key, T, Compare>::enumerate(F visitor, EnumerationOrder o) const {
+    auto order = static_cast<int>(o);
+    node_pointer stack[max_height];
+    int depth = 0;
+    for (auto n = root; n != nullptr || depth > 0;) {
+        // Going down as deep as possible
+        for (; n != nullptr; n = n->links[order]) {
+            stack[depth++] = n;
+        }
+        n = stack[--depth];
+        if (!visitor(std::as_const(n->value)))
+            return;
+        n = n->links[1 - order];
+    }
+}
+
+template<typename Key, typename T, typename Compare>
+int persistent_tree<Key, T, Compare>::checked_height(node_pointer n) {
+    if (n == nullptr)
+        return 0;
+    if (n->references.load(std::memory_order_relaxed) == 0)
+        return -1;
+    for (int dir : {0, 1}) {
+        auto child = n->links[dir];
+        if (child != nullptr && std::is_lt(Compare{}(get_key(child->value), get_key(n->value))) != (dir == 0))
+            return -1;
+    }
+    auto left  = checked_height(n->links[0]);
+    auto right = checked_height(n->links[1]);
+    if (left < 0 || right < 0 || left - right > 1 || right - left > 1 || n->height != std::max(left, right) + 1)
+        return -1;
+    return n->height;
+}
+
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "base.h"
+
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace binary_tree {
+
+/** @ingroup binary_tree
+ * @brief rb_balancer provides <a href="https://en.wikipedia.org/wiki/Red%E2%80%93black_tree">Red-black tree</a>.
+ *
+ * Inserting and erasing do two rotations at most and three respectively, the rest of rebalancing is recoloring.
+ * So it changes the tree less than AVL when erasing is frequent, but the tree is higher: up to 2*log2(n).
+ * Nodes have no parent link, the rebalancing goes bottom-up along the path that has been recorded by the descent.
+ */
+struct rb_balancer {
+
+struct Node {
+    bool is_red() const { return red != 0; }
+    void set_red(bool new_red) {
+        red = new_red;
+    }
+
+private:
+    // new nodes are red
+    uint8_t red = 1;
+};
+
+/// RB tree which has 2^64 nodes is not higher than 128
+static constexpr int max_path = 128;
+
+/**
+ * @brief max_height
+ * @return the maximal height of the tree that contains count nodes
+ */
+static std::size_t max_height(std::size_t count) noexcept {
+    return 2 * std::bit_width(count);
+}
+
+private:
+template <typename Node>
+static bool is_red(const Node* node) noexcept {
+    return node != nullptr && node->is_red();
+}
+
+template <typename Node>
+static int black_height(const Node* node) noexcept {
+    if (node == nullptr)
+        return 0;
+    if (node->is_red() && (is_red(node->links[0]) || is_red(node->links[1])))
+        return -1;
+    auto left  = black_height(node->links[0]);
+    auto right = black_height(node->links[1]);
+    if (left < 0 || left != right)
+        return -1;
+    return left + (node->is_red() ? 0 : 1);
+}
+
+public:
+/**
+ * @brief insert_by links a new node at the position chosen by the compare functor and rebalances the tree.
+ * @param root pointer to the root link
+ * @param compare functor that returns std::strong_ordering of the new key relative to the given node key
+ * @param create_node functor that receives the link where the new node must be stored
+ * @return the new node and true or the node with an equivalent key and false
+ */
+template<typename Node, typename F, typename C>
+static std::pair<Node*, bool> insert_by(Node** root, F compare, C create_node)
+{
+    node_path<Node, max_path> path(root);
+    for (auto node = *root; node != nullptr;) {
+        auto cmp = compare(node);
+        if (cmp == std::strong_ordering::equivalent) [[unlikely]]
+            return {node, false};
+        auto dir = node->get_direction(cmp);
+        path.push(node, dir);
+        node = node->links[dir];
+    }
+
+    create_node(path.link(path.depth));
+    auto new_node = *path.link(path.depth);
+    update_augment(new_node);
+    path.update_augment();
+
+    // The red node can't have a red parent.
+    // A red uncle takes the problem to the grandparent by recoloring, otherwise one or two rotations fix it.
+    auto node  = new_node;
+    auto level = path.depth;
+    while (level > 0) {
+        auto parent = path.nodes[level - 1];
+        if (!parent->is_red())
+            break;
+        // the red parent isn't the root
+        auto grandparent = path.nodes[level - 2];
+        int  parent_dir  = path.dirs[level - 2];
+        auto uncle       = grandparent->links[1 - parent_dir];
+        if (is_red(uncle)) {
+            parent->set_red(false);
+            uncle->set_red(false);
+            grandparent->set_red(true);
+            node = grandparent;
+            level -= 2;
+            continue;
+        }
+        if (path.dirs[level - 1] == parent_dir) {
+            rotate_2(path.link(level - 2), parent_dir);
+            parent->set_red(false);
+        } else {
+            rotate_3(path.link(level - 2), parent_dir);
+            node->set_red(false);
+        }
+        grandparent->set_red(true);
+        break;
+    }
+    (*root)->set_red(false);
+    return {new_node, true};
+}
+
+template<typename Node, typename C>
+static bool insert(Node** root, const typename Node::value_type& value, C create_node)
+{
+    const auto& key = Node::get_key(value);
+    return insert_by(root, [&key](Node* node) {
+        return node->compare(key);
+    }, [&value, &create_node](Node** link) {
+        create_node(link, value);
+    }).second;
+}
+
+/**
+ * @brief init_built_node sets the color of the node that has been linked by the bulk tree construction.
+ *
+ * The built tree is complete except the last level, so nodes of the last level are red and the others are black.
+ * @param left_height, right_height heights of the node subtrees (RB doesn't need them)
+ * @param depth, height node depth and the whole tree height
+ */
+template<typename Node>
+static void init_built_node(Node* node, int /*left_height*/, int /*right_height*/, int depth, int height) noexcept {
+    node->set_red(depth > 0 && depth == height - 1);
+}
+
+template<typename Node>
+static Node* erase(Node** root, const typename Node::key_type& key) noexcept
+{
+    node_path<Node, max_path> path(root);
+    auto target = *root;
+    while (target != nullptr) {
+        auto cmp = target->compare(key);
+        if (cmp == std::strong_ordering::equivalent)
+            break;
+        auto dir = target->get_direction(cmp);
+        path.push(target, dir);
+        target = target->links[dir];
+    }
+    if (target == nullptr) [[unlikely]]
+        return nullptr; //key not found nothing to remove
+
+    auto removed = unlink(path, target);
+    auto removed_black = !removed->is_red();
+    removed->set_red(target->is_red());
+    path.update_augment();
+    if (!removed_black)
+        return target;
+
+    // The path to the removed position has lost one black node.
+    // A red node there becomes black, otherwise the sibling subtree gives a node by rotations
+    // or loses a black node too and the problem goes up.
+    for (auto level = path.depth; true; --level) {
+        if (auto node = *path.link(level); is_red(node)) {
+            node->set_red(false);
+            return target;
+        }
+        if (level == 0)
+            break;
+        auto parent      = path.nodes[level - 1];
+        int  dir         = path.dirs[level - 1];
+        auto parent_link = path.link(level - 1);
+        auto sibling     = parent->links[1 - dir];
+        if (sibling->is_red()) {
+            rotate_2(parent_link, 1 - dir);
+            sibling->set_red(false);
+            parent->set_red(true);
+            parent_link = &sibling->links[dir];
+            sibling     = parent->links[1 - dir];
+        }
+        auto far  = sibling->links[1 - dir];
+        auto near = sibling->links[dir];
+        if (is_red(far)) {
+            rotate_2(parent_link, 1 - dir);
+            sibling->set_red(parent->is_red());
+            parent->set_red(false);
+            far->set_red(false);
+            return target;
+        }
+        if (is_red(near)) {
+            rotate_3(parent_link, 1 - dir);
+            near->set_red(parent->is_red());
+            parent->set_red(false);
+            return target;
+        }
+        sibling->set_red(true);
+        if (parent->is_red()) {
+            parent->set_red(false);
+            return target;
+        }
+    }
+    return target;
+}
+
+/**
+ * @brief verify checks the red-black properties of the tree (for testing purposes)
+ */
+template<typename Node>
+static bool verify(const Node* root) noexcept {
+    return !is_red(root) && black_height(root) >= 0;
+}
+};
+
+}
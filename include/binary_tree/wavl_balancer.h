@@ -0,0 +1,228 @@
+#pragma once
+
+#include "base.h"
+
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace binary_tree {
+
+/** @ingroup binary_tree
+ * @brief wavl_balancer provides <a href="https://en.wikipedia.org/wiki/WAVL_tree">weak AVL tree</a>.
+ *
+ * Every node has a rank, the rank difference between a node and its child is 1 or 2, leaves have rank 0.
+ * Without erasing the tree is exactly AVL tree. Erasing does two rotations at most
+ * and changes ranks in amortized O(1), so the tree is cheaper than AVL when erasing is frequent.
+ * Nodes have no parent link, the rebalancing goes bottom-up along the path that has been recorded by the descent.
+ */
+struct wavl_balancer {
+
+struct Node {
+    int get_rank() const { return rank; }
+    void set_rank(int new_rank) {
+        rank = static_cast<int8_t>(new_rank);
+    }
+
+private:
+    // new nodes are leaves
+    int8_t rank = 0;
+};
+
+/// WAVL tree which has 2^64 nodes is not higher than 128
+static constexpr int max_path = 128;
+
+/**
+ * @brief max_height
+ * @return the maximal height of the tree that contains count nodes
+ */
+static std::size_t max_height(std::size_t count) noexcept {
+    return 2 * std::bit_width(count);
+}
+
+private:
+template <typename Node>
+static int rank_of(const Node* node) noexcept {
+    return node == nullptr ? -1 : node->get_rank();
+}
+
+template <typename Node>
+static bool is_leaf(const Node* node) noexcept {
+    return node->links[0] == nullptr && node->links[1] == nullptr;
+}
+
+/**
+ * @return rank + 1 of the valid subtree or -1
+ */
+template <typename Node>
+static int checked_rank(const Node* node) noexcept {
+    if (node == nullptr)
+        return 0;
+    auto left  = checked_rank(node->links[0]);
+    auto right = checked_rank(node->links[1]);
+    if (left < 0 || right < 0)
+        return -1;
+    auto rank = node->get_rank() + 1;
+    for (auto child : {left, right}) {
+        if (rank - child < 1 || rank - child > 2)
+            return -1;
+    }
+    if (is_leaf(node) && node->get_rank() != 0)
+        return -1;
+    return rank;
+}
+
+public:
+/**
+ * @brief insert_by links a new node at the position chosen by the compare functor and rebalances the tree.
+ * @param root pointer to the root link
+ * @param compare functor that returns std::strong_ordering of the new key relative to the given node key
+ * @param create_node functor that receives the link where the new node must be stored
+ * @return the new node and true or the node with an equivalent key and false
+ */
+template<typename Node, typename F, typename C>
+static std::pair<Node*, bool> insert_by(Node** root, F compare, C create_node)
+{
+    node_path<Node, max_path> path(root);
+    for (auto node = *root; node != nullptr;) {
+        auto cmp = compare(node);
+        if (cmp == std::strong_ordering::equivalent) [[unlikely]]
+            return {node, false};
+        auto dir = node->get_direction(cmp);
+        path.push(node, dir);
+        node = node->links[dir];
+    }
+
+    create_node(path.link(path.depth));
+    auto new_node = *path.link(path.depth);
+    update_augment(new_node);
+    path.update_augment();
+
+    // The node can't have the same rank as its parent.
+    // The parent is promoted while its other child is a 1-child, otherwise one or two rotations fix it.
+    auto node  = new_node;
+    auto level = path.depth;
+    while (level > 0) {
+        auto parent = path.nodes[level - 1];
+        auto rank   = parent->get_rank();
+        if (rank != node->get_rank())
+            break;
+        int  dir    = path.dirs[level - 1];
+        if (rank - rank_of(parent->links[1 - dir]) == 1) {
+            parent->set_rank(rank + 1);
+            node = parent;
+            --level;
+            continue;
+        }
+        auto inner = node->links[1 - dir];
+        if (node->get_rank() - rank_of(inner) == 2) {
+            rotate_2(path.link(level - 1), dir);
+            parent->set_rank(rank - 1);
+        } else {
+            rotate_3(path.link(level - 1), dir);
+            inner->set_rank(inner->get_rank() + 1);
+            node->set_rank(node->get_rank() - 1);
+            parent->set_rank(rank - 1);
+        }
+        break;
+    }
+    return {new_node, true};
+}
+
+template<typename Node, typename C>
+static bool insert(Node** root, const typename Node::value_type& value, C create_node)
+{
+    const auto& key = Node::get_key(value);
+    return insert_by(root, [&key](Node* node) {
+        return node->compare(key);
+    }, [&value, &create_node](Node** link) {
+        create_node(link, value);
+    }).second;
+}
+
+/**
+ * @brief init_built_node sets the rank of the node that has been linked by the bulk tree construction.
+ *
+ * The rank is the node height minus one, so the built tree is AVL tree.
+ * @param left_height, right_height heights of the node subtrees
+ * @param depth, height node depth and the whole tree height (WAVL doesn't need them)
+ */
+template<typename Node>
+static void init_built_node(Node* node, int left_height, int right_height, int /*depth*/, int /*height*/) noexcept {
+    node->set_rank(left_height > right_height ? left_height : right_height);
+}
+
+template<typename Node>
+static Node* erase(Node** root, const typename Node::key_type& key) noexcept
+{
+    node_path<Node, max_path> path(root);
+    auto target = *root;
+    while (target != nullptr) {
+        auto cmp = target->compare(key);
+        if (cmp == std::strong_ordering::equivalent)
+            break;
+        auto dir = target->get_direction(cmp);
+        path.push(target, dir);
+        target = target->links[dir];
+    }
+    if (target == nullptr) [[unlikely]]
+        return nullptr; //key not found nothing to remove
+
+    auto removed = unlink(path, target);
+    removed->set_rank(target->get_rank());
+    path.update_augment();
+
+    // A leaf must have rank 0 and a child can't be a 3-child.
+    // Demotions go up while the sibling is a 2-child or a 2,2 node, otherwise one or two rotations fix it.
+    for (auto level = path.depth; level > 0; --level) {
+        auto parent = path.nodes[level - 1];
+        auto rank   = parent->get_rank();
+        if (is_leaf(parent)) {
+            if (rank == 0)
+                break;
+            parent->set_rank(0);
+            continue;
+        }
+        int  dir    = path.dirs[level - 1];
+        if (rank - rank_of(parent->links[dir]) < 3)
+            break;
+        auto sibling      = parent->links[1 - dir];
+        auto sibling_rank = sibling->get_rank();
+        if (rank - sibling_rank == 2) {
+            parent->set_rank(rank - 1);
+            continue;
+        }
+        auto far  = sibling->links[1 - dir];
+        auto near = sibling->links[dir];
+        if (sibling_rank - rank_of(far) == 2 && sibling_rank - rank_of(near) == 2) {
+            parent->set_rank(rank - 1);
+            sibling->set_rank(sibling_rank - 1);
+            continue;
+        }
+        if (sibling_rank - rank_of(far) == 1) {
+            rotate_2(path.link(level - 1), 1 - dir);
+            sibling->set_rank(sibling_rank + 1);
+            parent->set_rank(is_leaf(parent) ? 0 : rank - 1);
+        } else {
+            rotate_3(path.link(level - 1), 1 - dir);
+            near->set_rank(near->get_rank() + 2);
+            sibling->set_rank(sibling_rank - 1);
+            parent->set_rank(rank - 2);
+        }
+        break;
+    }
+    return target;
+}
+
+/**
+ * @brief verify checks the rank rules of the tree (for testing purposes)
+ */
+template<typename Node>
+static bool verify(const Node* root) noexcept {
+    return checked_rank(root) >= 0;
+}
+};
+
+}
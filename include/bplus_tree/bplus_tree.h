@@ -0,0 +1,750 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// BPLUS_TREE_NO_SIMD turns off the SSE2 search, so the scalar search of the other targets can be tested on x86-64
+#if defined(__SSE2__) && !defined(BPLUS_TREE_NO_SIMD)
+#define BPLUS_TREE_SSE2
+#include <emmintrin.h>
+#endif
+
+/** @defgroup bplus_tree bplus_tree
+ * @brief B+ tree for big sets and maps of small keys
+ *
+ * <a href="https://en.wikipedia.org/wiki/B%2B_tree">B+ tree</a> keeps many keys in every node,
+ * so the search visits a few nodes instead of a node per level as binary_tree::tree does.
+ * Every node takes a few cache lines, the search inside the node scans the sorted keys sequentially
+ * and the cache prefetcher hides the latency of the next lines.
+ * For 32-bit integer keys the scan compares four keys at once with SSE2.
+ *
+ * The interface follows binary_tree::tree: it is the set when T is void and the map otherwise.
+ */
+
+namespace bplus_tree {
+
+namespace detail {
+
+/// mapped values of the leaf, leaves of the set have none
+template <typename T, std::size_t N>
+struct mapped_array {
+    T data[N];
+};
+
+template <std::size_t N>
+struct mapped_array<void, N> {
+};
+
+}
+
+/** @ingroup bplus_tree
+ * @class tree
+ * @brief tree is B+ tree: items are kept sorted in leaves, inner nodes keep separator keys and links to children.
+ *
+ * Differences from binary_tree::tree:
+ *  - there are no iterators, any insert or erase moves items between nodes. enumerate() visits the items.
+ *  - Key and T must be default constructible, every node constructs all its slots.
+ *  - in the map mode keys and mapped values are kept in separate arrays, so enumerate()
+ *    passes std::pair<const Key&, T&> instead of value_type.
+ * @tparam Key key type
+ * @tparam T mapped type, void for the set
+ * @tparam Compare three-way comparison functor. The search inside nodes uses SIMD
+ * when the comparison is std::compare_three_way and Key is a 32-bit integer.
+ * @tparam Alloc allocator template, it is instantiated for the leaf and inner node types
+ * @tparam NodeSize desired node size in bytes, nodes are aligned to the cache line.
+ * Nodes are bigger when fewer than four keys fit in this size.
+ */
+template<typename Key, typename T = void,
+         typename Compare = std::compare_three_way,
+         template<typename X> typename Alloc = std::allocator,
+         std::size_t NodeSize = 256>
+class tree
+{
+public:
+    ///Alias for Key
+    using key_type    = Key;
+    ///Alias for T
+    using mapped_type = T;
+    /**
+     * When T isn't void value_type is std::pair<Key,T>.
+     * In the other case it is alias for Key
+     */
+    using value_type  = std::conditional_t<std::is_void_v<T>, Key, std::pair<Key, T>>;
+    /// Alias for Compare
+    using key_compare = Compare;
+    using size_type   = std::size_t;
+
+    enum class EnumerationOrder : int{
+        ASCENDING  = 0,
+        DESCENDING = 1,
+    };
+
+private:
+    static constexpr bool is_set = std::is_void_v<T>;
+    static constexpr std::size_t mapped_size = sizeof(std::conditional_t<is_set, char, T>) * (is_set ? 0 : 1);
+    static constexpr std::size_t cache_line  = 64;
+
+public:
+    ///Maximal number of items in the leaf
+    static constexpr int leaf_capacity  = static_cast<int>(std::max<std::size_t>(4, (NodeSize - 8) / (sizeof(Key) + mapped_size)));
+    ///Maximal number of keys in the inner node, it has one more child
+    static constexpr int inner_capacity = static_cast<int>(std::max<std::size_t>(4, (NodeSize - 16) / (sizeof(Key) + sizeof(void*))));
+
+private:
+    static_assert(leaf_capacity <= UINT16_MAX && inner_capacity <= UINT16_MAX, "NodeSize is too big");
+
+    static constexpr int min_leaf  = leaf_capacity / 2;
+    // an inner split gives the separator to the parent, so the right half can have one key less
+    static constexpr int min_inner = (inner_capacity - 1) / 2;
+    /**
+     * max_levels is the most inner levels of the tree of size_type items. The root has at least 2 children,
+     * other inner nodes have at least min_inner + 1 (2 for inner_capacity 4) and leaves have at least min_leaf items.
+     */
+    static constexpr int max_levels = [] {
+        constexpr std::size_t fanout = min_inner + 1;
+        // the fewest items in the tree of one inner level
+        std::size_t least_items = 2 * static_cast<std::size_t>(min_leaf);
+        int levels = 1;
+        while (least_items <= std::numeric_limits<size_type>::max() / fanout) {
+            least_items *= fanout;
+            ++levels;
+        }
+        return levels;
+    }();
+
+    struct node {
+        uint16_t count = 0;
+    };
+
+    struct alignas(cache_line) leaf_node : node {
+        Key keys[leaf_capacity];
+        [[no_unique_address]] detail::mapped_array<T, leaf_capacity> values;
+    };
+
+    struct alignas(cache_line) inner_node : node {
+        Key   keys[inner_capacity];
+        node* children[inner_capacity + 1];
+    };
+
+    using leaf_allocator_type  = Alloc<leaf_node>;
+    using inner_allocator_type = Alloc<inner_node>;
+    using leaf_traits  = std::allocator_traits<leaf_allocator_type>;
+    using inner_traits = std::allocator_traits<inner_allocator_type>;
+
+public:
+    ///Size of the leaf in bytes
+    static constexpr std::size_t leaf_size  = sizeof(leaf_node);
+    ///Size of the inner node in bytes
+    static constexpr std::size_t inner_size = sizeof(inner_node);
+
+    tree() noexcept(std::is_nothrow_default_constructible_v<leaf_allocator_type>
+                    && std::is_nothrow_default_constructible_v<inner_allocator_type>) = default;
+
+    tree(const tree&) = delete;
+    tree(tree&&) = delete;
+    tree& operator=(const tree&) = delete;
+    tree& operator=(tree&&) = delete;
+
+    ~tree() {
+        clear();
+    }
+
+    //Capacity
+    [[nodiscard]] bool empty() const noexcept {
+        return root == nullptr;
+    }
+
+    [[nodiscard]] size_type size() const noexcept {
+        return item_count;
+    }
+
+    [[nodiscard]] size_type max_size() const noexcept {
+        return std::numeric_limits<size_type>::max();
+    }
+
+    /**
+     * @brief height
+     * @return number of levels, 0 for the empty tree and 1 when the root is a leaf
+     */
+    [[nodiscard]] int height() const noexcept {
+        return root == nullptr ? 0 : inner_levels + 1;
+    }
+
+    //Modifiers
+    /**
+     * @brief Inserts element into the container, if the container doesn't already contain an element with an equivalent key.
+     *
+     * Full nodes on the path are split. The new nodes are allocated before any change,
+     * so the tree stays intact when the allocation throws.
+     * @param value element value to insert
+     * @return true when an element was inserted otherwise false
+     */
+    bool insert(const value_type& value);
+
+    /**
+     * @brief erase Removes specified elements from the container.
+     *
+     * The node that is less than half full takes an item from its sibling or is merged with it.
+     * @param key
+     * @return Number of elements removed.
+     */
+    size_type erase(const key_type& key) noexcept;
+
+    /**
+     * @brief clear Erases all elements from the container.
+     */
+    void clear() noexcept {
+        if (root != nullptr) {
+            destroy_subtree(root, inner_levels);
+        }
+        root         = nullptr;
+        inner_levels = 0;
+        item_count   = 0;
+    }
+
+    void swap(tree& other) noexcept {
+        std::swap(root, other.root);
+        std::swap(inner_levels, other.inner_levels);
+        std::swap(item_count, other.item_count);
+        std::swap(leaf_allocator, other.leaf_allocator);
+        std::swap(inner_allocator, other.inner_allocator);
+    }
+
+    //Lookup
+    template <typename K>
+    [[nodiscard]] size_type count(const K& x) const {
+        auto [leaf, pos] = find_position(x);
+        return leaf != nullptr && pos < leaf->count && Compare{}(x, leaf->keys[pos]) == 0 ? 1 : 0;
+    }
+
+    template <typename K>
+    [[nodiscard]] bool contains(const K& x) const {
+        return count(x) != 0;
+    }
+
+    /**
+     * @brief at returns the mapped value of the key (the map only)
+     * @throw std::out_of_range when the tree doesn't contain the key
+     */
+    template <typename K>
+    auto& at(const K& x) requires (!std::is_void_v<T>) {
+        auto [leaf, pos] = find_position(x);
+        if (leaf == nullptr || pos == leaf->count || Compare{}(x, leaf->keys[pos]) != 0)
+            throw std::out_of_range("bplus_tree::tree::at: the key is not found");
+        return leaf->values.data[pos];
+    }
+
+    /**
+     * @brief calls functor f for every element in the tree while f returns true
+     *
+     * The set passes const Key&, the map passes std::pair<const Key&, T&>.
+     * @tparam F functional object type
+     */
+    template <typename F>
+    void enumerate(F visitor, EnumerationOrder order = EnumerationOrder::ASCENDING) {
+        if (root != nullptr) {
+            enumerate_subtree(root, inner_levels, visitor, static_cast<int>(order));
+        }
+    }
+
+    //Test & debug
+    /**
+     * @brief verify_test checks the key order, node fill and depth of leaves, for testing purposes only!
+     */
+    bool verify_test() const {
+        if (root == nullptr)
+            return item_count == 0;
+        size_type items = 0;
+        return verify_subtree(root, inner_levels, nullptr, nullptr, items) && items == item_count;
+    }
+
+private:
+    node*     root         = nullptr;
+    int       inner_levels = 0;
+    size_type item_count   = 0;
+    [[no_unique_address]] leaf_allocator_type  leaf_allocator;
+    [[no_unique_address]] inner_allocator_type inner_allocator;
+
+    static const key_type& get_key(const value_type& value) noexcept {
+        if constexpr (is_set) {
+            return value;
+        } else {
+            return value.first;
+        }
+    }
+
+    template <typename K>
+    static constexpr bool is_simd_key = std::is_same_v<Compare, std::compare_three_way> && std::is_same_v<K, Key>
+                                     && std::is_integral_v<Key> && sizeof(Key) == 4;
+
+    template <typename K>
+    static constexpr bool is_scalar_key = std::is_same_v<Compare, std::compare_three_way> && std::is_same_v<K, Key>
+                                       && std::is_arithmetic_v<Key>;
+
+    /**
+     * @return number of keys that are less than x (or not greater than x when Upper is true)
+     */
+    template <bool Upper, typename K>
+    static int search(const Key* keys, int count, const K& x) noexcept;
+
+    template <typename K>
+    std::pair<leaf_node*, int> find_position(const K& x) const noexcept;
+
+    leaf_node* create_leaf() {
+        auto leaf = leaf_traits::allocate(leaf_allocator, 1);
+        leaf_traits::construct(leaf_allocator, leaf);
+        return leaf;
+    }
+
+    inner_node* create_inner() {
+        auto inner = inner_traits::allocate(inner_allocator, 1);
+        inner_traits::construct(inner_allocator, inner);
+        return inner;
+    }
+
+    void destroy(leaf_node* leaf) noexcept {
+        leaf_traits::destroy(leaf_allocator, leaf);
+        leaf_traits::deallocate(leaf_allocator, leaf, 1);
+    }
+
+    void destroy(inner_node* inner) noexcept {
+        inner_traits::destroy(inner_allocator, inner);
+        inner_traits::deallocate(inner_allocator, inner, 1);
+    }
+
+    void destroy_subtree(node* n, int level) noexcept;
+
+    /// moves items [first, last) of src to dst starting at d_first, the nodes must differ
+    static void move_items(leaf_node* src, int first, int last, leaf_node* dst, int d_first) noexcept {
+        std::move(src->keys + first, src->keys + last, dst->keys + d_first);
+        if constexpr (!is_set) {
+            std::move(src->values.data + first, src->values.data + last, dst->values.data + d_first);
+        }
+    }
+
+    /// moves items [first, count) of the leaf by shift positions (1 or -1)
+    static void shift_items(leaf_node* leaf, int first, int shift) noexcept {
+        auto last = static_cast<int>(leaf->count);
+        if (shift > 0) {
+            std::move_backward(leaf->keys + first, leaf->keys + last, leaf->keys + last + shift);
+            if constexpr (!is_set) {
+                std::move_backward(leaf->values.data + first, leaf->values.data + last, leaf->values.data + last + shift);
+            }
+        } else {
+            std::move(leaf->keys + first, leaf->keys + last, leaf->keys + first + shift);
+            if constexpr (!is_set) {
+                std::move(leaf->values.data + first, leaf->values.data + last, leaf->values.data + first + shift);
+            }
+        }
+    }
+
+    static void set_item(leaf_node* leaf, int pos, const value_type& value) {
+        leaf->keys[pos] = get_key(value);
+        if constexpr (!is_set) {
+            leaf->values.data[pos] = value.second;
+        }
+    }
+
+    static void insert_into_leaf(leaf_node* leaf, int pos, const value_type& value) {
+        shift_items(leaf, pos, 1);
+        set_item(leaf, pos, value);
+        ++leaf->count;
+    }
+
+    /// inserts the key at position i and the child to the right of it
+    static void insert_into_inner(inner_node* inner, int i, Key& key, node* child) noexcept {
+        auto count = static_cast<int>(inner->count);
+        std::move_backward(inner->keys + i, inner->keys + count, inner->keys + count + 1);
+        std::move_backward(inner->children + i + 1, inner->children + count + 1, inner->children + count + 2);
+        inner->keys[i]         = std::move(key);
+        inner->children[i + 1] = child;
+        ++inner->count;
+    }
+
+    /// removes the key at position i and the child to the right of it
+    static void remove_from_inner(inner_node* inner, int i) noexcept {
+        auto count = static_cast<int>(inner->count);
+        std::move(inner->keys + i + 1, inner->keys + count, inner->keys + i);
+        std::move(inner->children + i + 2, inner->children + count + 1, inner->children + i + 1);
+        --inner->count;
+    }
+
+    static void split_leaf(leaf_node* left, leaf_node* right, int pos, const value_type& value);
+    static void split_inner(inner_node* left, inner_node* right, int i, Key& separator, node*& child) noexcept;
+
+    void rebalance_leaf(inner_node* parent, int i) noexcept;
+    void rebalance_inner(inner_node* parent, int i) noexcept;
+
+    template <typename F>
+    static bool enumerate_subtree(node* n, int level, F& visitor, int order);
+
+    bool verify_subtree(const node* n, int level, const Key* low, const Key* high, size_type& items) const;
+};
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc, std::size_t NodeSize>
+template <bool Upper, typename K>
+int tree<Key, T, Compare, Alloc, NodeSize>::search(const Key* keys, int count, const K& x) noexcept {
+    int i = 0;
+#if defined(BPLUS_TREE_SSE2)
+    if constexpr (is_simd_key<K>) {
+        // the signed comparison of biased values orders unsigned keys too
+        constexpr uint32_t bias = std::is_signed_v<Key> ? 0 : 0x80000000u;
+        const auto flip   = _mm_set1_epi32(static_cast<int>(bias));
+        const auto needle = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(x) ^ bias));
+        for (; i + 4 <= count; i += 4) {
+            auto v    = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), flip);
+            auto less = _mm_cmplt_epi32(v, needle);
+            if constexpr (Upper) {
+                less = _mm_or_si128(less, _mm_cmpeq_epi32(v, needle));
+            }
+            // keys are sorted, so the first block that isn't wholly less ends the scan
+            auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(less)));
+            if (mask != 0xF)
+                return i + std::popcount(mask);
+        }
+    }
+#endif
+    if constexpr (is_scalar_key<K>) {
+        // branchless counting, the compiler can vectorize it
+        auto result = i;
+        for (; i < count; ++i) {
+            result += Upper ? !(x < keys[i]) : keys[i] < x;
+        }
+        return result;
+    } else {
+        auto low  = i;
+        auto high = count;
+        while (low < high) {
+            auto middle = (low + high) / 2;
+            auto cmp = Compare{}(keys[middle], x);
+            if (Upper ? !std::is_gt(cmp) : std::is_lt(cmp))
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return low;
+    }
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc, std::size_t NodeSize>
+template <typename K>
+std::pair<typename tree<Key, T, Compare, Alloc, NodeSize>::leaf_node*, int>
+tree<Key, T, Compare, Alloc, NodeSize>::find_position(const K& x) const noexcept {
+    if (root == nullptr)
+        return {nullptr, 0};
+    auto n = root;
+    for (int level = 0; level < inner_levels; ++level) {
+        auto inner = static_cast<inner_node*>(n);
+        n = inner->children[search<true>(inner->keys, inner->count, x)];
+    }
+    auto leaf = static_cast<leaf_node*>(n);
+    return {leaf, search<false>(leaf->keys, leaf->count, x)};
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc, std::size_t NodeSize>
+bool tree<Key, T, Compare, Alloc, NodeSize>::insert(const value_type& value) {
+    const auto& key = get_key(value);
+    if (root == nullptr) {
+        auto leaf = create_leaf();
+        set_item(leaf, 0, value);
+        leaf->count  = 1;
+        root         = leaf;
+        inner_levels = 0;
+        item_count   = 1;
+        return true;
+    }
+
+    inner_node* path[max_levels];
+    int         slots[max_levels];
+    auto n = root;
+    for (int level = 0; level < inner_levels; ++level) {
+        auto inner = static_cast<inner_node*>(n);
+        auto i = search<true>(inner->keys, inner->count, key);
+        path[level]  = inner;
+        slots[level] = i;
+        n = inner->children[i];
+    }
+    auto leaf = static_cast<leaf_node*>(n);
+    auto pos  = search<false>(leaf->keys, leaf->count, key);
+    if (pos < leaf->count && Compare{}(key, leaf->keys[pos]) == 0)
+        return false;
+
+    if (leaf->count < leaf_capacity) {
+        insert_into_leaf(leaf, pos, value);
+        ++item_count;
+        return true;
+    }
+
+    // The leaf and the full inner nodes above it are split, a new root is needed when all of them are full
+    auto full_levels = 0;
+    while (full_levels < inner_levels && path[inner_levels - 1 - full_levels]->count == inner_capacity) {
+        ++full_levels;
+    }
+    auto new_inner_count = full_levels + (full_levels == inner_levels ? 1 : 0);
+    inner_node* new_inners[max_levels + 1];
+    leaf_node*  right   = nullptr;
+    int         created = 0;
+    try {
+        right = create_leaf();
+        for (; created < new_inner_count; ++created) {
+            new_inners[created] = create_inner();
+        }
+    } catch (...) {
+        if (right != nullptr)
+            destroy(right);
+        for (int k = 0; k < created; ++k) {
+            destroy(new_inners[k]);
+        }
+        throw;
+    }
+
+    split_leaf(leaf, right, pos, value);
+    ++item_count;
+    Key   separator = right->keys[0];
+    node* child     = right;
+    int   spare     = 0;
+    for (int level = inner_levels; level-- > 0;) {
+        auto inner = path[level];
+        if (inner->count < inner_capacity) {
+            insert_into_inner(inner, slots[level], separator, child);
+            return true;
+        }
+        split_inner(inner, new_inners[spare++], slots[level], separator, child);
+    }
+    auto new_root = new_inners[spare];
+    new_root->keys[0]     = std::move(separator);
+    new_root->children[0] = root;
+    new_root->children[1] = child;
+    new_root->count       = 1;
+    root = new_root;
+    ++inner_levels;
+    return true;
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc, std::size_t NodeSize>
+void tree<Key, T, Compare, Alloc, NodeSize>::split_leaf(leaf_node* left, leaf_node* right, int pos, const value_type& value) {
+    constexpr int middle = leaf_capacity / 2;
+    move_items(left, middle, leaf_capacity, right, 0);
+    right->count = leaf_capacity - middle;
+    left->count  = middle;
+    if (pos <= middle)
+        insert_into_leaf(left, pos, value);
+    else
+        insert_into_leaf(right, pos - middle, value);
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc, std::size_t NodeSize>
+void tree<Key, T, Compare, Alloc, NodeSize>::split_inner(inner_node* left, inner_node* right, int i, Key& separator, node*& child) noexcept {
+    constexpr int middle = inner_capacity / 2;
+    Key up = std::move(left->keys[middle]);
+    std::move(left->keys + middle + 1, left->keys + inner_capacity, right->keys);
+    std::copy(left->children + middle + 1, left->children + inner_capacity + 1, right->children);
+    right->count = inner_capacity - middle - 1;
+    left->count  = middle;
+    if (i <= middle)
+        insert_into_inner(left, i, separator, child);
+    else
+        insert_into_inner(right, i - middle - 1, separator, child);
+    separator = std::move(up);
+    child     = right;
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc, std::size_t NodeSize>
+typename tree<Key, T, Compare, Alloc, NodeSize>::size_type tree<Key, T, Compare, Alloc, NodeSize>::erase(const key_type& key) noexcept {
+    if (root == nullptr)
+        return 0;
+
+    inner_node* path[max_levels];
+    int         slots[max_levels];
+    auto n = root;
+    for (int level = 0; level < inner_levels; ++level) {
+        auto inner = static_cast<inner_node*>(n);
+        auto i = search<true>(inner->keys, inner->count, key);
+        path[level]  = inner;
+        slots[level] = i;
+        n = inner->children[i];
+    }
+    auto leaf = static_cast<leaf_node*>(n);
+    auto pos  = search<false>(leaf->keys, leaf->count, key);
+    if (pos == leaf->count || Compare{}(key, leaf->keys[pos]) != 0)
+        return 0;
+
+    // Separators above can be equal to the erased key, they still divide the subtrees correctly
+    shift_items(leaf, pos + 1, -1);
+    --leaf->count;
+    --item_count;
+    if (inner_levels == 0) {
+        if (leaf->count == 0) {
+            destroy(leaf);
+            root = nullptr;
+        }
+        return 1;
+    }
+    if (leaf->count >= min_leaf)
+        return 1;
+
+    rebalance_leaf(path[inner_levels - 1], slots[inner_levels - 1]);
+    for (auto level = inner_levels - 1; level > 0 && path[level]->count < min_inner; --level) {
+        rebalance_inner(path[level - 1], slots[level - 1]);
+    }
+    if (auto old_root = static_cast<inner_node*>(root); old_root->count == 0) {
+        root = old_root->children[0];
+        destroy(old_root);
+        --inner_levels;
+    }
+    return 1;
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc, std::size_t NodeSize>
+void tree<Key, T, Compare, Alloc, NodeSize>::rebalance_leaf(inner_node* parent, int i) noexcept {
+    // The leaf takes an item from the sibling that has more than the minimum, otherwise they are merged
+    auto leaf = static_cast<leaf_node*>(parent->children[i]);
+    if (i > 0) {
+        auto left = static_cast<leaf_node*>(parent->children[i - 1]);
+        if (left->count > min_leaf) {
+            shift_items(leaf, 0, 1);
+            move_items(left, left->count - 1, left->count, leaf, 0);
+            --left->count;
+            ++leaf->count;
+            parent->keys[i - 1] = leaf->keys[0];
+            return;
+        }
+        --i;
+    } else {
+        auto right = static_cast<leaf_node*>(parent->children[i + 1]);
+        if (right->count > min_leaf) {
+            move_items(right, 0, 1, leaf, leaf->count);
+            ++leaf->count;
+            shift_items(right, 1, -1);
+            --right->count;
+            parent->keys[i] = right->keys[0];
+            return;
+        }
+    }
+    auto left  = static_cast<leaf_node*>(parent->children[i]);
+    auto right = static_cast<leaf_node*>(parent->children[i + 1]);
+    move_items(right, 0, right->count, left, left->count);
+    left->count += right->count;
+    destroy(right);
+    remove_from_inner(parent, i);
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc, std::size_t NodeSize>
+void tree<Key, T, Compare, Alloc, NodeSize>::rebalance_inner(inner_node* parent, int i) noexcept {
+    // The same as for leaves but the separator of the parent goes down and the sibling key goes up
+    auto inner = static_cast<inner_node*>(parent->children[i]);
+    auto count = static_cast<int>(inner->count);
+    if (i > 0) {
+        auto left = static_cast<inner_node*>(parent->children[i - 1]);
+        if (left->count > min_inner) {
+            std::move_backward(inner->keys, inner->keys + count, inner->keys + count + 1);
+            std::move_backward(inner->children, inner->children + count + 1, inner->children + count + 2);
+            inner->keys[0]      = std::move(parent->keys[i - 1]);
+            inner->children[0]  = left->children[left->count];
+            parent->keys[i - 1] = std::move(left->keys[left->count - 1]);
+            --left->count;
+            ++inner->count;
+            return;
+        }
+        --i;
+    } else {
+        auto right = static_cast<inner_node*>(parent->children[i + 1]);
+        if (right->count > min_inner) {
+            inner->keys[count]         = std::move(parent->keys[i]);
+            inner->children[count + 1] = right->children[0];
+            ++inner->count;
+            parent->keys[i] = std::move(right->keys[0]);
+            std::move(right->keys + 1, right->keys + right->count, right->keys);
+            std::move(right->children + 1, right->children + right->count + 1, right->children);
+            --right->count;
+            return;
+        }
+    }
+    auto left  = static_cast<inner_node*>(parent->children[i]);
+    auto right = static_cast<inner_node*>(parent->children[i + 1]);
+    auto left_count = static_cast<int>(left->count);
+    left->keys[left_count] = std::move(parent->keys[i]);
+    std::move(right->keys, right->keys + right->count, left->keys + left_count + 1);
+    std::copy(right->children, right->children + right->count + 1, left->children + left_count + 1);
+    left->count += right->count + 1;
+    destroy(right);
+    remove_from_inner(parent, i);
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc, std::size_t NodeSize>
+void tree<Key, T, Compare, Alloc, NodeSize>::destroy_subtree(node* n, int level) noexcept {
+    if (level == 0) {
+        destroy(static_cast<leaf_node*>(n));
+        return;
+    }
+    auto inner = static_cast<inner_node*>(n);
+    for (int i = 0; i <= inner->count; ++i) {
+        destroy_subtree(inner->children[i], level - 1);
+    }
+    destroy(inner);
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc, std::size_t NodeSize>
+template <typename F>
+bool tree<Key, T, Compare, Alloc, NodeSize>::enumerate_subtree(node* n, int level, F& visitor, int order) {
+    auto count = static_cast<int>(n->count);
+    if (level == 0) {
+        auto leaf = static_cast<leaf_node*>(n);
+        for (int k = 0; k < count; ++k) {
+            auto i = order == 0 ? k : count - 1 - k;
+            if constexpr (is_set) {
+                if (!visitor(static_cast<const Key&>(leaf->keys[i])))
+                    return false;
+            } else {
+                std::pair<const Key&, T&> item(leaf->keys[i], leaf->values.data[i]);
+                if (!visitor(item))
+                    return false;
+            }
+        }
+        return true;
+    }
+    auto inner = static_cast<inner_node*>(n);
+    for (int k = 0; k <= count; ++k) {
+        if (!enumerate_subtree(inner->children[order == 0 ? k : count - k], level - 1, visitor, order))
+            return false;
+    }
+    return true;
+}
+
+template<typename Key, typename T, typename Compare, template<typename X> typename Alloc, std::size_t NodeSize>
+bool tree<Key, T, Compare, Alloc, NodeSize>::verify_subtree(const node* n, int level, const Key* low, const Key* high, size_type& items) const {
+    // keys of the subtree are in [low, high)
+    auto count = static_cast<int>(n->count);
+    auto min_count = n == root ? 1 : (level == 0 ? min_leaf : min_inner);
+    if (count < min_count || count > (level == 0 ? leaf_capacity : inner_capacity))
+        return false;
+    const Key* keys = level == 0 ? static_cast<const leaf_node*>(n)->keys : static_cast<const inner_node*>(n)->keys;
+    for (int i = 0; i < count; ++i) {
+        if (i > 0 && !std::is_lt(Compare{}(keys[i - 1], keys[i])))
+            return false;
+        if (low != nullptr && std::is_lt(Compare{}(keys[i], *low)))
+            return false;
+        if (high != nullptr && !std::is_lt(Compare{}(keys[i], *high)))
+            return false;
+    }
+    if (level == 0) {
+        items += count;
+        return true;
+    }
+    auto inner = static_cast<const inner_node*>(n);
+    for (int i = 0; i <= count; ++i) {
+        if (!verify_subtree(inner->children[i], level - 1, i == 0 ? low : &keys[i - 1], i == count ? high : &keys[i], items))
+            return false;
+    }
+    return true;
+}
+
+}
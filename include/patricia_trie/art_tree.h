@@ -0,0 +1,898 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "util/bitutil.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief art_tree is <a href="https://db.in.tum.de/~leis/papers/ART.pdf">adaptive radix tree</a> of byte strings
+ * (std::string, std::vector<uint8_t> etc.).
+ *
+ * Every inner node branches by one byte of the key. Nodes grow and shrink through four sizes:
+ * Node4 and Node16 keep sorted bytes (Node16 is searched with SSE2), Node48 maps a byte to one of 48 slots,
+ * Node256 is an array of children. So a node is small when it has few children and a lookup does
+ * a few cache misses per key instead of one per differing bit as patricia_tree does.
+ *
+ * Path compression: a chain of nodes with one child is one node with the common prefix.
+ * Up to max_prefix_length bytes of the prefix are kept in the node, lookups skip the rest
+ * and compare the whole key with the leaf at the end.
+ * A key that ends at an inner node (a prefix of other keys) is kept by the node as its terminal leaf.
+ *
+ * The surface is the same as patricia_tree has, the iterators enumerate keys in lexicographic order (bytes are unsigned).
+ */
+template<typename KEY, typename Alloc = std::allocator<KEY>>
+class art_tree
+{
+    static_assert(sizeof(typename KEY::value_type) == 1 && std::is_integral_v<typename KEY::value_type>,
+                  "art_tree keys are strings of bytes");
+
+public:
+    typedef KEY         key_type;
+    typedef std::size_t size_type;
+
+    class const_iterator;
+
+    /**
+     * @brief art_tree creates an empty tree
+     */
+    art_tree() = default;
+
+    art_tree(const art_tree&) = delete;
+    art_tree& operator=(const art_tree&) = delete;
+
+    /**
+     * @brief ~art_tree clears the contents
+     */
+    ~art_tree() {
+        clear();
+    }
+
+    /**
+     * @brief clear clears the contents
+     */
+    void clear() noexcept;
+
+    bool empty() const noexcept {
+        return root_node == nullptr;
+    }
+
+    size_type size() const noexcept {
+        return item_count;
+    }
+
+    /**
+     * @brief contains check a tree contains a key
+     * @return returns true when a tree contains a key otherwise returns false
+     */
+    bool contains(const KEY& k) const;
+
+    /**
+     * @brief insert inserts a new key into the tree.
+     * Does nothing when a key is already present.
+     */
+    void insert(const KEY& k);
+
+    /**
+     * @brief erase removes a key from the tree
+     */
+    void erase(const KEY& k);
+
+    const_iterator begin() const;
+
+    const_iterator end() const {
+        return const_iterator();
+    }
+
+    /**
+     * @brief verify_test checks node sizes, byte order and the item count, for testing purposes only!
+     */
+    bool verify_test() const;
+
+private:
+    enum node_type : uint8_t {
+        LEAF,
+        NODE4,
+        NODE16,
+        NODE48,
+        NODE256,
+    };
+
+    /// the prefix bytes that inner nodes keep, lookups don't compare the longer part
+    static constexpr uint32_t max_prefix_length = 8;
+
+    struct node_base {
+        node_type type;
+
+        explicit node_base(node_type t) noexcept
+            : type(t)
+        {}
+    };
+
+    struct leaf : node_base {
+        KEY key;
+
+        explicit leaf(const KEY& k)
+            : node_base(LEAF)
+            , key(k)
+        {}
+    };
+
+    struct inner : node_base {
+        uint16_t count = 0;
+        uint32_t prefix_length = 0;
+        uint8_t  prefix[max_prefix_length] = {};
+        /// the key that ends after the prefix of this node
+        leaf*    terminal = nullptr;
+
+        using node_base::node_base;
+    };
+
+    struct node4 : inner {
+        static constexpr uint16_t capacity = 4;
+        uint8_t    keys[capacity] = {};
+        node_base* children[capacity] = {};
+
+        node4() noexcept
+            : inner(NODE4)
+        {}
+    };
+
+    struct node16 : inner {
+        static constexpr uint16_t capacity = 16;
+        uint8_t    keys[capacity] = {};
+        node_base* children[capacity] = {};
+
+        node16() noexcept
+            : inner(NODE16)
+        {}
+    };
+
+    struct node48 : inner {
+        static constexpr uint16_t capacity = 48;
+        static constexpr uint8_t  empty_index = capacity;
+        uint8_t    child_index[256];
+        node_base* children[capacity] = {};
+
+        node48() noexcept
+            : inner(NODE48)
+        {
+            std::memset(child_index, empty_index, sizeof(child_index));
+        }
+    };
+
+    struct node256 : inner {
+        node_base* children[256] = {};
+
+        node256() noexcept
+            : inner(NODE256)
+        {}
+    };
+
+    node_base* root_node = nullptr;
+    size_type  item_count = 0;
+    Alloc      allocator;
+
+    static const uint8_t* bytes(const KEY& k) noexcept {
+        return reinterpret_cast<const uint8_t*>(std::data(k));
+    }
+
+    template <typename N, typename... Args>
+    N* create(Args&&... args);
+
+    template <typename N>
+    void destroy(N* node) noexcept;
+
+    void destroy_node(node_base* node) noexcept;
+
+    /**
+     * @brief find_child
+     * @return the link to the child by the byte or nullptr
+     */
+    static node_base** find_child(const inner* node, uint8_t byte) noexcept;
+
+    /**
+     * @brief next_child finds the first child whose order position is not less than pos.
+     * The position is an index in the sorted bytes of Node4 and Node16 and the byte itself in Node48 and Node256.
+     * @param pos the position to start from, it is set after the found child
+     * @param byte receives the byte of the child
+     * @return the child or nullptr when there are no more children
+     */
+    static node_base* next_child(const inner* node, int& pos, uint8_t& byte) noexcept;
+
+    /// any leaf of the subtree, all of them share the prefix of the subtree root
+    static const leaf* any_leaf(const node_base* node) noexcept;
+
+    /**
+     * @brief prefix_mismatch
+     * @return number of the node prefix bytes that are equal to the key bytes from depth
+     */
+    static uint32_t prefix_mismatch(const inner* node, const KEY& k, size_type depth) noexcept;
+
+    /**
+     * @brief add_child links the child by the byte, the node grows to the next size when it is full
+     * @param link the link to the node, it is changed when the node grows
+     */
+    void add_child(node_base*& link, inner* node, uint8_t byte, node_base* child);
+
+    /**
+     * @brief remove_child unlinks the child by the byte, the node shrinks when it is small enough
+     * and it is replaced by its only entry
+     */
+    void remove_child(node_base*& link, inner* node, uint8_t byte) noexcept;
+
+    /// shrinks the node after its child or terminal leaf has been removed
+    void shrink(node_base*& link, inner* node) noexcept;
+
+    template <typename To, typename From>
+    To* move_to(node_base*& link, From* node) noexcept;
+
+    /// the copy of the node with the other size
+    template <typename To, typename From>
+    To* resize(node_base*& link, From* node);
+
+    void insert_leaf(leaf* new_leaf);
+
+    bool verify(const node_base* node, size_type& leaves) const;
+};
+
+/**
+ * @brief const_iterator visits keys in lexicographic order. It keeps the path from the root,
+ * so any change of the tree invalidates it.
+ */
+template<typename KEY, typename Alloc>
+class art_tree<KEY, Alloc>::const_iterator
+{
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = KEY;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const KEY*;
+    using reference         = const KEY&;
+
+    const_iterator() = default;
+
+    reference operator*() const noexcept {
+        return current->key;
+    }
+
+    pointer operator->() const noexcept {
+        return &current->key;
+    }
+
+    const_iterator& operator++() {
+        advance();
+        return *this;
+    }
+
+    const_iterator operator++(int) {
+        auto copy = *this;
+        advance();
+        return copy;
+    }
+
+    friend bool operator==(const const_iterator& a, const const_iterator& b) noexcept {
+        return a.current == b.current;
+    }
+
+private:
+    friend class art_tree;
+
+    struct frame {
+        const inner* node;
+        /// -1 before the terminal leaf otherwise next_child() position
+        int          pos;
+    };
+
+    std::vector<frame> path;
+    const leaf*        current = nullptr;
+
+    explicit const_iterator(const node_base* root) {
+        if (root == nullptr)
+            return;
+        if (root->type == LEAF) {
+            current = static_cast<const leaf*>(root);
+            return;
+        }
+        path.push_back({static_cast<const inner*>(root), -1});
+        advance();
+    }
+
+    void advance() {
+        current = nullptr;
+        while (!path.empty()) {
+            auto& top = path.back();
+            if (top.pos < 0) {
+                // the terminal key is a prefix of all keys below, so it goes first
+                top.pos = 0;
+                if (top.node->terminal != nullptr) {
+                    current = top.node->terminal;
+                    return;
+                }
+            }
+            uint8_t byte;
+            auto child = next_child(top.node, top.pos, byte);
+            if (child == nullptr) {
+                path.pop_back();
+            } else if (child->type == LEAF) {
+                current = static_cast<const leaf*>(child);
+                return;
+            } else {
+                path.push_back({static_cast<const inner*>(child), -1});
+            }
+        }
+    }
+};
+
+template<typename KEY, typename Alloc>
+typename art_tree<KEY, Alloc>::const_iterator art_tree<KEY, Alloc>::begin() const {
+    return const_iterator(root_node);
+}
+
+template<typename KEY, typename Alloc>
+template<typename N, typename... Args>
+N* art_tree<KEY, Alloc>::create(Args&&... args) {
+    typename std::allocator_traits<Alloc>::template rebind_alloc<N> node_allocator(allocator);
+    using traits = std::allocator_traits<decltype(node_allocator)>;
+    auto node = traits::allocate(node_allocator, 1);
+    try {
+        traits::construct(node_allocator, node, std::forward<Args>(args)...);
+    } catch (...) {
+        traits::deallocate(node_allocator, node, 1);
+        throw;
+    }
+    return node;
+}
+
+template<typename KEY, typename Alloc>
+template<typename N>
+void art_tree<KEY, Alloc>::destroy(N* node) noexcept {
+    typename std::allocator_traits<Alloc>::template rebind_alloc<N> node_allocator(allocator);
+    using traits = std::allocator_traits<decltype(node_allocator)>;
+    traits::destroy(node_allocator, node);
+    traits::deallocate(node_allocator, node, 1);
+}
+
+template<typename KEY, typename Alloc>
+void art_tree<KEY, Alloc>::destroy_node(node_base* node) noexcept {
+    switch (node->type) {
+    case LEAF:    destroy(static_cast<leaf*>(node)); break;
+    case NODE4:   destroy(static_cast<node4*>(node)); break;
+    case NODE16:  destroy(static_cast<node16*>(node)); break;
+    case NODE48:  destroy(static_cast<node48*>(node)); break;
+    case NODE256: destroy(static_cast<node256*>(node)); break;
+    }
+}
+
+template<typename KEY, typename Alloc>
+void art_tree<KEY, Alloc>::clear() noexcept {
+    if (root_node == nullptr)
+        return;
+    // the inner nodes are freed after their children
+    std::vector<node_base*> stack{root_node};
+    while (!stack.empty()) {
+        auto node = stack.back();
+        stack.pop_back();
+        if (node->type != LEAF) {
+            auto n = static_cast<inner*>(node);
+            if (n->terminal != nullptr)
+                destroy(n->terminal);
+            int pos = 0;
+            uint8_t byte;
+            for (auto child = next_child(n, pos, byte); child != nullptr; child = next_child(n, pos, byte)) {
+                stack.push_back(child);
+            }
+        }
+        destroy_node(node);
+    }
+    root_node = nullptr;
+    item_count = 0;
+}
+
+template<typename KEY, typename Alloc>
+typename art_tree<KEY, Alloc>::node_base** art_tree<KEY, Alloc>::find_child(const inner* node, uint8_t byte) noexcept {
+    auto n = const_cast<inner*>(node);
+    switch (n->type) {
+    case NODE4: {
+        auto n4 = static_cast<node4*>(n);
+        for (uint16_t i = 0; i < n4->count; ++i) {
+            if (n4->keys[i] == byte)
+                return &n4->children[i];
+        }
+        return nullptr;
+    }
+    case NODE16: {
+        auto n16 = static_cast<node16*>(n);
+#if defined(__SSE2__)
+        // all 16 bytes are compared at once, the bits after count are masked
+        auto equal = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(byte)),
+                                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(n16->keys)));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(equal)) & ((1u << n16->count) - 1);
+        return mask == 0 ? nullptr : &n16->children[std::countr_zero(mask)];
+#else
+        for (uint16_t i = 0; i < n16->count; ++i) {
+            if (n16->keys[i] == byte)
+                return &n16->children[i];
+        }
+        return nullptr;
+#endif
+    }
+    case NODE48: {
+        auto n48 = static_cast<node48*>(n);
+        auto index = n48->child_index[byte];
+        return index == node48::empty_index ? nullptr : &n48->children[index];
+    }
+    case NODE256: {
+        auto n256 = static_cast<node256*>(n);
+        return n256->children[byte] == nullptr ? nullptr : &n256->children[byte];
+    }
+    default:
+        return nullptr;
+    }
+}
+
+template<typename KEY, typename Alloc>
+typename art_tree<KEY, Alloc>::node_base* art_tree<KEY, Alloc>::next_child(const inner* node, int& pos, uint8_t& byte) noexcept {
+    switch (node->type) {
+    case NODE4: {
+        auto n4 = static_cast<const node4*>(node);
+        if (pos >= n4->count)
+            return nullptr;
+        byte = n4->keys[pos];
+        return n4->children[pos++];
+    }
+    case NODE16: {
+        auto n16 = static_cast<const node16*>(node);
+        if (pos >= n16->count)
+            return nullptr;
+        byte = n16->keys[pos];
+        return n16->children[pos++];
+    }
+    case NODE48: {
+        auto n48 = static_cast<const node48*>(node);
+        for (; pos < 256; ++pos) {
+            if (auto index = n48->child_index[pos]; index != node48::empty_index) {
+                byte = static_cast<uint8_t>(pos++);
+                return n48->children[index];
+            }
+        }
+        return nullptr;
+    }
+    case NODE256: {
+        auto n256 = static_cast<const node256*>(node);
+        for (; pos < 256; ++pos) {
+            if (auto child = n256->children[pos]; child != nullptr) {
+                byte = static_cast<uint8_t>(pos++);
+                return child;
+            }
+        }
+        return nullptr;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+template<typename KEY, typename Alloc>
+const typename art_tree<KEY, Alloc>::leaf* art_tree<KEY, Alloc>::any_leaf(const node_base* node) noexcept {
+    while (node->type != LEAF) {
+        auto n = static_cast<const inner*>(node);
+        if (n->terminal != nullptr)
+            return n->terminal;
+        int pos = 0;
+        uint8_t byte;
+        node = next_child(n, pos, byte);
+    }
+    return static_cast<const leaf*>(node);
+}
+
+template<typename KEY, typename Alloc>
+uint32_t art_tree<KEY, Alloc>::prefix_mismatch(const inner* node, const KEY& k, size_type depth) noexcept {
+    auto limit = static_cast<uint32_t>(std::min<size_type>(node->prefix_length, std::size(k) - depth));
+    auto key = bytes(k) + depth;
+    uint32_t i = 0;
+    for (auto stored = std::min(limit, max_prefix_length); i < stored; ++i) {
+        if (node->prefix[i] != key[i])
+            return i;
+    }
+    if (i < limit) {
+        // the rest of the prefix is compared with a key below the node
+        auto other = bytes(any_leaf(node)->key) + depth;
+        i += static_cast<uint32_t>(util::detail::mismatch_index(key + i, other + i, limit - i));
+    }
+    return i;
+}
+
+template<typename KEY, typename Alloc>
+bool art_tree<KEY, Alloc>::contains(const KEY& k) const {
+    auto key = bytes(k);
+    auto size = std::size(k);
+    size_type depth = 0;
+    for (auto node = root_node; node != nullptr;) {
+        if (node->type == LEAF)
+            return static_cast<const leaf*>(node)->key == k;
+
+        auto n = static_cast<const inner*>(node);
+        // optimistic: the prefix bytes that the node doesn't keep are checked by the final comparison
+        if (n->prefix_length > size - depth)
+            return false;
+        auto stored = std::min(n->prefix_length, max_prefix_length);
+        if (std::memcmp(n->prefix, key + depth, stored) != 0)
+            return false;
+        depth += n->prefix_length;
+
+        if (depth == size)
+            return n->terminal != nullptr && n->terminal->key == k;
+        auto link = find_child(n, key[depth]);
+        if (link == nullptr)
+            return false;
+        node = *link;
+        ++depth;
+    }
+    return false;
+}
+
+template<typename KEY, typename Alloc>
+void art_tree<KEY, Alloc>::insert(const KEY& k) {
+    if (contains(k))
+        return;
+    auto new_leaf = create<leaf>(k);
+    try {
+        insert_leaf(new_leaf);
+    } catch (...) {
+        destroy(new_leaf);
+        throw;
+    }
+    ++item_count;
+}
+
+template<typename KEY, typename Alloc>
+void art_tree<KEY, Alloc>::insert_leaf(leaf* new_leaf) {
+    // new nodes are created before the tree is changed, so a failed allocation leaves the tree as it was
+    const auto& k = new_leaf->key;
+    auto key = bytes(k);
+    auto size = std::size(k);
+    size_type depth = 0;
+    for (auto link = &root_node; true;) {
+        auto node = *link;
+        if (node == nullptr) {
+            *link = new_leaf;
+            return;
+        }
+
+        if (node->type == LEAF) {
+            // the leaf and the new key share the prefix of the new node and differ after it
+            auto old_leaf = static_cast<leaf*>(node);
+            auto other = bytes(old_leaf->key);
+            auto common = std::min(std::size(old_leaf->key), size) - depth;
+            auto prefix = static_cast<uint32_t>(util::detail::mismatch_index(key + depth, other + depth, common));
+            auto n = create<node4>();
+            n->prefix_length = prefix;
+            std::memcpy(n->prefix, key + depth, std::min(prefix, max_prefix_length));
+            depth += prefix;
+            for (auto l : {old_leaf, new_leaf}) {
+                if (std::size(l->key) == depth) {
+                    n->terminal = l;
+                } else {
+                    node_base* unused = n;
+                    add_child(unused, n, bytes(l->key)[depth], l);
+                }
+            }
+            *link = n;
+            return;
+        }
+
+        auto n = static_cast<inner*>(node);
+        auto matched = prefix_mismatch(n, k, depth);
+        if (matched < n->prefix_length) {
+            // the new node takes the common part of the prefix, the old node keeps the part after the differing byte
+            auto parent = create<node4>();
+            const uint8_t* prefix = n->prefix_length <= max_prefix_length ? n->prefix : bytes(any_leaf(n)->key) + depth;
+            parent->prefix_length = matched;
+            std::memcpy(parent->prefix, prefix, std::min(matched, max_prefix_length));
+            auto byte = prefix[matched];
+            auto rest = n->prefix_length - matched - 1;
+            std::memmove(n->prefix, prefix + matched + 1, std::min(rest, max_prefix_length));
+            n->prefix_length = rest;
+
+            node_base* unused = parent;
+            add_child(unused, parent, byte, n);
+            depth += matched;
+            if (depth == size) {
+                parent->terminal = new_leaf;
+            } else {
+                add_child(unused, parent, key[depth], new_leaf);
+            }
+            *link = parent;
+            return;
+        }
+
+        depth += n->prefix_length;
+        if (depth == size) {
+            n->terminal = new_leaf;
+            return;
+        }
+        auto child = find_child(n, key[depth]);
+        if (child == nullptr) {
+            add_child(*link, n, key[depth], new_leaf);
+            return;
+        }
+        link = child;
+        ++depth;
+    }
+}
+
+template<typename KEY, typename Alloc>
+void art_tree<KEY, Alloc>::erase(const KEY& k) {
+    auto key = bytes(k);
+    auto size = std::size(k);
+    size_type depth = 0;
+    node_base** parent_link = nullptr;
+    inner* parent = nullptr;
+    uint8_t byte = 0;
+    for (auto link = &root_node; *link != nullptr;) {
+        auto node = *link;
+        if (node->type == LEAF) {
+            auto l = static_cast<leaf*>(node);
+            if (l->key != k)
+                return;
+            if (parent == nullptr) {
+                root_node = nullptr;
+            } else {
+                remove_child(*parent_link, parent, byte);
+            }
+            destroy(l);
+            --item_count;
+            return;
+        }
+
+        auto n = static_cast<inner*>(node);
+        if (prefix_mismatch(n, k, depth) != n->prefix_length)
+            return;
+        depth += n->prefix_length;
+        if (depth == size) {
+            auto l = n->terminal;
+            if (l == nullptr || l->key != k)
+                return;
+            n->terminal = nullptr;
+            destroy(l);
+            --item_count;
+            shrink(*link, n);
+            return;
+        }
+        byte = key[depth];
+        auto child = find_child(n, byte);
+        if (child == nullptr)
+            return;
+        parent_link = link;
+        parent = n;
+        link = child;
+        ++depth;
+    }
+}
+
+template<typename KEY, typename Alloc>
+void art_tree<KEY, Alloc>::add_child(node_base*& link, inner* node, uint8_t byte, node_base* child) {
+    auto add_sorted = [byte, child](auto n) {
+        uint16_t i = n->count;
+        for (; i > 0 && n->keys[i - 1] > byte; --i) {
+            n->keys[i] = n->keys[i - 1];
+            n->children[i] = n->children[i - 1];
+        }
+        n->keys[i] = byte;
+        n->children[i] = child;
+        ++n->count;
+    };
+
+    switch (node->type) {
+    case NODE4: {
+        auto n4 = static_cast<node4*>(node);
+        if (n4->count < node4::capacity) {
+            add_sorted(n4);
+        } else {
+            add_sorted(resize<node16>(link, n4));
+        }
+        return;
+    }
+    case NODE16: {
+        auto n16 = static_cast<node16*>(node);
+        if (n16->count < node16::capacity) {
+            add_sorted(n16);
+        } else {
+            add_child(link, resize<node48>(link, n16), byte, child);
+        }
+        return;
+    }
+    case NODE48: {
+        auto n48 = static_cast<node48*>(node);
+        if (n48->count < node48::capacity) {
+            uint8_t slot = 0;
+            while (n48->children[slot] != nullptr) {
+                ++slot;
+            }
+            n48->children[slot] = child;
+            n48->child_index[byte] = slot;
+            ++n48->count;
+        } else {
+            add_child(link, resize<node256>(link, n48), byte, child);
+        }
+        return;
+    }
+    case NODE256: {
+        auto n256 = static_cast<node256*>(node);
+        n256->children[byte] = child;
+        ++n256->count;
+        return;
+    }
+    default:
+        return;
+    }
+}
+
+template<typename KEY, typename Alloc>
+void art_tree<KEY, Alloc>::remove_child(node_base*& link, inner* node, uint8_t byte) noexcept {
+    auto remove_sorted = [byte](auto n) {
+        uint16_t i = 0;
+        while (n->keys[i] != byte) {
+            ++i;
+        }
+        for (--n->count; i < n->count; ++i) {
+            n->keys[i] = n->keys[i + 1];
+            n->children[i] = n->children[i + 1];
+        }
+    };
+
+    switch (node->type) {
+    case NODE4:
+        remove_sorted(static_cast<node4*>(node));
+        break;
+    case NODE16:
+        remove_sorted(static_cast<node16*>(node));
+        break;
+    case NODE48: {
+        auto n48 = static_cast<node48*>(node);
+        n48->children[n48->child_index[byte]] = nullptr;
+        n48->child_index[byte] = node48::empty_index;
+        --n48->count;
+        break;
+    }
+    case NODE256:
+        static_cast<node256*>(node)->children[byte] = nullptr;
+        --node->count;
+        break;
+    default:
+        break;
+    }
+    shrink(link, node);
+}
+
+template<typename KEY, typename Alloc>
+void art_tree<KEY, Alloc>::shrink(node_base*& link, inner* node) noexcept {
+    auto entries = node->count + (node->terminal != nullptr ? 1 : 0);
+    if (entries == 1) {
+        // the node is replaced by its only entry
+        if (node->terminal != nullptr) {
+            link = node->terminal;
+        } else {
+            int pos = 0;
+            uint8_t byte;
+            auto child = next_child(node, pos, byte);
+            if (child->type != LEAF) {
+                // the path is compressed: the child prefix becomes the node prefix, the byte and the old child prefix
+                auto c = static_cast<inner*>(child);
+                uint8_t prefix[max_prefix_length];
+                auto length = std::min(node->prefix_length, max_prefix_length);
+                std::memcpy(prefix, node->prefix, length);
+                if (length < max_prefix_length)
+                    prefix[length++] = byte;
+                std::memcpy(prefix + length, c->prefix, std::min(c->prefix_length, max_prefix_length - length));
+                std::memcpy(c->prefix, prefix, max_prefix_length);
+                c->prefix_length += node->prefix_length + 1;
+            }
+            link = child;
+        }
+        destroy_node(node);
+        return;
+    }
+
+    // the thresholds are lower than the capacities of the smaller nodes, so erase and insert don't resize on every call
+    switch (node->type) {
+    case NODE16:
+        if (node->count == 3)
+            move_to<node4>(link, static_cast<node16*>(node));
+        break;
+    case NODE48:
+        if (node->count == 12)
+            move_to<node16>(link, static_cast<node48*>(node));
+        break;
+    case NODE256:
+        if (node->count == 37)
+            move_to<node48>(link, static_cast<node256*>(node));
+        break;
+    default:
+        break;
+    }
+}
+
+template<typename KEY, typename Alloc>
+template<typename To, typename From>
+To* art_tree<KEY, Alloc>::move_to(node_base*& link, From* node) noexcept {
+    // the smaller node can't be allocated without the risk of the exception, so the erase keeps the node
+    try {
+        return resize<To>(link, node);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+template<typename KEY, typename Alloc>
+template<typename To, typename From>
+To* art_tree<KEY, Alloc>::resize(node_base*& link, From* node) {
+    auto n = create<To>();
+    n->prefix_length = node->prefix_length;
+    std::memcpy(n->prefix, node->prefix, max_prefix_length);
+    n->terminal = node->terminal;
+
+    int pos = 0;
+    uint8_t byte;
+    for (auto child = next_child(node, pos, byte); child != nullptr; child = next_child(node, pos, byte)) {
+        if constexpr (std::is_same_v<To, node256>) {
+            n->children[byte] = child;
+        } else if constexpr (std::is_same_v<To, node48>) {
+            n->children[n->count] = child;
+            n->child_index[byte] = static_cast<uint8_t>(n->count);
+        } else {
+            // the children come in the byte order
+            n->keys[n->count] = byte;
+            n->children[n->count] = child;
+        }
+        ++n->count;
+    }
+    link = n;
+    destroy(node);
+    return n;
+}
+
+template<typename KEY, typename Alloc>
+bool art_tree<KEY, Alloc>::verify_test() const {
+    size_type leaves = 0;
+    return (root_node == nullptr || verify(root_node, leaves)) && leaves == item_count;
+}
+
+template<typename KEY, typename Alloc>
+bool art_tree<KEY, Alloc>::verify(const node_base* node, size_type& leaves) const {
+    if (node->type == LEAF) {
+        ++leaves;
+        return true;
+    }
+    auto n = static_cast<const inner*>(node);
+    if (n->terminal != nullptr)
+        ++leaves;
+    if (n->count + (n->terminal != nullptr ? 1 : 0) < 2)
+        return false;
+
+    int pos = 0;
+    uint8_t byte;
+    int previous = -1;
+    uint16_t count = 0;
+    for (auto child = next_child(n, pos, byte); child != nullptr; child = next_child(n, pos, byte)) {
+        if (byte <= previous || !verify(child, leaves))
+            return false;
+        previous = byte;
+        ++count;
+    }
+    uint16_t capacity = n->type == NODE4 ? 4 : n->type == NODE16 ? 16 : n->type == NODE48 ? 48 : 256;
+    return count == n->count && count <= capacity;
+}
@@ -1,40 +1,130 @@
 #pragma once
 
-#include <functional>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
-#include "bitutil.h"
+#include "util/bitutil.h"
 
 /**
-   TODO: 1)Find all strings with common prefix: Returns an array of strings which begin with the same prefix.
-   TODO: 2)Find predecessor: Locates the largest string less than a given string, by lexicographic order.
-   TODO: 3)Find successor: Locates the smallest string greater than a given string, by lexicographic order.
+   TODO: 1)Find predecessor: Locates the largest string less than a given string, by lexicographic order.
+   TODO: 2)Find successor: Locates the smallest string greater than a given string, by lexicographic order.
  */
-template<typename KEY, typename Alloc = std::allocator<KEY>>
+
+namespace patricia_keys {
+
+/// Every node keeps its own copy of the key
+struct by_value {};
+
+/**
+ * @brief The items of all keys are appended to one arena of the tree and nodes keep the offset and the length.
+ *
+ * It is for sequences with contiguous storage (std::string, std::vector<uint8_t> etc.): nodes are smaller,
+ * inserting a key doesn't allocate memory for it and the key items are close in memory.
+ * The keys are seen as std::basic_string_view for strings and as std::span for the other sequences.
+ * The items of erased keys stay in the arena until they are a half of it, then the arena is rebuilt,
+ * so the views are valid until the next insert or erase.
+ */
+struct interned {};
+
+namespace detail {
+
+template <typename KEY>
+struct key_view {
+    typedef std::span<const typename KEY::value_type> type;
+};
+
+template <typename Char, typename Traits, typename Alloc>
+struct key_view<std::basic_string<Char, Traits, Alloc>> {
+    typedef std::basic_string_view<Char, Traits> type;
+};
+
+template <typename KEY, typename Alloc>
+struct key_arena {
+    typedef typename KEY::value_type item_type;
+
+    std::vector<item_type, typename std::allocator_traits<Alloc>::template rebind_alloc<item_type>> items;
+    /// the number of items of erased keys
+    std::size_t dead = 0;
+};
+
+struct no_arena {};
+
+}
+
+}
+
+/**
+ * @brief patricia_tree is <a href="https://en.wikipedia.org/wiki/Radix_tree#PATRICIA">PATRICIA</a> trie of sequences
+ * of integers (std::string, std::vector<uint8_t> etc.).
+ *
+ * Every node keeps a key and the position of the bit that it tests (keys are seen through util::BitStreamAdaptor).
+ * Links to nodes with greater positions go down, the others go up to the node that keeps the key to compare with.
+ * A lookup tests one bit per node and compares whole keys once at the end, the keys are compared a word at a time.
+ * Any key can be stored, including the empty one and keys that are prefixes of each other.
+ *
+ * Fixed-width unsigned integers (uint32_t, uint64_t, util::uint128_t) are keys too, their bits are taken
+ * by shifts and masks. util::bit_prefix keys make routing and ACL tables:
+ * @code
+ * patricia_tree<util::bit_prefix<uint32_t>> routes;
+ * routes.insert({0x0A000000, 8});   // 10.0.0.0/8
+ * routes.insert({0x0A010000, 16});  // 10.1.0.0/16
+ * auto route = routes.longest_prefix_match({0x0A010203, 32}); // 10.1.0.0/16
+ * @endcode
+ *
+ * The KeyStorage policy tells where the keys are kept, see patricia_keys::by_value and patricia_keys::interned.
+ */
+template<typename KEY, typename Alloc = std::allocator<KEY>, typename KeyStorage = patricia_keys::by_value>
 class patricia_tree
 {
+    static constexpr bool is_interned = std::is_same_v<KeyStorage, patricia_keys::interned>;
+    static_assert(!is_interned || requires (const KEY& k) { std::data(k); },
+                  "interned keys must be sequences with contiguous storage");
+
 public:
     typedef KEY key_type;
+    /// const KEY& or, when the keys are interned, a view of the key items
+    typedef typename std::conditional_t<is_interned,
+                                        patricia_keys::detail::key_view<KEY>,
+                                        std::type_identity<const KEY&>>::type key_reference;
+    /// const KEY* or, when the keys are interned, std::optional of the view
+    typedef std::conditional_t<is_interned, std::optional<key_reference>, const KEY*> key_pointer;
 
+    class const_iterator;
 
 private:
+    /// where the key items of a node are in the arena, the offset and length are 32-bit to keep nodes small
+    struct interned_key
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    typedef std::conditional_t<is_interned, interned_key, KEY> stored_key;
+
     //Tree node definitions
     struct Node
     {
-        Node(const KEY& k)
-        {
-            left     = nullptr;
-            right    = nullptr;
-            position = 0;
-            key      = k;
-        }
-
-        Node   *left;
-        Node   *right;
-        size_t position;
-        KEY    key;
+        explicit Node(const stored_key& k)
+            : key(k)
+        {}
+
+        Node       *left     = nullptr;
+        Node       *right    = nullptr;
+        size_t     position  = 0;
+        stored_key key;
     };
 
     typedef Node                                    node_type;
@@ -47,6 +137,9 @@ public:
      */
     patricia_tree();
 
+    patricia_tree(const patricia_tree&) = delete;
+    patricia_tree& operator=(const patricia_tree&) = delete;
+
     /**
      * @brief ~patricia_tree clears the contents
      */
@@ -57,6 +150,14 @@ public:
      */
     void clear();
 
+    /**
+     * @brief empty
+     * @return true when the tree contains no keys
+     */
+    bool empty() const {
+        return root_node == nullptr;
+    }
+
     /**
      * @brief contains check a tree contains a key
      * @param key for checking
@@ -77,63 +178,149 @@ public:
      */
     void erase(const KEY& k);
 
+    /**
+     * @brief longest_prefix_match finds the most specific stored prefix of the key.
+     *
+     * Every stored prefix of the key is kept by a node on the search path of the key,
+     * so the nodes of one lookup are checked and no subtree is visited.
+     * @param k the key to match
+     * @return pointer to the longest stored key that is a prefix of k (or k itself) or nullptr,
+     * it is valid until the key is erased (until the next insert or erase when the keys are interned)
+     */
+    key_pointer longest_prefix_match(const KEY& k) const;
+
+    /**
+     * @brief for_each_with_prefix calls visitor for every stored key that starts with the prefix
+     * in lexicographic order.
+     *
+     * The search for the prefix stops at the subtree whose keys share all bits of the prefix,
+     * one key of it tells if all of them start with the prefix.
+     * @param prefix the beginning of the keys
+     * @param visitor functor that receives key_reference
+     */
+    template <typename F>
+    void for_each_with_prefix(const KEY& prefix, F visitor) const;
+
+    /**
+     * @brief begin
+     * @return iterator to the first key in lexicographic order
+     */
+    const_iterator begin() const {
+        return const_iterator(this, root_node);
+    }
+
+    /**
+     * @brief end
+     * @return iterator after the last key
+     */
+    const_iterator end() const {
+        return const_iterator();
+    }
+
     /**
      * @brief dump
      * @param os
      */
-    void dump(std::ostream& os);
-
-    //Prefix
-//    class prefix {
-//    public:
-//        prefix()=delete;
-//        const KEY& key()const
-//        {
-//            return prefix_key;
-//        }
-//        void add_key(const KEY& k);
-//        std::vector<KEY> keys(size_t = 0) const;
-
-//    private:
-//        patricia_tree   *tree;
-//        KEY             prefix_key;
-//        node_pointer    node;
-//        friend class patricia_tree;
-
-//        void
-
-//        prefix(patricia_tree *t, KEY k)
-//            :tree(t)
-//            ,prefix_key(k)
-//            , node(nullptr){}
-//    };
+    void dump(std::ostream& os) const;
+
+    /**
+     * @brief verify_test checks that every key is found by its bits and positions grow down the tree,
+     * for testing purposes only!
+     */
+    bool verify_test() const;
 
 private:
-    typedef typename Alloc::template rebind< node_type >::other Node_alloc_type;
-    typedef utils::BitStreamAdaptor<KEY> BitStream;
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<node_type> Node_alloc_type;
+    typedef std::allocator_traits<Node_alloc_type>                                   Node_alloc_traits;
+    typedef util::BitStreamAdaptor<std::remove_cvref_t<key_reference>> BitStream;
+    typedef std::conditional_t<is_interned, patricia_keys::detail::key_arena<KEY, Alloc>, patricia_keys::detail::no_arena> Arena;
+    /// the stack of traverse, the second member is the number of the links of the node that are taken
+    typedef std::vector<std::pair<node_pointer, int>> Path;
 
     Node_alloc_type node_allocator;
+    /**
+     * The root tests bit 0 that is 1 for all keys, so its left link is always nullptr
+     * and all other nodes are below its right link.
+     */
     node_pointer    root_node;
+    [[no_unique_address]] Arena arena;
+    /**
+     * The stack of traverse for clear() and compact_arena() that must not fail.
+     * Positions grow down the tree, so insert reserves the largest position + 1 items.
+     */
+    Path            down_path;
+
+    key_reference key_of(const node_pointer node) const {
+        if constexpr (is_interned) {
+            return key_reference(arena.items.data() + node->key.offset, node->key.length);
+        } else {
+            return node->key;
+        }
+    }
+
+    /// The key as the keys of nodes are seen, it doesn't copy the key
+    static key_reference view(const KEY& k) {
+        if constexpr (is_interned) {
+            return key_reference(std::data(k), std::size(k));
+        } else {
+            return k;
+        }
+    }
+
+    static bool equal(key_reference a, key_reference b) {
+        if constexpr (is_interned) {
+            return std::ranges::equal(a, b);
+        } else {
+            return a == b;
+        }
+    }
+
+    static bool is_down(const node_pointer node, const node_pointer next) {
+        return next != nullptr && next->position > node->position;
+    }
+
+    /// The visitor that stops where the key has to be compared, it is a closure so look_up inlines it
+    static constexpr auto is_up = [](const node_pointer node, const node_pointer next) {
+        return !is_down(node, next);
+    };
+
+    static node_pointer& link(node_pointer node, const BitStream& key) {
+        return key.bit(node->position) ? node->right : node->left;
+    }
 
     /**
      * @brief look_up
      * @param start_node
      * @param k
-     * @param visitor is a functor that receives const node_pointer argument.
+     * @param visitor is a functor that receives the node and its next node by the key.
      *  when visitor returns true lookUp interupts node searchig and returns a current node.
      * @return
      */
-    node_pointer_pair look_up(node_pointer start_node, const KEY& k,
-                              std::function<bool(const node_pointer, const node_pointer)> visitor);
+    template <typename Visitor>
+    node_pointer_pair look_up(node_pointer start_node, key_reference k, Visitor visitor) const;
 
     /**
-     * @brief recursive_traverse calls visitor functor for every node in the subtree.
-     * The order of traverse is down-to-up and left-to-right.
+     * @brief traverse calls visitor functor for every node in the subtree.
+     * The order of traverse is down-to-up and left-to-right, so the visitor may destroy the node.
+     * The path is kept on an explicit stack instead of the call stack.
      * @note Caller must grant start_node isn't nullptr
      * @param start_node is a root of subtree
      * @param visitor is functor that receives a node pointer.
+     * @param path is the stack, it doesn't allocate when it has the capacity of down_path
      */
-    void recursive_traverse(node_pointer start_node, std::function<void(node_pointer)> visitor);
+    template <typename Visitor>
+    void traverse(node_pointer start_node, Visitor visitor, Path& path) const;
+
+    template <typename Visitor>
+    void traverse(node_pointer start_node, Visitor visitor) const {
+        Path path;
+        traverse(start_node, visitor, path);
+    }
+
+    /// reserve_path makes down_path long enough for the node at position
+    void reserve_path(size_t position) {
+        if(down_path.capacity() <= position) down_path.reserve(std::max(position + 1, 2 * down_path.capacity()));
+    }
 
     /**
      * @brief remove_leaf the tree contains outer and inner nodes.
@@ -144,103 +331,163 @@ private:
      * @param node node pointer that should be remove
      */
     void remove_leaf(node_pointer parent, node_pointer node);
+
+    node_pointer create_node(key_reference k, size_t position);
+    void destroy_node(node_pointer node);
+
+    /**
+     * @brief compact_arena copies the keys of the nodes into a new arena without the items of erased keys.
+     * The arena and the nodes stay as they are when the memory can't be allocated.
+     */
+    void compact_arena() noexcept;
+
+    void write_key(std::ostream& os, const node_pointer node) const;
+};
+
+/**
+ * @brief const_iterator visits the keys in lexicographic order.
+ *
+ * Every key is referred by one up link and the links are taken from left to right,
+ * the path of down links is kept in the iterator. Inserting or erasing keys invalidates iterators.
+ * When the keys are interned the iterator gives views of the keys by value.
+ */
+template<typename KEY, typename Alloc, typename KeyStorage>
+class patricia_tree<KEY, Alloc, KeyStorage>::const_iterator
+{
+public:
+    typedef std::forward_iterator_tag            iterator_category;
+    typedef std::remove_cvref_t<key_reference>   value_type;
+    typedef std::ptrdiff_t                       difference_type;
+    typedef const value_type*                    pointer;
+    typedef key_reference                        reference;
+
+    const_iterator() = default;
+
+    reference operator*() const {
+        return tree->key_of(current);
+    }
+
+    pointer operator->() const requires (!is_interned) {
+        return &current->key;
+    }
+
+    const_iterator& operator++() {
+        advance();
+        return *this;
+    }
+
+    const_iterator operator++(int) {
+        auto result = *this;
+        advance();
+        return result;
+    }
+
+    friend bool operator==(const const_iterator& a, const const_iterator& b) {
+        return a.current == b.current;
+    }
+
+private:
+    friend class patricia_tree;
+
+    /// iterator to the first key of the subtree
+    const_iterator(const patricia_tree* owner, node_pointer start_node)
+        : tree(owner) {
+        if(start_node == nullptr) return;
+        path.emplace_back(start_node, 0);
+        advance();
+    }
+
+    void advance() {
+        current = nullptr;
+        while(!path.empty()) {
+            auto& [node, links] = path.back();
+            if(links == 2) {
+                path.pop_back();
+                continue;
+            }
+            auto next = links++ == 0 ? node->left : node->right;
+            if(is_down(node, next)) {
+                path.emplace_back(next, 0);
+            } else if(next != nullptr) {
+                current = next;
+                return;
+            }
+        }
+    }
+
+    /// the down links to the current key, the second member is the number of the links of the node that are taken
+    std::vector<std::pair<node_pointer, int>> path;
+    const patricia_tree* tree = nullptr;
+    node_pointer current = nullptr;
 };
 
-template<typename KEY, typename Alloc>
-patricia_tree<KEY, Alloc>::patricia_tree() {
+template<typename KEY, typename Alloc, typename KeyStorage>
+patricia_tree<KEY, Alloc, KeyStorage>::patricia_tree() {
     root_node = nullptr;
 }
 
-template<typename KEY, typename Alloc>
-patricia_tree<KEY, Alloc>::~patricia_tree() {
+template<typename KEY, typename Alloc, typename KeyStorage>
+patricia_tree<KEY, Alloc, KeyStorage>::~patricia_tree() {
     clear();
 }
 
-template<typename KEY, typename Alloc>
-void patricia_tree<KEY, Alloc>::clear() {
+template<typename KEY, typename Alloc, typename KeyStorage>
+void patricia_tree<KEY, Alloc, KeyStorage>::clear() {
     if(root_node == nullptr) return;
 
-    recursive_traverse(root_node, [this](node_pointer node)
+    //down_path has the capacity, so destroying of the tree doesn't allocate
+    traverse(root_node, [this](node_pointer node)
     {
-        node_allocator.destroy(node);
-        node_allocator.deallocate(node, 1);
-    });
+        destroy_node(node);
+    }, down_path);
+    root_node = nullptr;
+    if constexpr (is_interned) {
+        arena.items.clear();
+        arena.dead = 0;
+    }
 }
 
-template<typename KEY, typename Alloc>
-bool patricia_tree<KEY, Alloc>::contains(const KEY& k) const {
-    auto pair = look_up(root_node, k, [](node_pointer node, node_pointer next){
-        return next == nullptr || next->position <= node->position;
-    });
-   return pair.second != nullptr && pair.second->key == k;
+template<typename KEY, typename Alloc, typename KeyStorage>
+bool patricia_tree<KEY, Alloc, KeyStorage>::contains(const KEY& k) const {
+    key_reference kv = view(k);
+    auto pair = look_up(root_node, kv, is_up);
+    return pair.second != nullptr && equal(key_of(pair.second), kv);
 }
 
-template<typename KEY, typename Alloc>
-void patricia_tree<KEY, Alloc>::insert(const KEY& k) {
-    auto pair = look_up(root_node, k, [](node_pointer node, node_pointer next){
-            return next == nullptr || next->position <= node->position;
-        });
-    auto match_node = pair.second == nullptr ? pair.first : pair.second;
-
-    //If the key is already present do nothing
-    if( match_node != nullptr && match_node->key == k ) return;
+template<typename KEY, typename Alloc, typename KeyStorage>
+void patricia_tree<KEY, Alloc, KeyStorage>::insert(const KEY& k) {
+    key_reference kv = view(k);
+    if(root_node == nullptr) {
+        //All keys have bit 0 set, so the first node links itself by the right link
+        reserve_path(0);
+        root_node = create_node(kv, 0);
+        root_node->right = root_node;
+        return;
+    }
 
-    //create a new node
-    auto new_node = node_allocator.allocate(1, 0);
-    node_allocator.construct(new_node, k);
+    auto match_node = look_up(root_node, kv, is_up).second;
 
-    BitStream key(k);
+    //Keys differ from the closest one at the same bit as from the others that share the path
+    BitStream key(kv);
+    auto new_pos = key.mismatch(key_of(match_node));
 
-    //Define bit-position in the new node
-    if(match_node != nullptr){
-        auto new_pos = key.mismatch(match_node->key);
-        new_node->position = new_pos;
-        if(new_pos == -1){
-            //keys are prefix for each to other
-            if(new_node->key.size() < match_node->key.size()) {
-                //FIXME: OOps! the trie already contains longest key
-                //Need to delete long key insert short key and insert long again
-                //Sample: trie contains AAA and try to insert AA
-                return;
-            }
-            new_node->position = match_node->key.size();
-        }
-        if(static_cast<unsigned>(new_pos) == match_node->position){
-            new_node->position = match_node->position+1;
-        }
-    }else{
-        //New node hasn't prefix in the trie
-        new_node->position = 0;
-        if(key.bit(new_node->position)) {
-            new_node->right = new_node;
-            new_node->left  = root_node;
-        } else {
-            new_node->left  = new_node;
-            new_node->right = root_node;
-        }
-        root_node = new_node;
-        return;
-    }
+    //If the key is already present do nothing
+    if(new_pos == BitStream::npos) return;
 
-    auto parent_node = look_up(root_node, k, [&new_node](const node_pointer node, const node_pointer next)
+    //The new node goes below the last node that tests a lower bit
+    auto parent_node = look_up(root_node, kv, [new_pos](const node_pointer node, const node_pointer next)
     {
-        return next == nullptr || next->position <= node->position
-                || (new_node->position >= node->position && new_node->position < next->position);
+        return is_up(node, next) || next->position > new_pos;
     }).first;
 
-
-    //Connect to the parent
-    node_pointer next_node;
-    if(key.bit(parent_node->position)) {
-        next_node = parent_node->right;
-        parent_node->right = new_node;
-    } else {
-        next_node = parent_node->left;
-        parent_node->left = new_node;
-    }
+    reserve_path(new_pos);
+    auto new_node = create_node(kv, new_pos);
+    auto& parent_link = link(parent_node, key);
+    auto next_node = parent_link;
+    parent_link = new_node;
 
     //Connect a next node to the new
-    if(key.bit(new_node->position)) {
+    if(key.bit(new_pos)) {
         new_node->right = new_node;
         new_node->left  = next_node;
     } else {
@@ -249,90 +496,166 @@ void patricia_tree<KEY, Alloc>::insert(const KEY& k) {
     }
 }
 
-template<typename KEY, typename Alloc>
-void patricia_tree<KEY, Alloc>::erase(const KEY& k) {
-    auto pair = look_up(root_node, k, [](node_pointer node, node_pointer next){
-            return next == nullptr || next->position <= node->position;
-        });
+template<typename KEY, typename Alloc, typename KeyStorage>
+void patricia_tree<KEY, Alloc, KeyStorage>::erase(const KEY& k) {
+    if(root_node == nullptr) return;
+
+    key_reference kv = view(k);
+    auto pair = look_up(root_node, kv, is_up);
     auto parent_node = pair.first;
     auto match_node = pair.second;
 
     //If the key isn't present do nothing
-    if(match_node == nullptr || match_node->key != k ) return;
+    if(match_node == nullptr || !equal(key_of(match_node), kv)) return;
 
-    BitStream key(k);
-    auto link = key.bit(match_node->position)? match_node->right : match_node->left;
-    if(link != match_node){
-        //match_node isn't external leaf. So we need to swap the node with the external leaf parent
-        auto grand_node = look_up(root_node, k, [match_node](node_pointer node, node_pointer next){
-                return next == nullptr || next->position <= node->position
-                       || next == match_node;
+    BitStream key(kv);
+    if(parent_node == match_node) {
+        //match_node links itself, so it is removed with the other link
+        auto grand_node = look_up(root_node, kv, [match_node](node_pointer node, node_pointer next){
+                return is_up(node, next) || next == match_node;
             }).first;
-
-        if(key.bit(grand_node->position)) {
-            grand_node->right = parent_node;
+        if(grand_node == match_node) {
+            //only the root can link itself from the root, so it is the last node
+            destroy_node(match_node);
+            root_node = nullptr;
         } else {
-            grand_node->left = parent_node;
+            remove_leaf(grand_node, match_node);
         }
+    } else {
+        //parent_node links up to match_node: parent_node takes the place of match_node
+        //and the other link of parent_node takes the place of parent_node
+        auto parent_parent = look_up(root_node, kv, [parent_node](node_pointer node, node_pointer next){
+                return is_up(node, next) || next == parent_node;
+            }).first;
+        link(parent_parent, key) = key.bit(parent_node->position) ? parent_node->left : parent_node->right;
 
-        std::swap(parent_node->position, match_node->position);
-
-        auto next = parent_node->right == match_node? parent_node->left : parent_node->right;
-        if(key.bit(parent_node->position)) {
-            parent_node->right = match_node;
-            parent_node->left  = match_node->left;
+        parent_node->position = match_node->position;
+        parent_node->left     = match_node->left;
+        parent_node->right    = match_node->right;
+        if(match_node == root_node) {
+            root_node = parent_node;
         } else {
-            parent_node->left  = match_node;
-            parent_node->right = match_node->right;
+            auto grand_node = look_up(root_node, kv, [match_node](node_pointer node, node_pointer next){
+                    return is_up(node, next) || next == match_node;
+                }).first;
+            link(grand_node, key) = parent_node;
         }
+        destroy_node(match_node);
+    }
 
-        if(key.bit(match_node->position)) {
-            match_node->right = match_node;
-            match_node->left  = next;
-        } else {
-            match_node->right = next;
-            match_node->left  = match_node;
+    if constexpr (is_interned) {
+        //the arena is rebuilt when most of it is garbage, so every erased item is copied O(1) times
+        if(arena.dead * 2 > arena.items.size()) compact_arena();
+    }
+}
+
+template<typename KEY, typename Alloc, typename KeyStorage>
+typename patricia_tree<KEY, Alloc, KeyStorage>::key_pointer
+patricia_tree<KEY, Alloc, KeyStorage>::longest_prefix_match(const KEY& k) const {
+    if(root_node == nullptr) return key_pointer();
+
+    key_reference kv = view(k);
+    BitStream key(kv);
+    node_pointer best = nullptr;
+    auto check = [this, &key, &best](node_pointer node) {
+        //all prefixes of the key are prefixes of each other, the longer one has the longer stream
+        if(key.starts_with(key_of(node))
+           && (best == nullptr || BitStream(key_of(node)).size() > BitStream(key_of(best)).size())) {
+            best = node;
         }
+    };
+    auto last = look_up(root_node, kv, [&check](node_pointer node, node_pointer next){
+        check(node);
+        return is_up(node, next);
+    }).second;
+    if(last != nullptr) check(last);
+
+    if(best == nullptr) return key_pointer();
+    if constexpr (is_interned) {
+        return key_of(best);
+    } else {
+        return &best->key;
+    }
+}
+
+template<typename KEY, typename Alloc, typename KeyStorage>
+template<typename F>
+void patricia_tree<KEY, Alloc, KeyStorage>::for_each_with_prefix(const KEY& prefix, F visitor) const {
+    if(root_node == nullptr) return;
+
+    //the bits of the prefix are before the end of its stream
+    key_reference kv = view(prefix);
+    auto end = BitStream(kv).size();
+    auto [node, next] = look_up(root_node, kv, [end](node_pointer node, node_pointer next){
+        return is_up(node, next) || next->position >= end;
+    });
+
+    if(is_up(node, next)) {
+        //it is the up link to the only key that can start with the prefix
+        if(next != nullptr && BitStream(key_of(next)).starts_with(kv)) visitor(key_of(next));
+        return;
     }
 
-    remove_leaf(parent_node, match_node);
+    //the keys below differ after the prefix, so the first of them tells about all
+    const_iterator it(this, next);
+    if(!BitStream(*it).starts_with(kv)) return;
+    for(; it != const_iterator(); ++it) visitor(*it);
 }
 
-template<typename KEY, typename Alloc>
-void patricia_tree<KEY, Alloc>::dump(std::ostream& os) {
+template<typename KEY, typename Alloc, typename KeyStorage>
+void patricia_tree<KEY, Alloc, KeyStorage>::dump(std::ostream& os) const {
     os << "digraph G { " << std::endl;
     if(root_node != nullptr)
-        recursive_traverse(root_node, [&os](node_pointer node)
+        traverse(root_node, [this, &os](node_pointer node)
             {
-            if(node->left != nullptr){
-                os << "\"key=" << node->key << ", pos=" << node->position << "\" -> ";
-                os << "\"key=" << node->left->key << ", pos=" << node->left->position << "\";" << std::endl;
-            }
-            if(node->right != nullptr){
-                os << "\"key=" << node->key << ", pos=" << node->position << "\" -> ";
-                os << "\"key=" << node->right->key << ", pos=" << node->right->position << "\";" << std::endl;
+            for(auto next : {node->left, node->right}) {
+                if(next == nullptr) continue;
+                write_key(os, node);
+                os << " -> ";
+                write_key(os, next);
+                os << ";" << std::endl;
             }
             if(node->right == nullptr && node->left == nullptr){
-                os << "\"key=" << node->key << ", pos=" << node->position << "\";" << std::endl;
+                write_key(os, node);
+                os << ";" << std::endl;
             }
             });
 
     os << "}" << std::endl;
 }
 
+template<typename KEY, typename Alloc, typename KeyStorage>
+bool patricia_tree<KEY, Alloc, KeyStorage>::verify_test() const {
+    if(root_node == nullptr) return true;
+    if(root_node->position != 0 || root_node->left != nullptr) return false;
+
+    bool valid = true;
+    size_t nodes = 0;
+    size_t up_links = 0;
+    traverse(root_node, [&](node_pointer node)
+    {
+        ++nodes;
+        for(auto next : {node->left, node->right}) {
+            if(next != nullptr && !is_down(node, next)) ++up_links;
+        }
+        if(look_up(root_node, key_of(node), is_up).second != node) valid = false;
+    });
+    //every key is referred by one up link
+    return valid && up_links == nodes;
+}
+
 //Private methods
-template<typename KEY, typename Alloc>
-typename patricia_tree<KEY, Alloc>::node_pointer_pair
-patricia_tree<KEY, Alloc>::look_up(node_pointer start_node,
-                                  const KEY& k,
-                                  std::function<bool(const node_pointer, const node_pointer)> visitor) {
+template<typename KEY, typename Alloc, typename KeyStorage>
+template<typename Visitor>
+typename patricia_tree<KEY, Alloc, KeyStorage>::node_pointer_pair
+patricia_tree<KEY, Alloc, KeyStorage>::look_up(node_pointer start_node, key_reference k, Visitor visitor) const {
     if(start_node == nullptr) return node_pointer_pair(nullptr, nullptr);
 
     BitStream key(k);
     node_pointer node = start_node;
     node_pointer next = nullptr;
 
-    while(node->position < key.size())
+    while(true)
     {
         next = key.bit(node->position)? node->right : node->left;
         if(visitor(node, next)) break;
@@ -342,31 +665,100 @@ patricia_tree<KEY, Alloc>::look_up(node_pointer start_node,
     return node_pointer_pair(node, next);
 }
 
-template<typename KEY, typename Alloc>
-void patricia_tree<KEY, Alloc>::recursive_traverse(node_pointer start_node, std::function<void(node_pointer)> visitor) {
-    if(start_node->left != nullptr
-            && start_node->left->position > start_node->position)
-        recursive_traverse(start_node->left, visitor);
+template<typename KEY, typename Alloc, typename KeyStorage>
+template<typename Visitor>
+void patricia_tree<KEY, Alloc, KeyStorage>::traverse(node_pointer start_node, Visitor visitor, Path& path) const {
+    path.clear();
+    path.emplace_back(start_node, 0);
+    while(!path.empty()) {
+        auto& [node, links] = path.back();
+        if(links == 2) {
+            //up links refer to the node or to the nodes above, so they aren't visited yet
+            auto done = node;
+            path.pop_back();
+            visitor(done);
+            continue;
+        }
+        auto next = links++ == 0 ? node->left : node->right;
+        if(is_down(node, next)) path.emplace_back(next, 0);
+    }
+}
 
-    if(start_node->right != nullptr
-            && start_node->right->position > start_node->position)
-        recursive_traverse(start_node->right, visitor);
+template<typename KEY, typename Alloc, typename KeyStorage>
+void patricia_tree<KEY, Alloc, KeyStorage>::remove_leaf(node_pointer parent, node_pointer node) {
+    key_reference node_key = key_of(node);
+    BitStream key(node_key);
+    auto next_link = key.bit(node->position)? node->left : node->right;
+    link(parent, key) = next_link;
 
-    visitor(start_node);
+    //remove unlinked node
+    destroy_node(node);
 }
 
-template<typename KEY, typename Alloc>
-void patricia_tree<KEY, Alloc>::remove_leaf(node_pointer parent, node_pointer node) {
-    BitStream key(node->key);
-    auto next_link = key.bit(node->position)? node->left : node->right;
-    if(key.bit(parent->position)) {
-        parent->right = next_link;
-    } else {
-        parent->left  = next_link;
+template<typename KEY, typename Alloc, typename KeyStorage>
+typename patricia_tree<KEY, Alloc, KeyStorage>::node_pointer
+patricia_tree<KEY, Alloc, KeyStorage>::create_node(key_reference k, size_t position) {
+    auto node = Node_alloc_traits::allocate(node_allocator, 1);
+    try {
+        if constexpr (is_interned) {
+            auto offset = arena.items.size();
+            if(std::size(k) > std::numeric_limits<uint32_t>::max() - offset)
+                throw std::length_error("patricia_tree: the key arena is full");
+            arena.items.insert(arena.items.end(), std::begin(k), std::end(k));
+            Node_alloc_traits::construct(node_allocator, node,
+                                         interned_key{static_cast<uint32_t>(offset), static_cast<uint32_t>(std::size(k))});
+        } else {
+            Node_alloc_traits::construct(node_allocator, node, k);
+        }
+    } catch (...) {
+        Node_alloc_traits::deallocate(node_allocator, node, 1);
+        throw;
     }
+    node->position = position;
+    return node;
+}
 
-    //remove unlinked node
-    node_allocator.destroy(node);
-    node_allocator.deallocate(node, 1);
+template<typename KEY, typename Alloc, typename KeyStorage>
+void patricia_tree<KEY, Alloc, KeyStorage>::destroy_node(node_pointer node) {
+    if constexpr (is_interned) arena.dead += node->key.length;
+    Node_alloc_traits::destroy(node_allocator, node);
+    Node_alloc_traits::deallocate(node_allocator, node, 1);
 }
 
+template<typename KEY, typename Alloc, typename KeyStorage>
+void patricia_tree<KEY, Alloc, KeyStorage>::compact_arena() noexcept {
+    //the keys are copied into the new arena first, the nodes are changed only when it has been built
+    decltype(arena.items) items(arena.items.get_allocator());
+    try {
+        items.reserve(arena.items.size() - arena.dead);
+        if(root_node != nullptr) {
+            traverse(root_node, [this, &items](node_pointer node) {
+                auto first = arena.items.begin() + node->key.offset;
+                items.insert(items.end(), first, first + node->key.length);
+            }, down_path);
+        }
+    } catch (...) {
+        return;
+    }
+    //the same order as above, down_path has the capacity, so nothing can fail here
+    if(root_node != nullptr) {
+        uint32_t offset = 0;
+        traverse(root_node, [&offset](node_pointer node) {
+            node->key.offset = offset;
+            offset += node->key.length;
+        }, down_path);
+    }
+    arena.items.swap(items);
+    arena.dead = 0;
+}
+
+template<typename KEY, typename Alloc, typename KeyStorage>
+void patricia_tree<KEY, Alloc, KeyStorage>::write_key(std::ostream& os, const node_pointer node) const {
+    os << "\"key=";
+    if constexpr (requires { os << key_of(node); }) {
+        os << key_of(node);
+    } else {
+        os << BitStream(key_of(node));
+    }
+    os << ", pos=" << node->position << "\"";
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+/**
+ * @brief arena_allocator hands out objects from big contiguous blocks.
+ *
+ * The allocator is intended to be owned by a single container (as example binary_tree::tree)
+ * so it is movable but not copyable.
+ *  - allocate takes a freed object from the free list or bumps a pointer inside the current block.
+ *    A new block is requested from the system only when the current one is exhausted.
+ *    Block capacity grows twice at every new block until it reaches MaxBlockSize elements.
+ *  - deallocate puts an object into the intrusive free list, the memory goes back to the system only in release().
+ *  - reset makes all the allocated objects free at once. Blocks are kept to serve the next allocations.
+ *    Objects are not destroyed by reset, so the owner must destroy them before (or they must be trivially destructible).
+ * @tparam T type of the allocated objects
+ * @tparam MaxBlockSize maximal number of objects in the one block
+ */
+template <typename T, std::size_t MaxBlockSize = 64 * 1024>
+class arena_allocator {
+public:
+    using value_type      = T;
+    using size_type       = std::size_t;
+    using difference_type = std::ptrdiff_t;
+
+    template <typename U>
+    struct rebind {
+        using other = arena_allocator<U, MaxBlockSize>;
+    };
+
+    static constexpr size_type min_block_size = 64;
+    static_assert(MaxBlockSize >= min_block_size, "MaxBlockSize is too small");
+
+    arena_allocator() noexcept {}
+
+    arena_allocator(const arena_allocator&) = delete;
+    arena_allocator& operator=(const arena_allocator&) = delete;
+
+    arena_allocator(arena_allocator&& other) noexcept {
+        swap(other);
+    }
+
+    arena_allocator& operator=(arena_allocator&& other) noexcept {
+        if (this != &other) {
+            release();
+            swap(other);
+        }
+        return *this;
+    }
+
+    ~arena_allocator() {
+        release();
+    }
+
+    [[nodiscard]] T* allocate(size_type n) {
+        if (n == 1 && free_list != nullptr) [[likely]] {
+            auto p = free_list;
+            free_list = free_list->next;
+            return reinterpret_cast<T*>(p);
+        }
+        if (static_cast<size_type>(block_end - cursor) < n) [[unlikely]] {
+            next_block(n);
+        }
+        auto p = cursor;
+        cursor += n;
+        return p;
+    }
+
+    void deallocate(T* p, size_type n) noexcept {
+        for (size_type i = 0; i < n; ++i) {
+            auto item = reinterpret_cast<free_item*>(p + i);
+            item->next = free_list;
+            free_list = item;
+        }
+    }
+
+    /**
+     * @brief reset makes the whole arena free in O(number of blocks).
+     * @note the objects are not destroyed.
+     */
+    void reset() noexcept {
+        free_list = nullptr;
+        current   = 0;
+        if (blocks.empty()) {
+            cursor = block_end = nullptr;
+        } else {
+            cursor    = blocks.front().data;
+            block_end = cursor + blocks.front().size;
+        }
+    }
+
+    /**
+     * @brief release returns all the blocks to the system.
+     * @note the objects are not destroyed.
+     */
+    void release() noexcept {
+        for (auto& b : blocks) {
+            ::operator delete(b.data, std::align_val_t(alignof(T)));
+        }
+        blocks.clear();
+        reset();
+    }
+
+    /**
+     * @brief capacity
+     * @return number of objects that can be stored in the already requested blocks
+     */
+    [[nodiscard]] size_type capacity() const noexcept {
+        size_type result = 0;
+        for (const auto& b : blocks) {
+            result += b.size;
+        }
+        return result;
+    }
+
+    void swap(arena_allocator& other) noexcept {
+        std::swap(blocks, other.blocks);
+        std::swap(current, other.current);
+        std::swap(cursor, other.cursor);
+        std::swap(block_end, other.block_end);
+        std::swap(free_list, other.free_list);
+    }
+
+private:
+    struct free_item {
+        free_item* next;
+    };
+    static_assert(sizeof(T) >= sizeof(free_item), "T is too small to be linked into the free list");
+
+    struct block {
+        T*        data;
+        size_type size;
+    };
+
+    std::vector<block> blocks;
+    size_type          current   = 0;
+    T*                 cursor    = nullptr;
+    T*                 block_end = nullptr;
+    free_item*         free_list = nullptr;
+
+    void next_block(size_type n) {
+        // reuse blocks that have been kept after reset()
+        while (current + 1 < blocks.size()) {
+            auto& b = blocks[++current];
+            if (b.size >= n) {
+                cursor    = b.data;
+                block_end = b.data + b.size;
+                return;
+            }
+        }
+        auto size = blocks.empty() ? min_block_size : std::min(blocks.back().size * 2, MaxBlockSize);
+        size = std::max(size, n);
+        auto data = static_cast<T*>(::operator new(size * sizeof(T), std::align_val_t(alignof(T))));
+        blocks.push_back(block{data, size});
+        current   = blocks.size() - 1;
+        cursor    = data;
+        block_end = data + size;
+    }
+};
+
+}
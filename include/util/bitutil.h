@@ -1,13 +1,130 @@
 #pragma once
 
 #include <algorithm>
-#include <iostream>
+#include <bit>
+#include <concepts>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace util {
+
+#if defined(__SIZEOF_INT128__)
+/// 128-bit unsigned integer, it isn't std::unsigned_integral in the strict standard mode
+__extension__ typedef unsigned __int128 uint128_t;
+#endif
+
+/// Unsigned integers that patricia_tree and BitStreamAdaptor take as fixed-width keys
+template <typename T>
+concept fixed_width_unsigned = std::unsigned_integral<T> && !std::same_as<T, bool>
+#if defined(__SIZEOF_INT128__)
+    || std::same_as<T, uint128_t>
+#endif
+    ;
+
+/**
+ * @brief bit_prefix is the high length bits of an unsigned integer, like the IP network 10.0.0.0/8.
+ *
+ * The bits after the prefix are cleared, so equal prefixes have equal values.
+ */
+template <fixed_width_unsigned T>
+struct bit_prefix {
+    static constexpr unsigned bits = sizeof(T) * 8;
+
+    T        value  = 0;
+    unsigned length = 0;
+
+    bit_prefix() = default;
+
+    /**
+     * @param v integer whose high bits are the prefix
+     * @param l number of the prefix bits, it isn't greater than the integer width
+     */
+    bit_prefix(T v, unsigned l) noexcept
+        : value(l == 0 ? T{0} : static_cast<T>(v & static_cast<T>(~T{0} << (bits - l))))
+        , length(l)
+    {}
+
+    friend bool operator==(const bit_prefix&, const bit_prefix&) = default;
+
+    friend std::ostream& operator<<(std::ostream& os, const bit_prefix& prefix) {
+        return os << std::hex << static_cast<uint64_t>(prefix.value >> (bits > 64 ? bits - 64 : 0)) << std::dec << '/' << prefix.length;
+    }
+};
+
+namespace detail {
+
+/// count-leading-zeros that works with uint128_t too, x must not be zero
+template <typename T>
+unsigned countl_zero(T x) noexcept {
+    if constexpr (sizeof(T) > sizeof(uint64_t)) {
+        auto high = static_cast<uint64_t>(x >> 64);
+        return high != 0 ? std::countl_zero(high) : 64 + std::countl_zero(static_cast<uint64_t>(x));
+    } else {
+        return static_cast<unsigned>(std::countl_zero(x));
+    }
+}
+
+/**
+ * @brief mismatch_index compares two arrays of integers a word at a time
+ *
+ * Blocks of 16 bytes are compared with SSE2 when it is available, then 8-byte words:
+ * XOR of the words is not zero when they differ and count-trailing-zeros (count-leading-zeros on big endian)
+ * of it gives the first differing byte. The tail that is shorter than a word is compared item by item.
+ * @return index of the first item that differs or count when the arrays are equal
+ */
+template <typename T>
+std::size_t mismatch_index(const T* a, const T* b, std::size_t count) noexcept {
+    static_assert(std::is_integral_v<T> && 8 % sizeof(T) == 0);
+    const auto bytes = count * sizeof(T);
+    auto first = reinterpret_cast<const unsigned char*>(a);
+    auto second = reinterpret_cast<const unsigned char*>(b);
+    std::size_t offset = 0;
+#if defined(__SSE2__)
+    for (; offset + 16 <= bytes; offset += 16) {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + offset));
+        auto y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + offset));
+        // a bit per byte, it is set for equal bytes
+        auto equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)));
+        if (equal != 0xFFFF)
+            return (offset + std::countr_zero(~equal)) / sizeof(T);
+    }
+#endif
+    for (; offset + 8 <= bytes; offset += 8) {
+        uint64_t x;
+        uint64_t y;
+        std::memcpy(&x, first + offset, 8);
+        std::memcpy(&y, second + offset, 8);
+        if (auto diff = x ^ y; diff != 0) {
+            auto bit = std::endian::native == std::endian::little ? std::countr_zero(diff) : std::countl_zero(diff);
+            return (offset + bit / 8) / sizeof(T);
+        }
+    }
+    for (auto i = offset / sizeof(T); i < count; ++i) {
+        if (a[i] != b[i])
+            return i;
+    }
+    return count;
+}
 
-namespace utils{
+}
 
 /**
+ * @brief BitStreamAdaptor presents a sequence of integers (std::string, std::vector<uint8_t> etc.) as a bit stream.
  *
+ * The stream starts with a bit that is always 1, so no sequence looks like an all-zeros stream.
+ * Every item is preceded by a bit that is 1 while the sequence goes on, the item bits follow from the most significant one.
+ * The stream is zero after the end. So a sequence is never a prefix of another one
+ * and the first differing bit orders streams as the sequences are ordered lexicographically (items are compared as unsigned).
+ *
+ * Sequences with contiguous storage are compared a word at a time.
  */
 template<class C>
 class BitStreamAdaptor
@@ -19,16 +136,21 @@ public:
     typedef typename  value_type::value_type item_type;
     typedef typename  value_type::value_type& item_reference;
 
+    static_assert(std::is_integral_v<item_type>, "BitStreamAdaptor works with sequences of integers");
+
+    /// mismatch() result for equal sequences
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
     BitStreamAdaptor(const_reference v)
         :value(v){}
 
     /**
      * @brief size
-     * @return data size in bites
+     * @return number of bits that can be 1: the leading bit and the bits of all items
      */
     std::size_t size() const
     {
-        return value.size()*sizeof(item_type)*8;
+        return 1 + std::size(value) * item_stride;
     }
 
     /**
@@ -37,48 +159,185 @@ public:
      * @return true when bit by bit_pos is 1 otherwise false.
      * When bit_pos is great than data size also returns false
      */
-    bool bit(size_t bit_pos) const
+    bool bit(std::size_t bit_pos) const
     {
-        if(size() < bit_pos) return false;
-
-        size_t i = bit_pos/(sizeof(item_type)*8);
-        const auto& item = value.at(i);
-        return item & (1<<(bit_pos%(sizeof(item_type)*8)));
+        if (bit_pos == 0)
+            return true;
+        auto i = (bit_pos - 1) / item_stride;
+        auto offset = (bit_pos - 1) % item_stride;
+        if (i >= std::size(value))
+            return false;
+        if (offset == 0)
+            return true;
+        return (static_cast<unsigned_item>(item(i)) >> (item_bits - offset)) & 1;
     }
 
     /**
      * @brief mismatch
      * @param other const reference on another data
-     * @return the first mismathed bit position
+     * @return the first mismatched bit position or npos when the sequences are equal
      */
-    int mismatch(const_reference other) const
+    std::size_t mismatch(const_reference other) const
     {
-        const auto& mismatch_item = std::mismatch(std::begin(value),
-                                           std::end(value),
-                                           std::begin(other));
+        auto count = std::min(std::size(value), std::size(other));
+        auto i = mismatch_index(other, count);
+        if (i < count) {
+            auto mask = static_cast<unsigned_item>(item(i) ^ BitStreamAdaptor(other).item(i));
+            return 1 + i * item_stride + 1 + std::countl_zero(mask);
+        }
+        if (std::size(value) == std::size(other))
+            return npos;
+        // the shorter sequence has ended: the bit that marks the item differs
+        return 1 + count * item_stride;
+    }
 
-        if(mismatch_item.first ==  std::end(value)
-           || mismatch_item.second ==  std::end(other)) return -1;
+    /**
+     * @brief starts_with
+     * @return true when prefix is equal to the beginning of the data (or to the whole data)
+     */
+    bool starts_with(const_reference prefix) const
+    {
+        auto count = std::size(prefix);
+        return count <= std::size(value) && mismatch_index(prefix, count) == count;
+    }
 
-        auto mask = *mismatch_item.first ^ *mismatch_item.second;
+private:
+    using unsigned_item = std::make_unsigned_t<item_type>;
+    static constexpr std::size_t item_bits = sizeof(item_type) * 8;
+    static constexpr std::size_t item_stride = item_bits + 1;
+    static constexpr bool is_contiguous = requires (const C& c) {
+        { std::data(c) } -> std::convertible_to<const item_type*>;
+    };
 
-        //find on the first 1 in the mask
-        unsigned i;
-        for( i=0; i < sizeof(mask)*8; ++i){
-            if(mask & (1<<i))break;
+    /// the first of count items that differs from other
+    std::size_t mismatch_index(const_reference other, std::size_t count) const {
+        if constexpr (is_contiguous && 8 % sizeof(item_type) == 0) {
+            return detail::mismatch_index(std::data(value), std::data(other), count);
+        } else {
+            std::size_t i = 0;
+            auto first = std::begin(value);
+            auto second = std::begin(other);
+            for (; i < count && *first == *second; ++i, ++first, ++second) {}
+            return i;
         }
+    }
 
-        return i;
+    item_type item(std::size_t i) const {
+        if constexpr (is_contiguous) {
+            return std::data(value)[i];
+        } else {
+            return *std::next(std::begin(value), i);
+        }
     }
 
-private:
     const_reference value;
 };
 
-}//namespace utils
+/**
+ * @brief BitStreamAdaptor of a fixed-width unsigned integer: the leading 1 bit and the integer bits from the most significant one.
+ *
+ * All keys have the same length, so a bit is a shift and a mask and mismatch() is XOR and count-leading-zeros.
+ */
+template<fixed_width_unsigned C>
+class BitStreamAdaptor<C>
+{
+public:
+    typedef C value_type;
+    typedef const C& const_reference;
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    BitStreamAdaptor(const_reference v)
+        :value(v){}
+
+    std::size_t size() const
+    {
+        return 1 + bits;
+    }
+
+    bool bit(std::size_t bit_pos) const
+    {
+        if (bit_pos == 0)
+            return true;
+        return bit_pos <= bits && ((value >> (bits - bit_pos)) & 1) != 0;
+    }
+
+    std::size_t mismatch(const_reference other) const
+    {
+        auto mask = static_cast<C>(value ^ other);
+        return mask == 0 ? npos : 1 + detail::countl_zero(mask);
+    }
+
+    /// a fixed-width key is a prefix of the equal key only
+    bool starts_with(const_reference prefix) const
+    {
+        return value == prefix;
+    }
+
+private:
+    static constexpr std::size_t bits = sizeof(C) * 8;
+
+    C value;
+};
+
+/**
+ * @brief BitStreamAdaptor of bit_prefix: the leading 1 bit, then every prefix bit is preceded by 1 that marks it present.
+ *
+ * So a shorter prefix is a prefix of the stream of a longer one too, and patricia_tree can store both
+ * (the routes 10.0.0.0/8 and 10.1.0.0/16 at once).
+ */
+template<fixed_width_unsigned T>
+class BitStreamAdaptor<bit_prefix<T>>
+{
+public:
+    typedef bit_prefix<T> value_type;
+    typedef const value_type& const_reference;
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    BitStreamAdaptor(const_reference v)
+        :value(v){}
+
+    std::size_t size() const
+    {
+        return 1 + 2 * std::size_t{value.length};
+    }
+
+    bool bit(std::size_t bit_pos) const
+    {
+        if (bit_pos == 0)
+            return true;
+        auto i = (bit_pos - 1) / 2;
+        if (i >= value.length)
+            return false;
+        return (bit_pos - 1) % 2 == 0 || ((value.value >> (value_type::bits - 1 - i)) & 1) != 0;
+    }
+
+    std::size_t mismatch(const_reference other) const
+    {
+        auto count = std::min(value.length, other.length);
+        auto mask = static_cast<T>(value.value ^ other.value);
+        auto first = mask == 0 ? value_type::bits : detail::countl_zero(mask);
+        if (first < count)
+            return 2 + 2 * std::size_t{first};
+        if (value.length == other.length)
+            return npos;
+        return 1 + 2 * std::size_t{count};
+    }
+
+    bool starts_with(const_reference prefix) const
+    {
+        return prefix.length <= value.length && bit_prefix<T>(value.value, prefix.length) == prefix;
+    }
+
+private:
+    value_type value;
+};
+
+}//namespace util
 
 template <class C>
-std::ostream &operator<<(std::ostream &output, const utils::BitStreamAdaptor<C> &stream)
+std::ostream &operator<<(std::ostream &output, const util::BitStreamAdaptor<C> &stream)
 {
     std::size_t size = stream.size();
     for(std::size_t i=0; i < size; ++i)
@@ -87,5 +346,3 @@ std::ostream &operator<<(std::ostream &output, const utils::BitStreamAdaptor<C>
     }
     return output;
 }
-
-
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+/**
+ * @brief work_stealing_pool runs fork-join tasks on a small set of worker threads.
+ *
+ * Every worker has its own deque of tasks. The worker takes the newest task of its deque (depth first, the data is hot),
+ * an idle worker steals the oldest task of another deque (it is usually the biggest piece of work).
+ * Tasks spawned by threads outside of the pool go to one shared deque that all workers steal from.
+ *
+ * Tasks are grouped by task_group. wait() doesn't block while the group has unfinished tasks:
+ * the waiting thread runs queued tasks too, so nested fork-join never deadlocks and the caller thread helps.
+ * The first exception of the group tasks is rethrown by wait().
+ * @code
+ * util::work_stealing_pool pool;
+ * util::work_stealing_pool::task_group group;
+ * pool.spawn(group, [] { left_half(); });
+ * right_half();
+ * pool.wait(group);
+ * @endcode
+ */
+class work_stealing_pool {
+public:
+    class task_group {
+    public:
+        task_group() = default;
+        task_group(const task_group&) = delete;
+        task_group& operator=(const task_group&) = delete;
+
+    private:
+        friend class work_stealing_pool;
+
+        std::atomic<std::size_t> pending = 0;
+        std::mutex               error_mutex;
+        std::exception_ptr       error;
+    };
+
+    /**
+     * @param worker_count number of worker threads, the thread that waits for a group works too
+     */
+    explicit work_stealing_pool(unsigned worker_count = std::max(std::thread::hardware_concurrency(), 2u) - 1);
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    /**
+     * @note all groups must be waited before the pool is destroyed
+     */
+    ~work_stealing_pool();
+
+    /**
+     * @brief concurrency
+     * @return number of threads that can run tasks at once: the workers and the waiting thread
+     */
+    [[nodiscard]] unsigned concurrency() const noexcept {
+        return static_cast<unsigned>(workers.size()) + 1;
+    }
+
+    /**
+     * @brief spawn queues the task of the group
+     */
+    template <typename F>
+    void spawn(task_group& group, F&& f) {
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        auto& q = *queues[own_queue()];
+        try {
+            std::lock_guard lock(q.mutex);
+            q.tasks.push_back({std::function<void()>(std::forward<F>(f)), &group});
+        } catch (...) {
+            group.pending.fetch_sub(1, std::memory_order_relaxed);
+            throw;
+        }
+        queued.fetch_add(1);
+        if (sleeping.load() != 0) {
+            std::lock_guard lock(sleep_mutex);
+            wake.notify_one();
+        }
+    }
+
+    /**
+     * @brief wait runs queued tasks until all tasks of the group are finished
+     * @throw the first exception of the group tasks
+     */
+    void wait(task_group& group);
+
+    /**
+     * @brief shared returns the pool that is created at the first use with a worker per hardware thread (but one)
+     */
+    static work_stealing_pool& shared() {
+        static work_stealing_pool pool;
+        return pool;
+    }
+
+private:
+    struct task {
+        std::function<void()> run;
+        task_group*           group;
+    };
+
+    struct alignas(64) task_queue {
+        std::mutex       mutex;
+        std::deque<task> tasks;
+    };
+
+    /// queues[i] belongs to the worker i, the last one is shared by the threads outside of the pool
+    std::vector<std::unique_ptr<task_queue>> queues;
+    std::vector<std::thread>                 workers;
+    std::atomic<std::size_t>                 queued = 0;
+    std::atomic<unsigned>                    sleeping = 0;
+    std::atomic<bool>                        stopping = false;
+    std::mutex                               sleep_mutex;
+    std::condition_variable                  wake;
+
+    struct worker_identity {
+        const work_stealing_pool* pool = nullptr;
+        std::size_t               index = 0;
+    };
+
+    static worker_identity& identity() noexcept {
+        thread_local worker_identity id;
+        return id;
+    }
+
+    std::size_t own_queue() const noexcept {
+        const auto& id = identity();
+        return id.pool == this ? id.index : queues.size() - 1;
+    }
+
+    bool pop(std::size_t index, bool newest, task& t) {
+        auto& q = *queues[index];
+        std::lock_guard lock(q.mutex);
+        if (q.tasks.empty())
+            return false;
+        if (newest) {
+            t = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        } else {
+            t = std::move(q.tasks.front());
+            q.tasks.pop_front();
+        }
+        return true;
+    }
+
+    /**
+     * @brief run_one runs the newest own task or the oldest task of another queue
+     * @return false when there are no queued tasks
+     */
+    bool run_one(std::size_t self);
+
+    void worker_loop(std::size_t index);
+    void stop() noexcept;
+};
+
+inline work_stealing_pool::work_stealing_pool(unsigned worker_count) {
+    for (unsigned i = 0; i <= worker_count; ++i) {
+        queues.push_back(std::make_unique<task_queue>());
+    }
+    try {
+        for (unsigned i = 0; i < worker_count; ++i) {
+            workers.emplace_back([this, i] {
+                worker_loop(i);
+            });
+        }
+    } catch (...) {
+        stop();
+        throw;
+    }
+}
+
+inline work_stealing_pool::~work_stealing_pool() {
+    stop();
+}
+
+inline void work_stealing_pool::stop() noexcept {
+    {
+        std::lock_guard lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+inline bool work_stealing_pool::run_one(std::size_t self) {
+    if (queued.load() == 0)
+        return false;
+    task t;
+    bool found = pop(self, true, t);
+    for (std::size_t i = 1; !found && i < queues.size(); ++i) {
+        found = pop((self + i) % queues.size(), false, t);
+    }
+    if (!found)
+        return false;
+    queued.fetch_sub(1);
+    try {
+        t.run();
+    } catch (...) {
+        std::lock_guard lock(t.group->error_mutex);
+        if (!t.group->error)
+            t.group->error = std::current_exception();
+    }
+    t.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+}
+
+inline void work_stealing_pool::wait(task_group& group) {
+    auto self = own_queue();
+    while (group.pending.load(std::memory_order_acquire) != 0) {
+        if (!run_one(self)) {
+            // the rest of the group is running in other threads
+            std::this_thread::yield();
+        }
+    }
+    std::lock_guard lock(group.error_mutex);
+    if (group.error)
+        std::rethrow_exception(std::exchange(group.error, nullptr));
+}
+
+inline void work_stealing_pool::worker_loop(std::size_t index) {
+    identity() = {this, index};
+    while (true) {
+        if (run_one(index))
+            continue;
+        std::unique_lock lock(sleep_mutex);
+        ++sleeping;
+        wake.wait(lock, [this] {
+            return stopping.load() || queued.load() != 0;
+        });
+        --sleeping;
+        if (stopping.load())
+            return;
+    }
+}
+
+}
@@ -0,0 +1,156 @@
+#include <patricia_trie/art_tree.h>
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#define BOOST_TEST_MODULE ArtTree
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+std::string random_key(unsigned& seed, std::size_t max_length, int letters) {
+    seed = seed * 1103515245 + 12345;
+    std::string key(seed % (max_length + 1), 'a');
+    for (auto& c : key) {
+        seed = seed * 1103515245 + 12345;
+        c = static_cast<char>('a' + (seed >> 16) % letters);
+    }
+    return key;
+}
+
+template <typename KEY>
+void check_same(const art_tree<KEY>& tree, const std::set<KEY>& expected) {
+    BOOST_REQUIRE(tree.verify_test());
+    BOOST_REQUIRE_EQUAL(tree.size(), expected.size());
+    BOOST_REQUIRE(std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()));
+}
+
+template <typename KEY>
+void check_random_operations(const std::vector<KEY>& keys) {
+    art_tree<KEY> tree;
+    std::set<KEY> expected;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(keys[i]);
+        expected.insert(keys[i]);
+        if (i % 3 == 2) {
+            tree.erase(keys[i / 2]);
+            expected.erase(keys[i / 2]);
+        }
+    }
+    check_same(tree, expected);
+    for (const auto& key : keys) {
+        BOOST_REQUIRE_EQUAL(tree.contains(key), expected.count(key) != 0);
+    }
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        tree.erase(keys[i]);
+        expected.erase(keys[i]);
+        BOOST_REQUIRE(!tree.contains(keys[i]));
+        if (i % 500 == 0)
+            check_same(tree, expected);
+    }
+    BOOST_REQUIRE(tree.empty());
+    BOOST_REQUIRE(tree.begin() == tree.end());
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( ArtTreeTest )
+{
+    art_tree<std::string> tree;
+    BOOST_REQUIRE(tree.empty());
+    BOOST_REQUIRE(!tree.contains(""));
+    BOOST_REQUIRE(tree.begin() == tree.end());
+
+    for (const auto& key : {"romane", "romanus", "romulus", "rubens", "ruber", "rubicon", "rubicundus"}) {
+        tree.insert(key);
+    }
+    tree.insert("romane");
+    BOOST_REQUIRE_EQUAL(tree.size(), 7);
+    BOOST_REQUIRE(tree.contains("rubens"));
+    BOOST_REQUIRE(!tree.contains("rub"));
+    BOOST_REQUIRE(!tree.contains("rubicons"));
+    BOOST_REQUIRE(!tree.contains("a"));
+    BOOST_REQUIRE_EQUAL(*tree.begin(), "romane");
+
+    tree.erase("rubicon");
+    tree.erase("rubicon");
+    tree.erase("r");
+    BOOST_REQUIRE(tree.verify_test());
+    BOOST_REQUIRE_EQUAL(tree.size(), 6);
+    BOOST_REQUIRE(!tree.contains("rubicon"));
+    BOOST_REQUIRE(tree.contains("rubicundus"));
+
+    tree.clear();
+    BOOST_REQUIRE(tree.empty());
+    BOOST_REQUIRE_EQUAL(tree.size(), 0);
+    BOOST_REQUIRE(!tree.contains("romane"));
+}
+
+BOOST_AUTO_TEST_CASE( ArtTreePrefixKeysTest )
+{
+    // the keys end at inner nodes and inside of compressed paths
+    std::vector<std::string> keys = {"", "a", "aaaaaaaaaaaaaaaaaaaa", "aaaaaaaaaa", "aaaaaaaaaaaaaaaaaaab", "aaaab", "b",
+                                     std::string("a\0", 2)};
+    for (std::size_t shift = 0; shift < keys.size(); ++shift) {
+        art_tree<std::string> tree;
+        std::set<std::string> expected(keys.begin(), keys.end());
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            tree.insert(keys[(i + shift) % keys.size()]);
+        }
+        check_same(tree, expected);
+        BOOST_REQUIRE(!tree.contains("aaaaaaaaaaaaaaaaaaa"));
+        BOOST_REQUIRE(!tree.contains("aaaaaaaaaaaaaaaaaaac"));
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            auto key = keys[(i * 3 + shift) % keys.size()];
+            tree.erase(key);
+            expected.erase(key);
+            check_same(tree, expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( ArtTreeNodeSizesTest )
+{
+    // every byte value after the common prefix makes the node grow to Node256 and shrink back
+    art_tree<std::vector<uint8_t>> tree;
+    std::set<std::vector<uint8_t>> expected;
+    for (int round = 0; round < 2; ++round) {
+        for (int b = 255; b >= 0; --b) {
+            std::vector<uint8_t> key = {1, 2, static_cast<uint8_t>(b), static_cast<uint8_t>(round)};
+            tree.insert(key);
+            expected.insert(key);
+            if (b % 16 == 0)
+                check_same(tree, expected);
+        }
+    }
+    for (int b = 0; b < 256; ++b) {
+        for (int round = 0; round < 2; ++round) {
+            std::vector<uint8_t> key = {1, 2, static_cast<uint8_t>(b), static_cast<uint8_t>(round)};
+            tree.erase(key);
+            expected.erase(key);
+        }
+        if (b % 16 == 0 || b > 240)
+            check_same(tree, expected);
+    }
+    BOOST_REQUIRE(tree.empty());
+}
+
+BOOST_AUTO_TEST_CASE( ArtTreeRandomTest )
+{
+    unsigned seed = 23;
+    std::vector<std::string> short_keys;
+    std::vector<std::string> wide_keys;
+    std::vector<std::string> long_keys;
+    for (int i = 0; i < 5000; ++i) {
+        short_keys.push_back(random_key(seed, 6, 3));
+        // many letters make Node48 and Node256
+        wide_keys.push_back(random_key(seed, 4, 200));
+        // the prefixes are longer than the nodes keep
+        long_keys.push_back(std::string(30, 'p') + random_key(seed, 3, 2) + std::string(20, 'q') + random_key(seed, 3, 2));
+    }
+    check_random_operations(short_keys);
+    check_random_operations(wide_keys);
+    check_random_operations(long_keys);
+}
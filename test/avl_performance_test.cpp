@@ -1,16 +1,30 @@
 #include <util/profiler.h>
 #include <binary_tree/binary_tree.h>
+#include <binary_tree/compact_tree.h>
+#include <binary_tree/concurrent_tree.h>
+#include <binary_tree/rb_balancer.h>
+#include <binary_tree/wavl_balancer.h>
+#include <bplus_tree/bplus_tree.h>
+#include <util/arena_allocator.h>
 
 #include <ext/pb_ds/assoc_container.hpp>
 #include <ext/pb_ds/tree_policy.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <set>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
 #include <iostream>
 
 profiler::point_set mgr_time;
 constexpr int repeat = 100;
 
 binary_tree::tree<int>  avl_tree;
+binary_tree::tree<int, void, binary_tree::avl_balancer, std::compare_three_way, util::arena_allocator>  avl_arena_tree;
+binary_tree::tree<int, void, binary_tree::avl_balancer, std::compare_three_way, std::allocator, binary_tree::order_statistic>  avl_os_tree;
 std::set<int>  std_set;
 
 using  ordered_set = __gnu_pbds::tree<
@@ -33,6 +47,357 @@ void avl_test(int n) {
     }
 }
 
+void avl_insert_back_test(int n) {
+    static const char point_name[] = "AVL Tree (insert_back)";
+    profiler::point<mgr_time, point_name>   test_point;
+
+    for(int i = 0; i < repeat; ++i) {
+        for(int v = 0; v < n; ++v) {
+            avl_tree.insert_back(v);
+        }
+        avl_tree.clear();
+    }
+}
+
+void avl_arena_test(int n) {
+    static const char point_name[] = "AVL Tree (arena)";
+    profiler::point<mgr_time, point_name>   test_point;
+
+    for(int i = 0; i < repeat; ++i) {
+        for(int v = 0; v < n; ++v) {
+            avl_arena_tree.insert(v);
+        }
+        avl_arena_tree.clear();
+    }
+}
+
+void avl_sorted_build_test(int n) {
+    static const char point_name[] = "AVL Tree (sorted build)";
+    static std::vector<int> keys;
+    keys.resize(n);
+    for(int v = 0; v < n; ++v) {
+        keys[v] = v;
+    }
+    profiler::point<mgr_time, point_name>   test_point;
+
+    for(int i = 0; i < repeat; ++i) {
+        avl_tree.assign(keys.begin(), keys.end());
+        avl_tree.clear();
+    }
+}
+
+void avl_order_statistic_test(int n) {
+    static const char point_name[] = "AVL Tree (select/rank)";
+    profiler::point<mgr_time, point_name>   test_point;
+
+    for(int i = 0; i < repeat; ++i) {
+        for(int v = 0; v < n; ++v) {
+            avl_os_tree.insert(v);
+        }
+        std::size_t sum = 0;
+        for(int v = 0; v < n; ++v) {
+            sum += *avl_os_tree.select(v) + avl_os_tree.rank(v);
+        }
+        if (sum != std::size_t(n) * (n - 1)) {
+            std::cerr << "Wrong select/rank result" << std::endl;
+        }
+        avl_os_tree.clear();
+    }
+}
+
+void pbds_order_statistic_test(int n) {
+    static const char point_name[] = "PBDS (find_by_order/order_of_key)";
+    profiler::point<mgr_time, point_name>   test_point;
+
+    for(int i = 0; i < repeat; ++i) {
+        for(int v = 0; v < n; ++v) {
+            pbds_set.insert(v);
+        }
+        std::size_t sum = 0;
+        for(int v = 0; v < n; ++v) {
+            sum += *pbds_set.find_by_order(v) + pbds_set.order_of_key(v);
+        }
+        if (sum != std::size_t(n) * (n - 1)) {
+            std::cerr << "Wrong find_by_order/order_of_key result" << std::endl;
+        }
+        pbds_set.clear();
+    }
+}
+
+template <typename F>
+void union_test(int n, F run) {
+    static std::vector<int> a_keys;
+    static std::vector<int> b_keys;
+    a_keys.resize(n);
+    b_keys.resize(n);
+    for(int v = 0; v < n; ++v) {
+        a_keys[v] = 2 * v;
+        b_keys[v] = 3 * v;
+    }
+    binary_tree::tree<int> a;
+    binary_tree::tree<int> b;
+    for(int i = 0; i < repeat / 10; ++i) {
+        a.assign(a_keys.begin(), a_keys.end());
+        b.assign(b_keys.begin(), b_keys.end());
+        run(a, b);
+    }
+}
+
+void avl_union_insert_test(int n) {
+    static const char point_name[] = "AVL Tree union (insert one by one)";
+    union_test(n, [](auto& a, auto& b) {
+        profiler::point<mgr_time, point_name>   test_point;
+        b.enumerate([&a](int v) {
+            a.insert(v);
+            return true;
+        });
+    });
+}
+
+void avl_union_test(int n) {
+    static const char point_name[] = "AVL Tree union (set_union)";
+    union_test(n, [](auto& a, auto& b) {
+        profiler::point<mgr_time, point_name>   test_point;
+        a.set_union(b);
+    });
+}
+
+void avl_parallel_union_test(int n) {
+    static const char point_name[] = "AVL Tree union (set_union parallel)";
+    union_test(n, [](auto& a, auto& b) {
+        profiler::point<mgr_time, point_name>   test_point;
+        a.set_union(b, binary_tree::tree<int>::ExecutionPolicy::PARALLEL);
+    });
+}
+
+// keys are scattered over [0, 2n] by the prime multiplier
+int scattered_key(int i, int n) {
+    return static_cast<int>(static_cast<long>(i) * 7919 % (2 * n + 1));
+}
+
+template <typename Tree, const char* point_name>
+void insert_mix_test(int n) {
+    profiler::point<mgr_time, point_name>   test_point;
+
+    Tree tree;
+    for(int i = 0; i < repeat; ++i) {
+        for(int v = 0; v < n; ++v) {
+            tree.insert(scattered_key(v, n));
+        }
+        tree.clear();
+    }
+}
+
+template <typename Tree, const char* point_name>
+void erase_mix_test(int n) {
+    Tree tree;
+    for(int v = 0; v < n; ++v) {
+        tree.insert(scattered_key(v, n));
+    }
+    profiler::point<mgr_time, point_name>   test_point;
+
+    // one insert per two erases on average, so the tree size is about n/2 at the end
+    for(int i = 0; i < repeat; ++i) {
+        for(int v = 0; v < n; ++v) {
+            auto key = scattered_key(v + i, n);
+            if (v % 3 == 0) {
+                tree.insert(key);
+            } else {
+                tree.erase(key);
+            }
+        }
+    }
+}
+
+template <typename Tree, const char* point_name>
+void lookup_mix_test(int n) {
+    Tree tree;
+    for(int v = 0; v < n; ++v) {
+        tree.insert(scattered_key(v, n));
+    }
+    profiler::point<mgr_time, point_name>   test_point;
+
+    std::size_t found = 0;
+    for(int i = 0; i < repeat; ++i) {
+        for(int v = 0; v < n; ++v) {
+            found += tree.count(scattered_key(v + i, n));
+        }
+    }
+    if (found == 0) {
+        std::cerr << "Nothing has been found" << std::endl;
+    }
+}
+
+using rb_tree   = binary_tree::tree<int, void, binary_tree::rb_balancer>;
+using wavl_tree = binary_tree::tree<int, void, binary_tree::wavl_balancer>;
+
+const char avl_insert_mix[]  = "AVL Tree (insert mix)";
+const char rb_insert_mix[]   = "RB Tree (insert mix)";
+const char wavl_insert_mix[] = "WAVL Tree (insert mix)";
+const char avl_erase_mix[]   = "AVL Tree (erase mix)";
+const char rb_erase_mix[]    = "RB Tree (erase mix)";
+const char wavl_erase_mix[]  = "WAVL Tree (erase mix)";
+const char avl_lookup_mix[]  = "AVL Tree (lookup mix)";
+const char rb_lookup_mix[]   = "RB Tree (lookup mix)";
+const char wavl_lookup_mix[] = "WAVL Tree (lookup mix)";
+const char compact_insert_mix[] = "Compact Tree (insert mix)";
+const char compact_erase_mix[]  = "Compact Tree (erase mix)";
+const char compact_lookup_mix[] = "Compact Tree (lookup mix)";
+const char bplus_insert_mix[]   = "B+ Tree (insert mix)";
+const char bplus_erase_mix[]    = "B+ Tree (erase mix)";
+const char bplus_lookup_mix[]   = "B+ Tree (lookup mix)";
+
+void balancers_test(int n) {
+    insert_mix_test<binary_tree::tree<int>, avl_insert_mix>(n);
+    insert_mix_test<rb_tree, rb_insert_mix>(n);
+    insert_mix_test<wavl_tree, wavl_insert_mix>(n);
+    erase_mix_test<binary_tree::tree<int>, avl_erase_mix>(n);
+    erase_mix_test<rb_tree, rb_erase_mix>(n);
+    erase_mix_test<wavl_tree, wavl_erase_mix>(n);
+    lookup_mix_test<binary_tree::tree<int>, avl_lookup_mix>(n);
+    lookup_mix_test<rb_tree, rb_lookup_mix>(n);
+    lookup_mix_test<wavl_tree, wavl_lookup_mix>(n);
+    insert_mix_test<binary_tree::compact_tree<int>, compact_insert_mix>(n);
+    erase_mix_test<binary_tree::compact_tree<int>, compact_erase_mix>(n);
+    lookup_mix_test<binary_tree::compact_tree<int>, compact_lookup_mix>(n);
+    insert_mix_test<bplus_tree::tree<int>, bplus_insert_mix>(n);
+    erase_mix_test<bplus_tree::tree<int>, bplus_erase_mix>(n);
+    lookup_mix_test<bplus_tree::tree<int>, bplus_lookup_mix>(n);
+}
+
+void frozen_lookup_test(int n) {
+    static const char point_name[] = "Frozen Tree (lookup mix)";
+    binary_tree::tree<int> tree;
+    for(int v = 0; v < n; ++v) {
+        tree.insert(scattered_key(v, n));
+    }
+    auto frozen = tree.freeze();
+    profiler::point<mgr_time, point_name>   test_point;
+
+    std::size_t found = 0;
+    for(int i = 0; i < repeat; ++i) {
+        for(int v = 0; v < n; ++v) {
+            found += frozen.count(scattered_key(v + i, n));
+        }
+    }
+    if (found == 0) {
+        std::cerr << "Nothing has been found" << std::endl;
+    }
+}
+
+void batch_lookup_test(int n) {
+    static const char point_name[] = "AVL Tree (batch lookup mix)";
+    binary_tree::tree<int> tree;
+    for(int v = 0; v < n; ++v) {
+        tree.insert(scattered_key(v, n));
+    }
+    std::vector<int> keys(n);
+    std::vector<char> found(n);
+    profiler::point<mgr_time, point_name>   test_point;
+
+    std::size_t found_count = 0;
+    for(int i = 0; i < repeat; ++i) {
+        for(int v = 0; v < n; ++v) {
+            keys[v] = scattered_key(v + i, n);
+        }
+        tree.contains_batch(keys.begin(), keys.end(), found.begin());
+        found_count += std::count(found.begin(), found.end(), 1);
+    }
+    if (found_count == 0) {
+        std::cerr << "Nothing has been found" << std::endl;
+    }
+}
+
+/**
+ * @brief reader_scaling_test runs reader threads with one writer that inserts and erases 1% of the keys
+ * @return lookups per microsecond of all readers
+ */
+template <typename Insert, typename Erase, typename Contains>
+double reader_scaling_test(int n, int reader_count, Insert insert, Erase erase, Contains contains) {
+    constexpr int lookups = 200000;
+    std::atomic<bool> done = false;
+    std::vector<std::thread> readers;
+    std::thread writer([&] {
+        for (int i = 0; !done.load(std::memory_order_relaxed); ++i) {
+            auto key = n + i % (n / 100 + 1);
+            insert(key);
+            erase(key);
+        }
+    });
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<std::size_t> found = 0;
+    for (int r = 0; r < reader_count; ++r) {
+        readers.emplace_back([&, r] {
+            std::size_t local = 0;
+            for (int v = 0; v < lookups; ++v) {
+                local += contains(scattered_key(v + r, n)) ? 1 : 0;
+            }
+            found += local;
+        });
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    done = true;
+    writer.join();
+    if (found.load() == 0) {
+        std::cerr << "Nothing has been found" << std::endl;
+    }
+    return static_cast<double>(lookups) * reader_count / static_cast<double>(std::max<long long>(time, 1));
+}
+
+void concurrent_scaling_test(int n) {
+    binary_tree::concurrent_tree<int> concurrent;
+    binary_tree::tree<int> locked;
+    std::shared_mutex mutex;
+    for(int v = 0; v < n; ++v) {
+        concurrent.insert(scattered_key(v, n));
+        locked.insert(scattered_key(v, n));
+    }
+    std::cout << "Reader scaling, size: " << n << ", hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+    for (int readers : {1, 2, 4, 8}) {
+        auto lock_free = reader_scaling_test(n, readers,
+            [&](int key) { concurrent.insert(key); },
+            [&](int key) { concurrent.erase(key); },
+            [&](int key) { return concurrent.contains(key); });
+        auto shared_lock = reader_scaling_test(n, readers,
+            [&](int key) { std::unique_lock lock(mutex); locked.insert(key); },
+            [&](int key) { std::unique_lock lock(mutex); locked.erase(key); },
+            [&](int key) { std::shared_lock lock(mutex); return locked.contains(key); });
+        std::cout << "Readers: " << readers << "\tConcurrent Tree: " << lock_free << " lookups/us"
+                  << "\tShared mutex AVL Tree: " << shared_lock << " lookups/us" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void parallel_pass_test(int n) {
+    binary_tree::tree<int, long> map;
+    for(int v = 0; v < n; ++v) {
+        map.insert({v, v});
+    }
+    // aging pass: a little work per element
+    auto age = [](std::pair<const int, long>& item) {
+        item.second = item.second * 31 / 32 + 1;
+    };
+    auto start = std::chrono::steady_clock::now();
+    map.enumerate([&age](auto& item) {
+        age(item);
+        return true;
+    });
+    auto sequential = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Full pass, size: " << n << ", hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+    std::cout << "enumerate: " << sequential << "us" << std::endl;
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        util::work_stealing_pool pool(threads - 1);
+        start = std::chrono::steady_clock::now();
+        map.parallel_for_each(age, pool);
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "parallel_for_each, threads: " << threads << "\t" << time << "us" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
 void std_set_test(int n) {
     static const char point_name[] = "STD SET";
     profiler::point<mgr_time, point_name>   test_point;
@@ -58,8 +423,21 @@ void std_set_test(int n) {
 //}
 
 int main(int /*argc*/, char** /*argv*/) {
+    std::cout << "AVL Tree node: " << binary_tree::tree<int>::node_size << " bytes" << std::endl;
+    std::cout << "Compact Tree node: " << binary_tree::compact_tree<int>::node_size << " bytes" << std::endl << std::endl;
     for (int i = 100; i < 1000000; i*=10) {
         avl_test(i);
+        avl_insert_back_test(i);
+        avl_arena_test(i);
+        avl_sorted_build_test(i);
+        avl_order_statistic_test(i);
+        pbds_order_statistic_test(i);
+        balancers_test(i);
+        frozen_lookup_test(i);
+        batch_lookup_test(i);
+        avl_union_insert_test(i);
+        avl_union_test(i);
+        avl_parallel_union_test(i);
         std_set_test(i);
 //        pbds_test(i);
 
@@ -69,5 +447,7 @@ int main(int /*argc*/, char** /*argv*/) {
         profiler::point_set::get_manager<mgr_time>().reset();
         std::cout << std::endl;
     }
+    concurrent_scaling_test(100000);
+    parallel_pass_test(1000000);
     return 0;
 }
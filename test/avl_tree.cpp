@@ -1,5 +1,26 @@
 
 #include <binary_tree/binary_tree.h>
+#include <binary_tree/compact_tree.h>
+#include <binary_tree/concurrent_tree.h>
+#include <binary_tree/mapped_tree.h>
+#include <binary_tree/persistent_tree.h>
+#include <binary_tree/rb_balancer.h>
+#include <binary_tree/wavl_balancer.h>
+#include <util/arena_allocator.h>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 
 #define BOOST_TEST_MODULE Binary_Tree
@@ -7,7 +28,6 @@
 
 BOOST_AUTO_TEST_SUITE(Binary_Tree)
 
-BOOST_AUTO_TEST_CASE(AVL_Tree)
 BOOST_AUTO_TEST_CASE(AVL_Tree_Max_height)
 {
     using KEY_TYPE = int;
@@ -30,6 +50,7 @@ BOOST_AUTO_TEST_CASE(AVL_Tree_Max_height)
     avl_tree.clear();
 }
 
+BOOST_AUTO_TEST_CASE(AVL_Tree)
 {
     using KEY_TYPE = int;
     binary_tree::tree<KEY_TYPE>  avl_tree;
@@ -94,4 +115,1320 @@ BOOST_AUTO_TEST_CASE(AVL_Tree_enum) {
     }, binary_tree::tree<KEY_TYPE>::EnumerationOrder::DESCENDING);
 }
 
+BOOST_AUTO_TEST_CASE(AVL_Tree_arena) {
+    using KEY_TYPE = int;
+    binary_tree::tree<KEY_TYPE, void, binary_tree::avl_balancer, std::compare_three_way, util::arena_allocator>  avl_tree;
+    constexpr KEY_TYPE FIRST = 0;
+    constexpr KEY_TYPE LAST  = 10000;
+
+    for (int round = 0; round < 3; ++round) {
+        for (int i = FIRST; i <= LAST; ++i) {
+            BOOST_REQUIRE(avl_tree.insert(i));
+        }
+        for (int i = FIRST; i <= LAST; i += 2) {
+            BOOST_REQUIRE(avl_tree.erase(i));
+        }
+        // freed nodes are reused
+        for (int i = FIRST; i <= LAST; i += 2) {
+            BOOST_REQUIRE(avl_tree.insert(i));
+        }
+        BOOST_REQUIRE_EQUAL(avl_tree.size(), LAST - FIRST + 1);
+        for (int i = FIRST; i <= LAST; ++i) {
+            BOOST_REQUIRE(avl_tree.contains(i));
+        }
+        avl_tree.check_height_test([](int hl, int hr){
+            BOOST_REQUIRE(std::abs(hl-hr) <= 1);
+        });
+        avl_tree.clear();
+        BOOST_REQUIRE_EQUAL(avl_tree.size(), 0);
+        BOOST_REQUIRE(!avl_tree.contains(FIRST));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_arena_non_trivial) {
+    binary_tree::tree<int, std::string, binary_tree::avl_balancer, std::compare_three_way, util::arena_allocator>  avl_map;
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 1000; ++i) {
+            BOOST_REQUIRE(avl_map.insert({i, std::string(64, 'a' + i % 26)}));
+        }
+        BOOST_REQUIRE_EQUAL(avl_map.size(), 1000);
+        avl_map.clear();
+        BOOST_REQUIRE(avl_map.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_sorted_build) {
+    using KEY_TYPE = int;
+    using tree_type = binary_tree::tree<KEY_TYPE>;
+    for (int n = 0; n < 300; ++n) {
+        std::vector<KEY_TYPE> keys(n);
+        for (int i = 0; i < n; ++i) {
+            keys[i] = i * 2;
+        }
+        tree_type avl_tree(keys.begin(), keys.end());
+        BOOST_REQUIRE_EQUAL(avl_tree.size(), n);
+        avl_tree.check_height_test([](int hl, int hr){
+            BOOST_REQUIRE(std::abs(hl-hr) <= 1);
+        });
+        std::vector<KEY_TYPE> enumerated;
+        avl_tree.enumerate([&enumerated](auto& v){
+            enumerated.push_back(v);
+            return true;
+        });
+        BOOST_REQUIRE(enumerated == keys);
+
+        // balance factors must be correct for the following updates
+        for (int i = 0; i < n; ++i) {
+            BOOST_REQUIRE(avl_tree.insert(i * 2 + 1));
+            avl_tree.check_height_test([](int hl, int hr){
+                BOOST_REQUIRE(std::abs(hl-hr) <= 1);
+            });
+        }
+        for (int i = 0; i < n; ++i) {
+            BOOST_REQUIRE(avl_tree.erase(i * 2));
+            avl_tree.check_height_test([](int hl, int hr){
+                BOOST_REQUIRE(std::abs(hl-hr) <= 1);
+            });
+        }
+        BOOST_REQUIRE_EQUAL(avl_tree.size(), n);
+    }
+
+    binary_tree::tree<int, std::string> avl_map;
+    // the iterator of the map changes the mapped value only, a changed key would break the order
+    using map_iterator = binary_tree::tree<int, std::string>::iterator;
+    static_assert(!std::is_assignable_v<decltype((std::declval<map_iterator>()->first)), int>);
+    static_assert(std::is_assignable_v<decltype((std::declval<map_iterator>()->second)), std::string>);
+    static_assert(std::is_same_v<map_iterator::reference, std::pair<const int, std::string>&>);
+    avl_map.insert({100, "old"});
+    std::vector<std::pair<int, std::string>> values{{1, "one"}, {2, "two"}, {3, "three"}};
+    avl_map.assign(values.begin(), values.end());
+    BOOST_REQUIRE_EQUAL(avl_map.size(), 3);
+    BOOST_REQUIRE(avl_map.contains(2));
+    BOOST_REQUIRE(!avl_map.contains(100));
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_insert_back_front) {
+    using KEY_TYPE = int;
+    binary_tree::tree<KEY_TYPE>  avl_tree;
+    std::set<KEY_TYPE> expected;
+
+    // mostly ascending keys with some late ones
+    for (int i = 0; i < 5000; ++i) {
+        auto key = (i % 7 == 0) ? i - 20 : i;
+        BOOST_REQUIRE_EQUAL(avl_tree.insert_back(key), expected.insert(key).second);
+    }
+    // mostly descending keys
+    for (int i = -1; i > -3000; --i) {
+        auto key = (i % 5 == 0) ? i + 7 : i * 2;
+        BOOST_REQUIRE_EQUAL(avl_tree.insert_front(key), expected.insert(key).second);
+    }
+    // random keys work too
+    for (int i = 0; i < 1000; ++i) {
+        auto key = (i * 7919) % 20000 - 10000;
+        BOOST_REQUIRE_EQUAL(avl_tree.insert_back(key), expected.insert(key).second);
+        BOOST_REQUIRE_EQUAL(avl_tree.insert_front(-key), expected.insert(-key).second);
+    }
+
+    // the finger must follow erasing of the outermost nodes
+    for (int i = 0; i < 100; ++i) {
+        auto max_key = *expected.rbegin();
+        BOOST_REQUIRE(avl_tree.erase(max_key));
+        expected.erase(max_key);
+        BOOST_REQUIRE_EQUAL(avl_tree.insert_back(max_key - 1), expected.insert(max_key - 1).second);
+        auto min_key = *expected.begin();
+        BOOST_REQUIRE(avl_tree.erase(min_key));
+        expected.erase(min_key);
+        BOOST_REQUIRE_EQUAL(avl_tree.insert_front(min_key + 1), expected.insert(min_key + 1).second);
+        BOOST_REQUIRE(!avl_tree.insert_back(*expected.rbegin()));
+        BOOST_REQUIRE(!avl_tree.insert_front(*expected.begin()));
+    }
+
+    BOOST_REQUIRE_EQUAL(avl_tree.size(), expected.size());
+    avl_tree.check_height_test([](int hl, int hr){
+        BOOST_REQUIRE(std::abs(hl-hr) <= 1);
+    });
+    std::vector<KEY_TYPE> enumerated;
+    avl_tree.enumerate([&enumerated](auto& v){
+        enumerated.push_back(v);
+        return true;
+    });
+    BOOST_REQUIRE(std::equal(enumerated.begin(), enumerated.end(), expected.begin(), expected.end()));
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_insert_back_front_opposite) {
+    // insert_back can put the key before the minimum and insert_front after the maximum,
+    // then the finger of the other end has to follow
+    auto check_order = [](binary_tree::tree<int>& tree, const std::set<int>& expected) {
+        std::vector<int> enumerated;
+        tree.enumerate([&enumerated](auto& v){
+            enumerated.push_back(v);
+            return true;
+        });
+        BOOST_REQUIRE(std::equal(enumerated.begin(), enumerated.end(), expected.begin(), expected.end()));
+    };
+
+    {
+        binary_tree::tree<int> tree;
+        std::set<int> expected;
+        for (auto [back, key] : {std::pair{false, 10}, {true, 5}, {false, 7}, {true, 12}, {false, 15}, {true, 11}}) {
+            BOOST_REQUIRE_EQUAL(back ? tree.insert_back(key) : tree.insert_front(key), expected.insert(key).second);
+            check_order(tree, expected);
+        }
+    }
+
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> any_key(0, 1000);
+    for (int run = 0; run < 200; ++run) {
+        binary_tree::tree<int> tree;
+        std::set<int> expected;
+        for (int i = 0; i < 50; ++i) {
+            auto key = any_key(random);
+            auto back = (random() & 1) != 0;
+            BOOST_REQUIRE_EQUAL(back ? tree.insert_back(key) : tree.insert_front(key), expected.insert(key).second);
+            check_order(tree, expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_iterators) {
+    using tree_type = binary_tree::tree<int>;
+    static_assert(std::bidirectional_iterator<tree_type::iterator>);
+    static_assert(std::bidirectional_iterator<tree_type::const_iterator>);
+
+    tree_type avl_tree;
+    BOOST_REQUIRE(avl_tree.begin() == avl_tree.end());
+    std::vector<int> keys;
+    for (int i = 0; i < 1000; ++i) {
+        keys.push_back(i * 2);
+        avl_tree.insert((i * 7919) % 1000 * 2);
+    }
+
+    BOOST_REQUIRE(std::equal(avl_tree.begin(), avl_tree.end(), keys.begin(), keys.end()));
+    BOOST_REQUIRE(std::equal(avl_tree.rbegin(), avl_tree.rend(), keys.rbegin(), keys.rend()));
+    BOOST_REQUIRE_EQUAL(*--avl_tree.end(), keys.back());
+    BOOST_REQUIRE_EQUAL(std::distance(avl_tree.cbegin(), avl_tree.cend()), keys.size());
+
+    for (int key = -3; key < 2003; ++key) {
+        auto lower = std::lower_bound(keys.begin(), keys.end(), key);
+        auto upper = std::upper_bound(keys.begin(), keys.end(), key);
+
+        auto it = avl_tree.lower_bound(key);
+        BOOST_REQUIRE_EQUAL(std::distance(avl_tree.begin(), it), std::distance(keys.begin(), lower));
+        BOOST_REQUIRE(it == avl_tree.end() || *it == *lower);
+        it = avl_tree.upper_bound(key);
+        BOOST_REQUIRE_EQUAL(std::distance(avl_tree.begin(), it), std::distance(keys.begin(), upper));
+        BOOST_REQUIRE(it == avl_tree.end() || *it == *upper);
+
+        auto [first, last] = avl_tree.equal_range(key);
+        BOOST_REQUIRE_EQUAL(std::distance(first, last), std::distance(lower, upper));
+        BOOST_REQUIRE((avl_tree.find(key) != avl_tree.end()) == (lower != upper));
+    }
+
+    // range scan starts at the key
+    auto first = avl_tree.lower_bound(501);
+    auto last = avl_tree.upper_bound(1200);
+    BOOST_REQUIRE(std::equal(first, last,
+                             std::lower_bound(keys.begin(), keys.end(), 501),
+                             std::upper_bound(keys.begin(), keys.end(), 1200)));
+
+    // erasing via iterators
+    for (auto it = avl_tree.begin(); it != avl_tree.end();) {
+        if (*it % 4 == 0) {
+            it = avl_tree.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    BOOST_REQUIRE_EQUAL(avl_tree.size(), 500);
+    BOOST_REQUIRE(std::all_of(avl_tree.begin(), avl_tree.end(), [](int v){ return v % 4 == 2; }));
+
+    binary_tree::tree<int, std::string> avl_map;
+    avl_map.insert({1, "one"});
+    avl_map.insert({2, "two"});
+    avl_map.find(2)->second = "TWO";
+    BOOST_REQUIRE_EQUAL(avl_map.lower_bound(2)->second, "TWO");
+    const auto& const_map = avl_map;
+    BOOST_REQUIRE_EQUAL(const_map.begin()->second, "one");
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_insert_hint) {
+    binary_tree::tree<int>  avl_tree;
+    std::set<int> expected;
+    for (int i = 0; i < 3000; ++i) {
+        auto key = (i * 7919) % 6000;
+        // the hint is the right place, a wrong place or the end
+        auto hint_key = (i % 3 == 0) ? key + 1 : (i % 3 == 1) ? 6000 - key : 10000;
+        auto hint = avl_tree.lower_bound(hint_key);
+        BOOST_REQUIRE_EQUAL(avl_tree.insert(hint, key), expected.insert(key).second);
+        BOOST_REQUIRE(!avl_tree.insert(avl_tree.lower_bound(key), key));
+    }
+    avl_tree.check_height_test([](int hl, int hr){
+        BOOST_REQUIRE(std::abs(hl-hr) <= 1);
+    });
+    BOOST_REQUIRE(std::equal(avl_tree.begin(), avl_tree.end(), expected.begin(), expected.end()));
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_order_statistic) {
+    using os_tree = binary_tree::tree<int, void, binary_tree::avl_balancer, std::compare_three_way,
+                                      std::allocator, binary_tree::order_statistic>;
+    os_tree avl_tree;
+    std::set<int> expected;
+    auto check = [&]() {
+        std::vector<int> sorted(expected.begin(), expected.end());
+        for (std::size_t i = 0; i < sorted.size(); ++i) {
+            auto it = avl_tree.select(i);
+            BOOST_REQUIRE(it != avl_tree.end());
+            BOOST_REQUIRE_EQUAL(*it, sorted[i]);
+            BOOST_REQUIRE_EQUAL(avl_tree.rank(sorted[i]), i);
+            BOOST_REQUIRE_EQUAL(avl_tree.rank(sorted[i] + 1), i + 1);
+        }
+        BOOST_REQUIRE(avl_tree.select(sorted.size()) == avl_tree.end());
+        if (!sorted.empty()) {
+            BOOST_REQUIRE_EQUAL(avl_tree.rank(sorted.front() - 1), 0);
+            // the iterator returned by select is usable to walk the tree
+            auto it = avl_tree.select(sorted.size() / 2);
+            BOOST_REQUIRE(std::equal(it, avl_tree.end(), sorted.begin() + sorted.size() / 2, sorted.end()));
+        }
+    };
+
+    for (int i = 0; i < 2000; ++i) {
+        auto key = (i * 7919) % 4000;
+        BOOST_REQUIRE_EQUAL(avl_tree.insert(key), expected.insert(key).second);
+    }
+    check();
+    for (int i = 0; i < 1500; ++i) {
+        auto key = (i * 104729) % 4000;
+        BOOST_REQUIRE_EQUAL(avl_tree.erase(key), expected.erase(key) == 1);
+    }
+    check();
+    for (int i = 0; i < 500; ++i) {
+        avl_tree.insert_back(4000 + i);
+        expected.insert(4000 + i);
+        avl_tree.insert_front(-2 - i);
+        expected.insert(-2 - i);
+    }
+    avl_tree.erase(avl_tree.select(10));
+    expected.erase(std::next(expected.begin(), 10));
+    check();
+
+    std::vector<int> values(1000);
+    for (int i = 0; i < 1000; ++i) {
+        values[i] = 2 * i;
+    }
+    avl_tree.assign(values.begin(), values.end());
+    expected = std::set<int>(values.begin(), values.end());
+    check();
+}
+
+namespace {
+
+struct total_size {
+    using value_type = std::size_t;
+    static value_type identity() { return 0; }
+    static value_type combine(value_type a, value_type b) { return a + b; }
+    static value_type lift(const auto& v) { return v.second; }
+};
+
+// not commutative, so it checks the order of combining
+struct key_sequence {
+    using value_type = std::vector<int>;
+    static value_type identity() { return {}; }
+    static value_type combine(const value_type& a, const value_type& b) {
+        auto result = a;
+        result.insert(result.end(), b.begin(), b.end());
+        return result;
+    }
+    static value_type lift(int v) { return {v}; }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_range_aggregate) {
+    binary_tree::tree<int, std::size_t, binary_tree::avl_balancer, std::compare_three_way,
+                      std::allocator, binary_tree::aggregate<total_size>> blocks;
+    std::map<int, std::size_t> expected;
+    auto check_sum = [&](int lo, int hi) {
+        std::size_t sum = 0;
+        for (auto it = expected.lower_bound(lo); it != expected.end() && it->first < hi; ++it) {
+            sum += it->second;
+        }
+        BOOST_REQUIRE_EQUAL(blocks.range_aggregate(lo, hi), sum);
+    };
+
+    for (int i = 0; i < 1000; ++i) {
+        auto key = (i * 7919) % 3000;
+        auto size = static_cast<std::size_t>(i % 17 + 1);
+        BOOST_REQUIRE_EQUAL(blocks.insert({key, size}), expected.insert({key, size}).second);
+    }
+    for (int i = 0; i < 400; ++i) {
+        auto key = (i * 104729) % 3000;
+        BOOST_REQUIRE_EQUAL(blocks.erase(key), expected.erase(key) == 1);
+    }
+    for (int lo = -10; lo < 3010; lo += 37) {
+        for (int hi = lo; hi < 3010; hi += 101) {
+            check_sum(lo, hi);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(blocks.range_aggregate(100, 50), 0);
+    blocks.clear();
+    BOOST_REQUIRE_EQUAL(blocks.range_aggregate(0, 3000), 0);
+
+    binary_tree::tree<int, void, binary_tree::avl_balancer, std::compare_three_way,
+                      std::allocator, binary_tree::aggregate<key_sequence>> keys;
+    std::vector<int> sorted;
+    for (int i = 0; i < 300; ++i) {
+        sorted.push_back(3 * i);
+    }
+    keys.assign(sorted.begin(), sorted.end());
+    for (int i = 0; i < 300; i += 7) {
+        keys.insert_back(1000 + i);
+        sorted.push_back(1000 + i);
+    }
+    for (int lo = -1; lo < 1400; lo += 23) {
+        for (int hi = lo; hi < 1400; hi += 61) {
+            std::vector<int> range(std::lower_bound(sorted.begin(), sorted.end(), lo),
+                                   std::lower_bound(sorted.begin(), sorted.end(), hi));
+            BOOST_REQUIRE(keys.range_aggregate(lo, hi) == range);
+        }
+    }
+}
+
+namespace {
+
+template <typename Tree>
+void check_avl(const Tree& tree) {
+    tree.check_height_test([](int hl, int hr){
+        BOOST_REQUIRE(std::abs(hl-hr) <= 1);
+    });
+}
+
+}
+
+template <typename B>
+void check_interval_tree() {
+    binary_tree::interval_tree<int, int, B> tree;
+    std::vector<binary_tree::interval<int>> intervals;
+    for (int i = 0; i < 600; ++i) {
+        int low = (i * 7919) % 1000;
+        intervals.push_back({low, low + 1 + (i * 31) % 97});
+        tree.insert({intervals.back(), i});
+    }
+    // erasing rebalances the tree, the bounds must follow rotations
+    for (int i = 0; i < 600; i += 3) {
+        BOOST_REQUIRE_EQUAL(tree.erase(intervals[i]), 1);
+        intervals[i] = {0, 0};
+    }
+    BOOST_REQUIRE(tree.verify_test());
+    std::erase(intervals, binary_tree::interval<int>{0, 0});
+    std::sort(intervals.begin(), intervals.end());
+
+    for (int lo = -10; lo < 1110; lo += 7) {
+        for (int length : {1, 5, 60}) {
+            std::vector<binary_tree::interval<int>> found;
+            tree.enumerate_overlapping(lo, lo + length, [&found](const auto& item) {
+                found.push_back(item.first);
+                return true;
+            });
+            std::vector<binary_tree::interval<int>> expected;
+            std::copy_if(intervals.begin(), intervals.end(), std::back_inserter(expected), [&](const auto& i) {
+                return i.low < lo + length && lo < i.high;
+            });
+            BOOST_REQUIRE(found == expected);
+        }
+        std::vector<binary_tree::interval<int>> stabbed;
+        tree.enumerate_stabbing(lo, [&stabbed](const auto& item) {
+            stabbed.push_back(item.first);
+            return true;
+        });
+        BOOST_REQUIRE_EQUAL(stabbed.size(), std::count_if(intervals.begin(), intervals.end(), [lo](const auto& i) {
+            return i.low <= lo && lo < i.high;
+        }));
+    }
+
+    int visited = 0;
+    tree.enumerate_stabbing(500, [&visited](const auto&) {
+        return ++visited < 2;
+    });
+    BOOST_REQUIRE_EQUAL(visited, 2);
+}
+
+BOOST_AUTO_TEST_CASE(Interval_Tree) {
+    check_interval_tree<binary_tree::avl_balancer>();
+    check_interval_tree<binary_tree::rb_balancer>();
+    check_interval_tree<binary_tree::wavl_balancer>();
+
+    binary_tree::interval_tree<long> empty;
+    empty.enumerate_stabbing(1L, [](const auto&) {
+        BOOST_FAIL("the tree is empty");
+        return true;
+    });
+    empty.insert({1, 2});
+    int found = 0;
+    empty.enumerate_overlapping(2L, 3L, [&found](const auto&) { return ++found; });
+    empty.enumerate_stabbing(1L, [&found](const auto&) { return ++found; });
+    BOOST_REQUIRE_EQUAL(found, 1);
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_parallel_for_each) {
+    util::work_stealing_pool pool(3);
+    for (int count : {0, 1, 100, 5000, 40000}) {
+        binary_tree::tree<int, long> map;
+        for (int i = 0; i < count; ++i) {
+            map.insert({i, 0});
+        }
+        std::atomic<long> visited = 0;
+        map.parallel_for_each([&visited](auto& item) {
+            item.second = 2 * item.first;
+            ++visited;
+        }, pool);
+        BOOST_REQUIRE_EQUAL(visited.load(), count);
+        for (const auto& [key, value] : map) {
+            BOOST_REQUIRE_EQUAL(value, 2 * key);
+        }
+
+        // the combining isn't commutative, so the order of keys is checked too
+        auto ordered = map.parallel_reduce(std::vector<int>(), [](const auto& item) {
+            return std::vector<int>{item.first};
+        }, [](std::vector<int> a, std::vector<int> b) {
+            a.insert(a.end(), b.begin(), b.end());
+            return a;
+        }, pool);
+        BOOST_REQUIRE_EQUAL(ordered.size(), map.size());
+        BOOST_REQUIRE(std::is_sorted(ordered.begin(), ordered.end()));
+        auto sum = map.parallel_reduce(0L, [](const auto& item) {
+            return item.second;
+        }, std::plus<long>());
+        BOOST_REQUIRE_EQUAL(sum, static_cast<long>(count) * (count - 1));
+    }
+
+    // the exception of any subtree comes out
+    binary_tree::tree<int> tree;
+    for (int i = 0; i < 50000; ++i) {
+        tree.insert(i);
+    }
+    BOOST_REQUIRE_THROW(tree.parallel_for_each([](int key) {
+        if (key == 12345)
+            throw std::runtime_error("failed");
+    }, pool), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_split_join) {
+    using os_tree = binary_tree::tree<int, void, binary_tree::avl_balancer, std::compare_three_way,
+                                      std::allocator, binary_tree::order_statistic>;
+    std::vector<int> values;
+    for (int i = 0; i < 1000; ++i) {
+        values.push_back(3 * i);
+    }
+
+    for (int key : {-1, 0, 1, 3, 300, 301, 1500, 2997, 2998, 5000}) {
+        binary_tree::tree<int> left(values.begin(), values.end());
+        binary_tree::tree<int> right;
+        right.insert(100000);
+        left.split(key, right);
+        check_avl(left);
+        check_avl(right);
+        auto middle = std::lower_bound(values.begin(), values.end(), key);
+        BOOST_REQUIRE_EQUAL(left.size(), static_cast<std::size_t>(middle - values.begin()));
+        BOOST_REQUIRE_EQUAL(right.size(), static_cast<std::size_t>(values.end() - middle));
+        BOOST_REQUIRE(std::equal(left.begin(), left.end(), values.begin(), middle));
+        BOOST_REQUIRE(std::equal(right.begin(), right.end(), middle, values.end()));
+
+        left.join(right);
+        check_avl(left);
+        BOOST_REQUIRE(right.empty());
+        BOOST_REQUIRE_EQUAL(left.size(), values.size());
+        BOOST_REQUIRE(std::equal(left.begin(), left.end(), values.begin(), values.end()));
+    }
+
+    // joining trees of very different heights and keeping augmentation up to date
+    for (int count : {0, 1, 2, 5, 100, 999}) {
+        os_tree left(values.begin(), values.begin() + count);
+        os_tree right(values.begin() + count, values.end());
+        left.join(right);
+        check_avl(left);
+        BOOST_REQUIRE_EQUAL(left.size(), values.size());
+        for (std::size_t i = 0; i < values.size(); i += 7) {
+            BOOST_REQUIRE_EQUAL(*left.select(i), values[i]);
+        }
+        left.split(values[count], right);
+        BOOST_REQUIRE_EQUAL(left.size(), count);
+        BOOST_REQUIRE_EQUAL(right.size(), values.size() - count);
+        BOOST_REQUIRE_EQUAL(right.rank(values.back()), values.size() - count - 1);
+    }
+
+    // the tree stays usable after split
+    binary_tree::tree<int> left(values.begin(), values.end());
+    binary_tree::tree<int> right;
+    left.split(1500, right);
+    BOOST_REQUIRE(left.insert(1501));
+    BOOST_REQUIRE(left.erase(0));
+    BOOST_REQUIRE(left.insert_back(1502));
+    BOOST_REQUIRE_EQUAL(left.size(), 501);
+    check_avl(left);
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_erase_range) {
+    using os_tree = binary_tree::tree<int, void, binary_tree::avl_balancer, std::compare_three_way,
+                                      std::allocator, binary_tree::order_statistic>;
+    std::vector<int> values;
+    for (int i = 0; i < 1000; ++i) {
+        values.push_back(3 * i);
+    }
+
+    for (auto [lo, hi] : {std::pair{-5, 0}, std::pair{-5, 1}, std::pair{0, 1500}, std::pair{1, 1501},
+                          std::pair{300, 303}, std::pair{301, 302}, std::pair{1500, 5000}, std::pair{-1, 5000},
+                          std::pair{2000, 1000}, std::pair{300, 300}, std::pair{303, 300}, std::pair{0, 0}}) {
+        binary_tree::tree<int> tree(values.begin(), values.end());
+        os_tree augmented(values.begin(), values.end());
+        std::vector<int> expected;
+        std::copy_if(values.begin(), values.end(), std::back_inserter(expected), [lo, hi](int v) {
+            return v < lo || v >= hi;
+        });
+        auto removed = values.size() - expected.size();
+
+        BOOST_REQUIRE_EQUAL(tree.erase_range(lo, hi), removed);
+        check_avl(tree);
+        BOOST_REQUIRE_EQUAL(tree.size(), expected.size());
+        BOOST_REQUIRE(std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()));
+
+        BOOST_REQUIRE_EQUAL(augmented.erase_range(lo, hi), removed);
+        BOOST_REQUIRE_EQUAL(augmented.size(), expected.size());
+        for (std::size_t i = 0; i < expected.size(); i += 7) {
+            BOOST_REQUIRE_EQUAL(*augmented.select(i), expected[i]);
+        }
+    }
+
+    // the map destroys the mapped values and the tree stays usable
+    binary_tree::tree<int, std::string> map;
+    for (int i = 0; i < 100; ++i) {
+        map.insert({i, std::to_string(i)});
+    }
+    BOOST_REQUIRE_EQUAL(map.erase_range(0, 90), 90);
+    BOOST_REQUIRE(map.insert({5, "5"}));
+    BOOST_REQUIRE_EQUAL(map.size(), 11);
+    BOOST_REQUIRE_EQUAL(map.find(95)->second, "95");
+    check_avl(map);
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_erase_if) {
+    using os_tree = binary_tree::tree<int, void, binary_tree::avl_balancer, std::compare_three_way,
+                                      std::allocator, binary_tree::order_statistic>;
+    std::vector<int> values;
+    for (int i = 0; i < 1000; ++i) {
+        values.push_back(i);
+    }
+
+    for (int modulo : {1, 2, 3, 7, 1000, 2000}) {
+        auto pred = [modulo](int v) {
+            return v % modulo == 0 || (v > 200 && v < 700);
+        };
+        std::vector<int> expected;
+        std::remove_copy_if(values.begin(), values.end(), std::back_inserter(expected), pred);
+
+        os_tree tree(values.begin(), values.end());
+        BOOST_REQUIRE_EQUAL(tree.erase_if(pred), values.size() - expected.size());
+        check_avl(tree);
+        BOOST_REQUIRE_EQUAL(tree.size(), expected.size());
+        BOOST_REQUIRE(std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()));
+        for (std::size_t i = 0; i < expected.size(); i += 7) {
+            BOOST_REQUIRE_EQUAL(*tree.select(i), expected[i]);
+        }
+    }
+
+    // the elements checked before the exception are removed, the rest are kept
+    binary_tree::tree<int> tree(values.begin(), values.end());
+    BOOST_CHECK_THROW(tree.erase_if([](int v) {
+        if (v == 500)
+            throw std::runtime_error("stop");
+        return v % 2 == 0;
+    }), std::runtime_error);
+    check_avl(tree);
+    BOOST_REQUIRE_EQUAL(tree.size(), 750);
+    BOOST_REQUIRE(!tree.contains(498));
+    BOOST_REQUIRE(tree.contains(499));
+    BOOST_REQUIRE(tree.contains(500));
+    BOOST_REQUIRE(tree.contains(502));
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_set_operations) {
+    using tree_type = binary_tree::tree<int>;
+    auto fill = [](tree_type& tree, std::set<int>& expected, int count, int step, int modulo) {
+        for (int i = 0; i < count; ++i) {
+            auto key = static_cast<int>((static_cast<long>(i) * step) % modulo);
+            tree.insert(key);
+            expected.insert(key);
+        }
+    };
+    // small, unbalanced and big (parallel) cases
+    for (auto [count_a, count_b] : {std::pair{0, 100}, std::pair{100, 0}, std::pair{10, 3000},
+                                    std::pair{3000, 10}, std::pair{3000, 3000}, std::pair{200000, 150000}}) {
+        for (auto policy : {tree_type::ExecutionPolicy::SEQUENTIAL, tree_type::ExecutionPolicy::PARALLEL}) {
+            std::set<int> a_set;
+            std::set<int> b_set;
+            tree_type a;
+            tree_type b;
+            fill(a, a_set, count_a, 7919, 4 * count_a + 1);
+            fill(b, b_set, count_b, 104729, 3 * count_b + 1);
+
+            std::vector<int> expected;
+            std::set_union(a_set.begin(), a_set.end(), b_set.begin(), b_set.end(), std::back_inserter(expected));
+            tree_type u;
+            tree_type other;
+            u.assign(a_set.begin(), a_set.end());
+            other.assign(b_set.begin(), b_set.end());
+            u.set_union(other, policy);
+            BOOST_REQUIRE(other.empty());
+            BOOST_REQUIRE_EQUAL(u.size(), expected.size());
+            BOOST_REQUIRE(std::equal(u.begin(), u.end(), expected.begin(), expected.end()));
+            check_avl(u);
+
+            expected.clear();
+            std::set_intersection(a_set.begin(), a_set.end(), b_set.begin(), b_set.end(), std::back_inserter(expected));
+            tree_type i;
+            other.assign(b_set.begin(), b_set.end());
+            i.assign(a_set.begin(), a_set.end());
+            i.set_intersection(other, policy);
+            BOOST_REQUIRE_EQUAL(i.size(), expected.size());
+            BOOST_REQUIRE(std::equal(i.begin(), i.end(), expected.begin(), expected.end()));
+            check_avl(i);
+
+            expected.clear();
+            std::set_difference(a_set.begin(), a_set.end(), b_set.begin(), b_set.end(), std::back_inserter(expected));
+            a.set_difference(b, policy);
+            BOOST_REQUIRE(b.empty());
+            BOOST_REQUIRE_EQUAL(a.size(), expected.size());
+            BOOST_REQUIRE(std::equal(a.begin(), a.end(), expected.begin(), expected.end()));
+            check_avl(a);
+        }
+    }
+
+    // map keeps the mapped values of this tree
+    binary_tree::tree<int, std::string> map_a;
+    binary_tree::tree<int, std::string> map_b;
+    for (int i = 0; i < 100; ++i) {
+        map_a.insert({2 * i, "a"});
+        map_b.insert({3 * i, "b"});
+    }
+    map_a.set_union(map_b);
+    BOOST_REQUIRE_EQUAL(map_a.size(), 166);
+    BOOST_REQUIRE_EQUAL(map_a.find(6)->second, "a");
+    BOOST_REQUIRE_EQUAL(map_a.find(3)->second, "b");
+}
+
+struct counted {
+    static inline int constructed = 0;
+    std::string text;
+    explicit counted(std::string t)
+        : text(std::move(t)) {
+        ++constructed;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_emplace_extract) {
+    binary_tree::tree<int, std::string> map;
+    using value_type = binary_tree::tree<int, std::string>::value_type;
+    value_type item(1, std::string(100, 'a'));
+    BOOST_REQUIRE(map.insert(std::move(item)));
+    BOOST_REQUIRE(item.second.empty());
+    value_type same_key(1, std::string(100, 'b'));
+    BOOST_REQUIRE(!map.insert(std::move(same_key)));
+    // the value isn't moved when the key is in the tree
+    BOOST_REQUIRE_EQUAL(same_key.second, std::string(100, 'b'));
+    BOOST_REQUIRE_EQUAL(map.find(1)->second, std::string(100, 'a'));
+
+    BOOST_REQUIRE(map.emplace(2, "two"));
+    BOOST_REQUIRE(!map.emplace(2, "other"));
+    BOOST_REQUIRE_EQUAL(map.find(2)->second, "two");
+
+    binary_tree::tree<int, counted> counted_map;
+    BOOST_REQUIRE(counted_map.try_emplace(1, "one"));
+    BOOST_REQUIRE(!counted_map.try_emplace(1, "another one"));
+    BOOST_REQUIRE_EQUAL(counted::constructed, 1);
+    BOOST_REQUIRE_EQUAL(counted_map.find(1)->second.text, "one");
+    int key = 2;
+    BOOST_REQUIRE(counted_map.try_emplace(std::move(key), "two"));
+    BOOST_REQUIRE_EQUAL(counted::constructed, 2);
+
+    // re-keying reuses the node
+    for (int i = 3; i < 100; ++i) {
+        map.try_emplace(i, std::to_string(i));
+    }
+    auto handle = map.extract(50);
+    BOOST_REQUIRE(handle);
+    BOOST_REQUIRE(!map.contains(50));
+    BOOST_REQUIRE_EQUAL(map.size(), 98);
+    BOOST_REQUIRE(map.extract(50).empty());
+    auto* mapped = &handle.mapped();
+    handle.key() = 150;
+    BOOST_REQUIRE(map.insert(std::move(handle)));
+    BOOST_REQUIRE(handle.empty());
+    BOOST_REQUIRE_EQUAL(&map.find(150)->second, mapped);
+    BOOST_REQUIRE_EQUAL(map.find(150)->second, "50");
+    BOOST_REQUIRE(map.verify_test());
+
+    // the node stays in the handle when the key is in the tree
+    handle = map.extract(map.find(20));
+    handle.key() = 21;
+    BOOST_REQUIRE(!map.insert(std::move(handle)));
+    BOOST_REQUIRE(!handle.empty());
+    binary_tree::tree<int, std::string> other;
+    BOOST_REQUIRE(other.insert(std::move(handle)));
+    BOOST_REQUIRE_EQUAL(other.find(21)->second, "20");
+    BOOST_REQUIRE(!other.insert(std::move(handle)));
+
+    // extracted nodes are reset, so augmentation and balance are valid after the reinsertion
+    binary_tree::tree<int, void, binary_tree::rb_balancer, std::compare_three_way, std::allocator, binary_tree::order_statistic> os_tree;
+    for (int i = 0; i < 200; ++i) {
+        os_tree.insert(i);
+    }
+    for (int i = 0; i < 200; i += 3) {
+        auto node = os_tree.extract(i);
+        node.value() = i + 1000;
+        BOOST_REQUIRE(os_tree.insert(std::move(node)));
+    }
+    BOOST_REQUIRE(os_tree.verify_test());
+    std::size_t index = 0;
+    for (auto value : os_tree) {
+        BOOST_REQUIRE_EQUAL(*os_tree.select(index), value);
+        BOOST_REQUIRE_EQUAL(os_tree.rank(value), index);
+        ++index;
+    }
+    // this handle is destroyed with its node
+    BOOST_REQUIRE(os_tree.extract(1000));
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_batch_lookup) {
+    binary_tree::tree<int, std::string> map;
+    std::vector<int> keys;
+    std::vector<bool> found;
+    std::vector<const std::pair<const int, std::string>*> values;
+    map.contains_batch(keys.begin(), keys.end(), found.begin());
+    for (int count : {1, 5, 16, 17, 1000}) {
+        keys.clear();
+        for (int i = 0; i < count; ++i) {
+            keys.push_back((i * 7919) % 3001 - 500);
+        }
+        found.assign(keys.size(), false);
+        values.assign(keys.size(), nullptr);
+        map.contains_batch(keys.begin(), keys.end(), found.begin());
+        map.find_batch(keys.begin(), keys.end(), values.begin());
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            BOOST_REQUIRE_EQUAL(found[i], map.contains(keys[i]));
+            if (found[i]) {
+                BOOST_REQUIRE_EQUAL(values[i], &*map.find(keys[i]));
+            } else {
+                BOOST_REQUIRE(values[i] == nullptr);
+            }
+        }
+        for (int i = 0; i < 200; ++i) {
+            map.insert({i * 5, std::to_string(i)});
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(AVL_Tree_freeze) {
+    for (int count : {0, 1, 2, 3, 7, 8, 9, 100, 1000}) {
+        binary_tree::tree<int> tree;
+        for (int i = 0; i < count; ++i) {
+            tree.insert(3 * i);
+        }
+        auto frozen = tree.freeze();
+        BOOST_REQUIRE_EQUAL(frozen.size(), tree.size());
+        for (int key = -2; key < 3 * count + 2; ++key) {
+            BOOST_REQUIRE_EQUAL(frozen.count(key), tree.count(key));
+            auto bound = frozen.lower_bound(key);
+            if (key > 3 * (count - 1)) {
+                BOOST_REQUIRE(bound == nullptr);
+            } else {
+                BOOST_REQUIRE(bound != nullptr);
+                BOOST_REQUIRE_EQUAL(*bound, *tree.lower_bound(key));
+            }
+        }
+
+        std::vector<int> keys;
+        frozen.enumerate([&keys](int key) {
+            keys.push_back(key);
+            return true;
+        }, decltype(frozen)::EnumerationOrder::DESCENDING);
+        BOOST_REQUIRE(std::equal(keys.begin(), keys.end(), tree.rbegin(), tree.rend()));
+    }
+
+    binary_tree::tree<std::string, int> map;
+    for (int i = 0; i < 500; ++i) {
+        map.insert({std::to_string(i), i});
+    }
+    auto frozen_map = map.freeze();
+    for (int i = 0; i < 500; ++i) {
+        BOOST_REQUIRE_EQUAL(frozen_map.at(std::to_string(i)), i);
+    }
+    BOOST_REQUIRE(!frozen_map.contains(std::string("500")));
+    BOOST_REQUIRE_THROW(frozen_map.at(std::string("x")), std::out_of_range);
+    int visited = 0;
+    frozen_map.enumerate([&visited, &map](const auto& item) {
+        BOOST_REQUIRE_EQUAL(map.find(item.first)->second, item.second);
+        return ++visited < 100;
+    });
+    BOOST_REQUIRE_EQUAL(visited, 100);
+}
+
+using balancers = std::tuple<binary_tree::avl_balancer, binary_tree::rb_balancer, binary_tree::wavl_balancer>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(Balancer_insert_erase, B, balancers) {
+    binary_tree::tree<int, void, B> tree;
+    std::set<int> expected;
+    auto check = [&]() {
+        BOOST_REQUIRE(tree.verify_test());
+        BOOST_REQUIRE_EQUAL(tree.size(), expected.size());
+        BOOST_REQUIRE(std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()));
+    };
+
+    for (int i = 0; i < 5000; ++i) {
+        auto key = (i * 7919) % 10007;
+        BOOST_REQUIRE_EQUAL(tree.insert(key), expected.insert(key).second);
+        if (i % 500 == 0) {
+            check();
+        }
+    }
+    check();
+    // erase heavy mix
+    for (int i = 0; i < 20000; ++i) {
+        auto key = (i * 104729) % 10007;
+        if (i % 3 == 0) {
+            BOOST_REQUIRE_EQUAL(tree.insert(key), expected.insert(key).second);
+        } else {
+            BOOST_REQUIRE_EQUAL(tree.erase(key), expected.erase(key));
+        }
+        if (i % 1000 == 0) {
+            check();
+        }
+    }
+    check();
+    for (int i = 0; i < 2000; ++i) {
+        tree.insert_back(20000 + i);
+        expected.insert(20000 + i);
+        tree.insert_front(-1 - i);
+        expected.insert(-1 - i);
+    }
+    check();
+    while (!expected.empty()) {
+        auto key = *std::next(expected.begin(), expected.size() / 2);
+        BOOST_REQUIRE(tree.erase(key));
+        expected.erase(key);
+        if (expected.size() % 997 == 0) {
+            check();
+        }
+    }
+    check();
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(Balancer_sorted_build, B, balancers) {
+    for (int count : {0, 1, 2, 3, 4, 7, 8, 100, 1023, 1024, 1025}) {
+        std::vector<int> values(count);
+        for (int i = 0; i < count; ++i) {
+            values[i] = 2 * i;
+        }
+        binary_tree::tree<int, void, B> tree(values.begin(), values.end());
+        BOOST_REQUIRE(tree.verify_test());
+        for (int i = 0; i < count; ++i) {
+            BOOST_REQUIRE(tree.insert(2 * i + 1));
+        }
+        BOOST_REQUIRE(tree.verify_test());
+        for (int i = 0; i < count; i += 2) {
+            BOOST_REQUIRE(tree.erase(2 * i));
+        }
+        BOOST_REQUIRE(tree.verify_test());
+    }
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(Balancer_order_statistic, B, balancers) {
+    binary_tree::tree<int, void, B, std::compare_three_way, std::allocator, binary_tree::order_statistic> tree;
+    std::set<int> expected;
+    for (int i = 0; i < 3000; ++i) {
+        auto key = (i * 7919) % 4001;
+        tree.insert(key);
+        expected.insert(key);
+        if (i % 2 == 1) {
+            auto erased = (i * 104729) % 4001;
+            BOOST_REQUIRE_EQUAL(tree.erase(erased), expected.erase(erased));
+        }
+    }
+    BOOST_REQUIRE(tree.verify_test());
+    std::size_t index = 0;
+    for (auto key : expected) {
+        BOOST_REQUIRE_EQUAL(*tree.select(index), key);
+        BOOST_REQUIRE_EQUAL(tree.rank(key), index);
+        ++index;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Compact_Tree) {
+    static_assert(binary_tree::compact_tree<int>::node_size == 12);
+
+    binary_tree::compact_tree<int> tree;
+    std::set<int> expected;
+    BOOST_REQUIRE(tree.empty());
+    BOOST_REQUIRE_EQUAL(tree.erase(1), 0);
+    for (int i = 0; i < 5000; ++i) {
+        auto key = (i * 7919) % 6007;
+        BOOST_REQUIRE_EQUAL(tree.insert(key), expected.insert(key).second);
+        if (i % 3 == 2) {
+            auto erased = (i * 104729) % 6007;
+            BOOST_REQUIRE_EQUAL(tree.erase(erased), expected.erase(erased));
+        }
+    }
+    BOOST_REQUIRE(tree.verify_test());
+    BOOST_REQUIRE_EQUAL(tree.size(), expected.size());
+    for (int key = -1; key < 6010; ++key) {
+        BOOST_REQUIRE_EQUAL(tree.contains(key), expected.count(key) != 0);
+    }
+
+    std::vector<int> keys;
+    tree.enumerate([&keys](int key) {
+        keys.push_back(key);
+        return true;
+    });
+    BOOST_REQUIRE(std::equal(keys.begin(), keys.end(), expected.begin(), expected.end()));
+    keys.clear();
+    tree.enumerate([&keys](int key) {
+        keys.push_back(key);
+        return keys.size() < 10;
+    }, binary_tree::compact_tree<int>::EnumerationOrder::DESCENDING);
+    BOOST_REQUIRE(std::equal(keys.begin(), keys.end(), expected.rbegin(), std::next(expected.rbegin(), 10)));
+
+    // erased nodes are reused
+    auto capacity = tree.capacity();
+    for (auto key : expected) {
+        BOOST_REQUIRE_EQUAL(tree.erase(key), 1);
+    }
+    BOOST_REQUIRE(tree.empty());
+    for (auto key : expected) {
+        BOOST_REQUIRE(tree.insert(key));
+    }
+    BOOST_REQUIRE(tree.verify_test());
+    BOOST_REQUIRE_EQUAL(tree.capacity(), capacity);
+
+    tree.clear();
+    BOOST_REQUIRE(tree.empty());
+    BOOST_REQUIRE_EQUAL(tree.size(), 0);
+    BOOST_REQUIRE(!tree.contains(0));
+}
+
+BOOST_AUTO_TEST_CASE(Compact_Tree_sorted_build) {
+    for (int count : {0, 1, 2, 3, 4, 7, 8, 100, 1023, 1024, 1025}) {
+        std::vector<int> values(count);
+        for (int i = 0; i < count; ++i) {
+            values[i] = 2 * i;
+        }
+        binary_tree::compact_tree<int> tree(values.begin(), values.end());
+        BOOST_REQUIRE(tree.verify_test());
+        BOOST_REQUIRE_EQUAL(tree.size(), values.size());
+        for (int i = 0; i < count; ++i) {
+            BOOST_REQUIRE(tree.insert(2 * i + 1));
+        }
+        BOOST_REQUIRE(tree.verify_test());
+        for (int i = 0; i < count; i += 2) {
+            BOOST_REQUIRE_EQUAL(tree.erase(2 * i), 1);
+        }
+        BOOST_REQUIRE(tree.verify_test());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Concurrent_Tree) {
+    binary_tree::concurrent_tree<int> tree;
+    std::set<int> expected;
+    for (int i = 0; i < 3000; ++i) {
+        auto key = (i * 7919) % 1009;
+        if (i % 3 == 2) {
+            BOOST_REQUIRE_EQUAL(tree.erase(key), expected.erase(key));
+        } else {
+            BOOST_REQUIRE_EQUAL(tree.insert(key), expected.insert(key).second);
+        }
+        BOOST_REQUIRE_EQUAL(tree.size(), expected.size());
+    }
+    BOOST_REQUIRE(tree.verify_test());
+    for (int key = -1; key <= 1009; ++key) {
+        BOOST_REQUIRE_EQUAL(tree.count(key), expected.count(key));
+    }
+    std::vector<int> keys;
+    tree.enumerate([&keys](int key) {
+        keys.push_back(key);
+        return true;
+    }, decltype(tree)::EnumerationOrder::DESCENDING);
+    BOOST_REQUIRE(std::equal(keys.begin(), keys.end(), expected.rbegin(), expected.rend()));
+    tree.clear();
+    BOOST_REQUIRE(tree.empty());
+    BOOST_REQUIRE(!tree.contains(keys.front()));
+
+    binary_tree::concurrent_tree<std::string, int> map;
+    for (int i = 0; i < 100; ++i) {
+        BOOST_REQUIRE(map.insert({std::to_string(i), i}));
+    }
+    BOOST_REQUIRE(!map.insert({"7", 0}));
+    BOOST_REQUIRE(map.visit(std::string("7"), [](const auto& item) {
+        BOOST_REQUIRE_EQUAL(item.second, 7);
+    }));
+    BOOST_REQUIRE(!map.visit(std::string("x"), [](const auto&) {}));
+}
+
+BOOST_AUTO_TEST_CASE(Concurrent_Tree_readers) {
+    // readers must always find the even keys while the writer inserts and erases the odd ones
+    binary_tree::concurrent_tree<int> tree;
+    constexpr int count = 2000;
+    for (int i = 0; i < count; i += 2) {
+        tree.insert(i);
+    }
+    std::atomic<bool> done = false;
+    std::atomic<int>  failures = 0;
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&tree, &done, &failures, r] {
+            for (int pass = 0; !done.load(); ++pass) {
+                for (int i = r * 2; i < count; i += 6) {
+                    if (!tree.contains(i))
+                        ++failures;
+                }
+                int previous = -1;
+                int even = 0;
+                tree.enumerate([&](int key) {
+                    if (key <= previous)
+                        ++failures;
+                    previous = key;
+                    even += key % 2 == 0 ? 1 : 0;
+                    return true;
+                });
+                if (even != count / 2)
+                    ++failures;
+            }
+        });
+    }
+    // reclaim() of another thread is serialized with the writer
+    std::thread reclaimer([&tree, &done] {
+        while (!done.load()) {
+            tree.reclaim();
+            std::this_thread::yield();
+        }
+    });
+    for (int pass = 0; pass < 20; ++pass) {
+        for (int i = 1; i < count; i += 2) {
+            tree.insert(i);
+        }
+        for (int i = 1; i < count; i += 2) {
+            tree.erase(i);
+        }
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    reclaimer.join();
+    BOOST_REQUIRE_EQUAL(failures.load(), 0);
+    BOOST_REQUIRE_EQUAL(tree.size(), count / 2);
+    BOOST_REQUIRE(tree.verify_test());
+}
+
+BOOST_AUTO_TEST_CASE(Concurrent_Tree_long_reader) {
+    binary_tree::concurrent_tree<int> tree;
+    constexpr int count = 100;
+    for (int i = 0; i < count; ++i) {
+        tree.insert(i);
+    }
+    // the reader stays in its enumeration while the writer replaces many times reclaim_threshold nodes
+    std::atomic<bool> entered = false;
+    std::atomic<bool> release = false;
+    int seen = 0;
+    std::thread reader([&] {
+        tree.enumerate([&](int) {
+            if (!entered.exchange(true)) {
+                while (!release.load()) {
+                    std::this_thread::yield();
+                }
+            }
+            ++seen;
+            return true;
+        });
+    });
+    while (!entered.load()) {
+        std::this_thread::yield();
+    }
+    for (int pass = 0; pass < 50; ++pass) {
+        for (int i = count; i < 2 * count; ++i) {
+            tree.insert(i);
+        }
+        for (int i = count; i < 2 * count; ++i) {
+            tree.erase(i);
+        }
+        tree.reclaim();
+    }
+    release = true;
+    reader.join();
+    BOOST_REQUIRE_EQUAL(seen, count);
+
+    // a visitor can write, it keeps its own snapshot
+    BOOST_REQUIRE(tree.visit(0, [&tree](int) {
+        tree.insert(-1);
+        tree.reclaim();
+    }));
+    BOOST_REQUIRE(tree.contains(-1));
+    tree.reclaim();
+    BOOST_REQUIRE_EQUAL(tree.size(), count + 1);
+    BOOST_REQUIRE(tree.verify_test());
+}
+
+BOOST_AUTO_TEST_CASE(Mapped_Tree) {
+    // a unique name, so concurrent runs of the test don't overwrite the file of each other
+    auto name = "futils_mapped_tree_test_" + std::to_string(std::random_device{}()) + ".bin";
+    auto path = (std::filesystem::temp_directory_path() / name).string();
+    for (int count : {0, 1, 2, 7, 8, 1000}) {
+        binary_tree::tree<int> tree;
+        for (int i = 0; i < count; ++i) {
+            tree.insert(3 * i);
+        }
+        binary_tree::mapped_tree<int>::save(tree, path);
+        binary_tree::mapped_tree<int> mapped(path);
+        BOOST_REQUIRE_EQUAL(mapped.size(), tree.size());
+        for (int key = -2; key < 3 * count + 2; ++key) {
+            BOOST_REQUIRE_EQUAL(mapped.count(key), tree.count(key));
+            auto bound = mapped.lower_bound(key);
+            if (key > 3 * (count - 1)) {
+                BOOST_REQUIRE(bound == nullptr);
+            } else {
+                BOOST_REQUIRE_EQUAL(*bound, *tree.lower_bound(key));
+            }
+        }
+        std::vector<int> keys;
+        mapped.enumerate([&keys](int key) {
+            keys.push_back(key);
+            return true;
+        });
+        BOOST_REQUIRE(std::equal(keys.begin(), keys.end(), tree.begin(), tree.end()));
+    }
+
+    std::map<uint64_t, double> map;
+    for (uint64_t i = 0; i < 500; ++i) {
+        map[i * i] = static_cast<double>(i) / 2;
+    }
+    binary_tree::mapped_tree<uint64_t, double>::save(map, path);
+    auto mapped_map = binary_tree::mapped_tree<uint64_t, double>(path);
+    for (const auto& [key, value] : map) {
+        BOOST_REQUIRE_EQUAL(mapped_map.at(key), value);
+    }
+    BOOST_REQUIRE_THROW(mapped_map.at(uint64_t{2}), std::out_of_range);
+    int visited = 0;
+    mapped_map.enumerate([&visited](const auto& item) {
+        BOOST_REQUIRE_EQUAL(item.first, static_cast<uint64_t>(visited) * visited);
+        return ++visited < 10;
+    }, decltype(mapped_map)::EnumerationOrder::ASCENDING);
+    BOOST_REQUIRE_EQUAL(visited, 10);
+
+    // the file of other types or a damaged file isn't mapped
+    BOOST_REQUIRE_THROW(binary_tree::mapped_tree<int>{path}, std::runtime_error);
+    BOOST_REQUIRE_THROW((binary_tree::mapped_tree<uint64_t, float>{path}), std::runtime_error);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+    BOOST_REQUIRE_THROW((binary_tree::mapped_tree<uint64_t, double>{path}), std::runtime_error);
+    std::filesystem::remove(path);
+    BOOST_REQUIRE_THROW(binary_tree::mapped_tree<int>{path}, std::system_error);
+}
+
+struct alive {
+    static inline int count = 0;
+    int value;
+    alive(int v)
+        : value(v) {
+        ++count;
+    }
+    alive(const alive& other)
+        : value(other.value) {
+        ++count;
+    }
+    alive& operator=(const alive&) = default;
+    ~alive() {
+        --count;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(Persistent_Tree) {
+    binary_tree::persistent_tree<int> tree;
+    std::set<int> expected;
+    std::vector<std::pair<binary_tree::persistent_tree<int>, std::set<int>>> versions;
+    for (int i = 0; i < 3000; ++i) {
+        auto key = (i * 7919) % 1009;
+        if (i % 3 == 2) {
+            BOOST_REQUIRE_EQUAL(tree.erase(key), expected.erase(key));
+        } else {
+            BOOST_REQUIRE_EQUAL(tree.insert(key), expected.insert(key).second);
+        }
+        if (i % 100 == 0) {
+            versions.emplace_back(tree.snapshot(), expected);
+            BOOST_REQUIRE(versions.back().first.shares_root_test(tree));
+        }
+    }
+    versions.emplace_back(tree, expected);
+    tree.clear();
+    BOOST_REQUIRE(tree.empty());
+    for (const auto& [version, keys] : versions) {
+        BOOST_REQUIRE(version.verify_test());
+        BOOST_REQUIRE_EQUAL(version.size(), keys.size());
+        std::vector<int> enumerated;
+        version.enumerate([&enumerated](int key) {
+            enumerated.push_back(key);
+            return true;
+        });
+        BOOST_REQUIRE(std::equal(enumerated.begin(), enumerated.end(), keys.begin(), keys.end()));
+    }
+
+    binary_tree::persistent_tree<std::string, int> map;
+    map.insert({"one", 1});
+    auto old_map = map;
+    map.erase("one");
+    map.insert({"one", 2});
+    BOOST_REQUIRE_EQUAL(old_map.at(std::string("one")), 1);
+    BOOST_REQUIRE_EQUAL(map.find(std::string("one"))->second, 2);
+    BOOST_REQUIRE_THROW(map.at(std::string("two")), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(Persistent_Tree_sharing) {
+    {
+        binary_tree::persistent_tree<int, alive> tree;
+        for (int i = 0; i < 1024; ++i) {
+            tree.insert({i, i});
+        }
+        BOOST_REQUIRE_EQUAL(alive::count, 1024);
+        // nothing is copied without snapshots
+        for (int i = 0; i < 1024; i += 2) {
+            tree.erase(i);
+            tree.insert({i, i});
+        }
+        BOOST_REQUIRE_EQUAL(alive::count, 1024);
+
+        auto snapshot = tree.snapshot();
+        BOOST_REQUIRE_EQUAL(alive::count, 1024);
+        tree.insert({5000, 5000});
+        // the path and the rotated nodes are copied only
+        BOOST_REQUIRE_GT(alive::count, 1024);
+        BOOST_REQUIRE_LT(alive::count, 1024 + 2 * 12);
+        BOOST_REQUIRE(!snapshot.contains(5000));
+        BOOST_REQUIRE(tree.contains(5000));
+
+        int visited = 0;
+        std::thread reader([snapshot, &visited] {
+            snapshot.enumerate([&visited](const auto& item) {
+                visited += item.second.value < 1024 ? 1 : 0;
+                return true;
+            });
+        });
+        for (int i = 0; i < 1024; ++i) {
+            tree.erase(i);
+        }
+        reader.join();
+        BOOST_REQUIRE_EQUAL(visited, 1024);
+        BOOST_REQUIRE_EQUAL(tree.size(), 1);
+        BOOST_REQUIRE_EQUAL(snapshot.size(), 1024);
+
+        // the nodes that only the snapshot refers to are freed with it
+        snapshot = tree;
+        BOOST_REQUIRE_EQUAL(alive::count, 1);
+    }
+    BOOST_REQUIRE_EQUAL(alive::count, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,348 @@
+#pragma once
+
+/**
+ * The harness of tree_benchmark and trie_benchmark: workloads of timed phases, batch timing, percentiles,
+ * the table and the JSON output and the command line.
+ *
+ * A benchmark defines its config that derives from benchmark::config and has
+ *  - key_type and benchmark_name,
+ *  - make_workload(name, n) that generates the keys,
+ *  - parse_option(option, value), usage_options and write_json_config(out) for its own options,
+ * and passes the table of its containers to benchmark::run().
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace benchmark {
+
+enum class op_kind : uint8_t {
+    INSERT,
+    ERASE,
+    LOOKUP,
+};
+
+template <typename Key>
+struct operation {
+    op_kind kind;
+    Key     key;
+};
+
+/**
+ * @brief phase is a sequence of operations that is timed as one result
+ */
+template <typename Key>
+struct phase {
+    std::string                 name;
+    std::vector<operation<Key>> operations;
+};
+
+/**
+ * @brief workload fills the container with preload keys (not timed) and then runs its phases one by one
+ */
+template <typename Key>
+struct workload {
+    std::string             name;
+    std::vector<Key>        preload;
+    std::vector<phase<Key>> phases;
+};
+
+/// The options of every benchmark, workloads are the default ones and also all known ones
+struct config {
+    std::vector<std::size_t> sizes       = {1000, 100000};
+    std::size_t              repetitions = 5;
+    std::size_t              batch       = 256;
+    uint64_t                 seed        = 1;
+    std::vector<std::string> workloads;
+    std::vector<std::string> containers;
+    std::string              json_path;
+};
+
+struct result {
+    std::string container;
+    std::string workload;
+    std::string phase;
+    std::size_t size;
+    std::size_t operations;
+    /// found keys and successful inserts/erases, the same for all containers when they are correct
+    std::size_t hits;
+    double      mean = 0;
+    double      p50  = 0;
+    double      p90  = 0;
+    double      p99  = 0;
+    double      max  = 0;
+};
+
+inline std::vector<std::string> split_list(std::string_view text, char separator) {
+    std::vector<std::string> items;
+    while (!text.empty()) {
+        auto end = text.find(separator);
+        items.emplace_back(text.substr(0, end));
+        text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+    }
+    return items;
+}
+
+template <typename Key>
+std::vector<operation<Key>> operations_of(op_kind kind, const std::vector<Key>& keys) {
+    std::vector<operation<Key>> operations;
+    operations.reserve(keys.size());
+    for (const auto& key : keys) {
+        operations.push_back({kind, key});
+    }
+    return operations;
+}
+
+/**
+ * @brief run_operation
+ * @return 1 for a found key and a successful insert or erase. Containers whose insert returns nothing
+ * count every insert as successful, so their workloads insert distinct keys only.
+ */
+template <typename Set, typename Key>
+std::size_t run_operation(Set& set, const operation<Key>& op) {
+    switch (op.kind) {
+    case op_kind::INSERT:
+        if constexpr (requires { set.insert(op.key).second; }) {
+            return set.insert(op.key).second ? 1 : 0;
+        } else if constexpr (requires { { set.insert(op.key) } -> std::convertible_to<bool>; }) {
+            return set.insert(op.key) ? 1 : 0;
+        } else {
+            set.insert(op.key);
+            return 1;
+        }
+    case op_kind::ERASE:
+        if constexpr (requires { { set.erase(op.key) } -> std::convertible_to<std::size_t>; }) {
+            return set.erase(op.key) != 0 ? 1 : 0;
+        } else {
+            set.erase(op.key);
+            return 1;
+        }
+    case op_kind::LOOKUP:
+        if constexpr (requires { set.count(op.key); }) {
+            return set.count(op.key) != 0 ? 1 : 0;
+        } else if constexpr (requires { set.contains(op.key); }) {
+            return set.contains(op.key) ? 1 : 0;
+        } else {
+            return set.find(op.key) != set.end() ? 1 : 0;
+        }
+    }
+    return 0;
+}
+
+inline double percentile(const std::vector<double>& sorted, double p) {
+    auto index = static_cast<std::size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+    return sorted[std::min(index == 0 ? 0 : index - 1, sorted.size() - 1)];
+}
+
+/**
+ * @brief measure runs the workload cfg.repetitions times on a new container every time
+ * @return one result per phase
+ */
+template <typename Set, typename Config>
+std::vector<result> measure(const std::string& container, const workload<typename Config::key_type>& w,
+                            std::size_t size, const Config& cfg) {
+    using clock = std::chrono::steady_clock;
+    std::vector<std::vector<double>> batch_times(w.phases.size());
+    std::vector<std::size_t> hits(w.phases.size());
+    for (std::size_t repetition = 0; repetition < cfg.repetitions; ++repetition) {
+        Set set;
+        for (const auto& key : w.preload) {
+            set.insert(key);
+        }
+        for (std::size_t p = 0; p < w.phases.size(); ++p) {
+            const auto& operations = w.phases[p].operations;
+            std::size_t phase_hits = 0;
+            for (std::size_t first = 0; first < operations.size(); first += cfg.batch) {
+                auto last = std::min(first + cfg.batch, operations.size());
+                auto start = clock::now();
+                for (auto i = first; i < last; ++i) {
+                    phase_hits += run_operation(set, operations[i]);
+                }
+                std::chrono::duration<double, std::nano> time = clock::now() - start;
+                batch_times[p].push_back(time.count() / static_cast<double>(last - first));
+            }
+            hits[p] = phase_hits;
+        }
+    }
+
+    std::vector<result> results;
+    for (std::size_t p = 0; p < w.phases.size(); ++p) {
+        auto& times = batch_times[p];
+        std::sort(times.begin(), times.end());
+        result r{container, w.name, w.phases[p].name, size, w.phases[p].operations.size(), hits[p]};
+        if (!times.empty()) {
+            r.mean = std::accumulate(times.begin(), times.end(), 0.0) / static_cast<double>(times.size());
+            r.p50 = percentile(times, 0.5);
+            r.p90 = percentile(times, 0.9);
+            r.p99 = percentile(times, 0.99);
+            r.max = times.back();
+        }
+        results.push_back(r);
+    }
+    return results;
+}
+
+template <typename Config>
+struct container_entry {
+    std::string name;
+    std::vector<result> (*run)(const std::string&, const workload<typename Config::key_type>&, std::size_t, const Config&);
+};
+
+//Reporting
+inline std::string json_string(std::string_view text) {
+    std::string quoted = "\"";
+    for (auto c : text) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+template <typename Config>
+void write_json(std::ostream& out, const Config& cfg, const std::vector<result>& results) {
+    out << std::setprecision(6);
+    out << "{\n  \"benchmark\": " << json_string(Config::benchmark_name) << ",\n  \"config\": {\"repetitions\": " << cfg.repetitions
+        << ", \"batch\": " << cfg.batch << ", \"seed\": " << cfg.seed;
+    cfg.write_json_config(out);
+    out << ", \"sizes\": [";
+    for (std::size_t i = 0; i < cfg.sizes.size(); ++i) {
+        out << (i == 0 ? "" : ", ") << cfg.sizes[i];
+    }
+    out << "]},\n  \"unit\": \"ns/op\",\n  \"results\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"container\": " << json_string(r.container) << ", \"workload\": " << json_string(r.workload)
+            << ", \"phase\": " << json_string(r.phase) << ", \"size\": " << r.size
+            << ", \"operations\": " << r.operations << ", \"hits\": " << r.hits
+            << ", \"mean\": " << r.mean << ", \"p50\": " << r.p50 << ", \"p90\": " << r.p90
+            << ", \"p99\": " << r.p99 << ", \"max\": " << r.max << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+inline void print_result(const result& r) {
+    std::cout << std::left << std::setw(19) << r.container << std::setw(9) << r.workload << std::setw(8) << r.phase
+              << std::right << std::setw(9) << r.size << std::fixed << std::setprecision(1)
+              << std::setw(10) << r.mean << std::setw(10) << r.p50 << std::setw(10) << r.p90
+              << std::setw(10) << r.p99 << std::setw(10) << r.max << std::endl;
+}
+
+template <typename Config>
+bool parse_arguments(int argc, char** argv, Config& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view option = argv[i];
+        if (option == "--help" || i + 1 == argc)
+            return false;
+        std::string value = argv[++i];
+        if (option == "--sizes") {
+            cfg.sizes.clear();
+            for (const auto& size : split_list(value, ',')) {
+                cfg.sizes.push_back(std::stoul(size));
+            }
+        } else if (option == "--repetitions") {
+            cfg.repetitions = std::stoul(value);
+        } else if (option == "--batch") {
+            cfg.batch = std::max<std::size_t>(1, std::stoul(value));
+        } else if (option == "--seed") {
+            cfg.seed = std::stoull(value);
+        } else if (option == "--workloads") {
+            cfg.workloads = split_list(value, ',');
+        } else if (option == "--containers") {
+            cfg.containers = split_list(value, ',');
+        } else if (option == "--json") {
+            cfg.json_path = value;
+        } else if (!cfg.parse_option(option, value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief run is main() of a benchmark: every container runs every workload of every size.
+ * @return 0, 1 for wrong arguments, 2 when the containers disagree on the hits of a phase
+ */
+template <typename Config>
+int run(int argc, char** argv, Config& cfg, const std::vector<container_entry<Config>>& containers) {
+    const std::vector<std::string> known_workloads = cfg.workloads;
+    bool valid = false;
+    try {
+        valid = parse_arguments(argc, argv, cfg);
+    } catch (const std::exception&) {
+    }
+    for (const auto& name : cfg.containers) {
+        valid = valid && std::any_of(containers.begin(), containers.end(), [&name](const auto& c) { return c.name == name; });
+    }
+    for (const auto& name : cfg.workloads) {
+        valid = valid && std::find(known_workloads.begin(), known_workloads.end(), name) != known_workloads.end();
+    }
+    if (!valid) {
+        std::cerr << "Usage: " << argv[0] << " [--sizes 1000,100000] [--repetitions 5] [--batch 256] [--seed 1]\n"
+                  << "    [--workloads ";
+        for (auto it = known_workloads.begin(); it != known_workloads.end(); ++it) {
+            std::cerr << (it == known_workloads.begin() ? "" : ",") << *it;
+        }
+        std::cerr << "]" << Config::usage_options << "\n    [--containers name,...] [--json file]\nContainers:";
+        for (const auto& c : containers) {
+            std::cerr << ' ' << c.name;
+        }
+        std::cerr << std::endl;
+        return 1;
+    }
+    if (cfg.containers.empty()) {
+        for (const auto& c : containers) {
+            cfg.containers.push_back(c.name);
+        }
+    }
+
+    std::cout << std::left << std::setw(19) << "container" << std::setw(9) << "workload" << std::setw(8) << "phase"
+              << std::right << std::setw(9) << "size" << std::setw(10) << "mean" << std::setw(10) << "p50"
+              << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "max" << "  (ns/op)" << std::endl;
+    std::vector<result> results;
+    int exit_code = 0;
+    for (auto size : cfg.sizes) {
+        for (const auto& workload_name : cfg.workloads) {
+            auto w = cfg.make_workload(workload_name, size);
+            std::vector<std::size_t> expected_hits;
+            for (const auto& name : cfg.containers) {
+                auto entry = std::find_if(containers.begin(), containers.end(), [&name](const auto& c) { return c.name == name; });
+                auto measured = entry->run(name, w, size, cfg);
+                for (std::size_t p = 0; p < measured.size(); ++p) {
+                    print_result(measured[p]);
+                    // the containers must agree on every found key
+                    if (expected_hits.size() <= p) {
+                        expected_hits.push_back(measured[p].hits);
+                    } else if (expected_hits[p] != measured[p].hits) {
+                        std::cerr << name << " has wrong result of " << workload_name << "/" << measured[p].phase << std::endl;
+                        exit_code = 2;
+                    }
+                }
+                results.insert(results.end(), measured.begin(), measured.end());
+            }
+        }
+    }
+
+    if (!cfg.json_path.empty()) {
+        std::ofstream json(cfg.json_path);
+        write_json(json, cfg, results);
+        if (!json) {
+            std::cerr << "Can't write " << cfg.json_path << std::endl;
+            return 1;
+        }
+    }
+    return exit_code;
+}
+
+}
@@ -0,0 +1,161 @@
+#include <bplus_tree/bplus_tree.h>
+#include <util/arena_allocator.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+#define BOOST_TEST_MODULE BPlus_Tree
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+// keys are scattered over [0, 2n] by the prime multiplier
+template <typename Key>
+Key scattered_key(int i, int n) {
+    return static_cast<Key>(static_cast<long>(i) * 7919 % (2 * n + 1));
+}
+
+template <typename Tree, typename Key>
+void check_random_operations(int n) {
+    Tree tree;
+    std::set<Key> expected;
+    for (int i = 0; i < n; ++i) {
+        auto key = scattered_key<Key>(i, n);
+        BOOST_REQUIRE_EQUAL(tree.insert(key), expected.insert(key).second);
+        if (i % 3 == 2) {
+            auto erased = scattered_key<Key>(i * 13 + 5, n);
+            BOOST_REQUIRE_EQUAL(tree.erase(erased), expected.erase(erased));
+        }
+    }
+    BOOST_REQUIRE(tree.verify_test());
+    BOOST_REQUIRE_EQUAL(tree.size(), expected.size());
+    for (int i = -1; i < 2 * n + 2; ++i) {
+        auto key = static_cast<Key>(i);
+        BOOST_REQUIRE_EQUAL(tree.contains(key), expected.count(key) != 0);
+    }
+
+    std::vector<Key> keys;
+    tree.enumerate([&keys](const Key& key) {
+        keys.push_back(key);
+        return true;
+    });
+    BOOST_REQUIRE(std::equal(keys.begin(), keys.end(), expected.begin(), expected.end()));
+
+    // erasing everything collapses the tree level by level
+    for (int i = 0; i < 2 * n + 1; ++i) {
+        auto key = scattered_key<Key>(i, n);
+        BOOST_REQUIRE_EQUAL(tree.erase(key), expected.erase(key));
+        if (i % 97 == 0) {
+            BOOST_REQUIRE(tree.verify_test());
+        }
+    }
+    BOOST_REQUIRE(tree.empty());
+    BOOST_REQUIRE_EQUAL(tree.size(), 0);
+    BOOST_REQUIRE_EQUAL(tree.height(), 0);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(BPlus_Tree)
+
+// small nodes make the tree high, so splits and merges of inner nodes are frequent
+using set_types = std::tuple<
+    std::tuple<bplus_tree::tree<int>, int>,
+    std::tuple<bplus_tree::tree<int, void, std::compare_three_way, std::allocator, 64>, int>,
+    std::tuple<bplus_tree::tree<uint32_t, void, std::compare_three_way, std::allocator, 64>, uint32_t>,
+    std::tuple<bplus_tree::tree<int64_t, void, std::compare_three_way, std::allocator, 64>, int64_t>,
+    std::tuple<bplus_tree::tree<double, void, std::compare_three_way, std::allocator, 128>, double>,
+    std::tuple<bplus_tree::tree<int, void, std::compare_three_way, util::arena_allocator, 64>, int>>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(BPlus_Tree_set, P, set_types)
+{
+    using Tree = std::tuple_element_t<0, P>;
+    using Key  = std::tuple_element_t<1, P>;
+    static_assert(Tree::leaf_size % 64 == 0 && Tree::inner_size % 64 == 0);
+    for (int n : {1, 10, 100, 5000}) {
+        check_random_operations<Tree, Key>(n);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BPlus_Tree_simd_search)
+{
+    // unsigned keys above INT32_MAX check the biased comparison
+    bplus_tree::tree<uint32_t> tree;
+    std::vector<uint32_t> keys;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        keys.push_back(i);
+        keys.push_back(UINT32_MAX - i);
+        keys.push_back(0x80000000u + i);
+        keys.push_back(0x7FFFFFFFu - i);
+    }
+    for (auto key : keys) {
+        BOOST_REQUIRE(tree.insert(key));
+    }
+    BOOST_REQUIRE(tree.verify_test());
+    for (auto key : keys) {
+        BOOST_REQUIRE(tree.contains(key));
+        BOOST_REQUIRE(!tree.insert(key));
+    }
+    BOOST_REQUIRE(!tree.contains(5000u));
+    BOOST_REQUIRE(!tree.contains(0x80000000u + 5000));
+
+    std::sort(keys.begin(), keys.end());
+    std::vector<uint32_t> visited;
+    tree.enumerate([&visited](uint32_t key) {
+        visited.push_back(key);
+        return true;
+    }, bplus_tree::tree<uint32_t>::EnumerationOrder::DESCENDING);
+    BOOST_REQUIRE(std::equal(visited.begin(), visited.end(), keys.rbegin(), keys.rend()));
+}
+
+BOOST_AUTO_TEST_CASE(BPlus_Tree_map)
+{
+    bplus_tree::tree<std::string, std::string, std::compare_three_way, std::allocator, 512> tree;
+    std::map<std::string, std::string> expected;
+    for (int i = 0; i < 3000; ++i) {
+        auto key = std::to_string(scattered_key<int>(i, 3000));
+        auto value = std::pair(key, "value " + key);
+        BOOST_REQUIRE_EQUAL(tree.insert(value), expected.insert(value).second);
+        if (i % 2 == 1) {
+            auto erased = std::to_string(scattered_key<int>(i * 7, 3000));
+            BOOST_REQUIRE_EQUAL(tree.erase(erased), expected.erase(erased));
+        }
+    }
+    BOOST_REQUIRE(tree.verify_test());
+    BOOST_REQUIRE_EQUAL(tree.size(), expected.size());
+    BOOST_REQUIRE_GT(tree.height(), 1);
+
+    for (auto& [key, value] : expected) {
+        BOOST_REQUIRE_EQUAL(tree.at(key), value);
+    }
+    BOOST_REQUIRE_THROW(tree.at(std::string("missing")), std::out_of_range);
+
+    tree.at(expected.begin()->first) = "changed";
+    expected.begin()->second = "changed";
+    auto it = expected.begin();
+    tree.enumerate([&it](auto& item) {
+        BOOST_REQUIRE_EQUAL(item.first, it->first);
+        BOOST_REQUIRE_EQUAL(item.second, it->second);
+        ++it;
+        return true;
+    });
+    BOOST_REQUIRE(it == expected.end());
+
+    std::size_t visited = 0;
+    tree.enumerate([&visited](auto&) {
+        return ++visited < 10;
+    });
+    BOOST_REQUIRE_EQUAL(visited, 10);
+
+    tree.clear();
+    BOOST_REQUIRE(tree.empty());
+    BOOST_REQUIRE(tree.verify_test());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,439 @@
+#include <patricia_trie/patricia_trie.h>
+#include <util/bitutil.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#define BOOST_TEST_MODULE PatriciaTest
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+// the first differing bit found bit by bit
+template <typename C>
+std::size_t slow_mismatch(const C& a, const C& b) {
+    util::BitStreamAdaptor<C> x(a);
+    util::BitStreamAdaptor<C> y(b);
+    auto size = std::max(x.size(), y.size()) + 1;
+    for (std::size_t i = 0; i < size; ++i) {
+        if (x.bit(i) != y.bit(i))
+            return i;
+    }
+    return util::BitStreamAdaptor<C>::npos;
+}
+
+template <typename C>
+void check_mismatch(const C& a, const C& b) {
+    auto expected = slow_mismatch(a, b);
+    BOOST_REQUIRE_EQUAL(util::BitStreamAdaptor<C>(a).mismatch(b), expected);
+    BOOST_REQUIRE_EQUAL(util::BitStreamAdaptor<C>(b).mismatch(a), expected);
+    if (expected != util::BitStreamAdaptor<C>::npos) {
+        // the bit of the lexicographically less sequence is 0
+        BOOST_REQUIRE_EQUAL(util::BitStreamAdaptor<C>(a).bit(expected), !(a < b));
+    }
+}
+
+std::string random_key(unsigned& seed, std::size_t max_length) {
+    seed = seed * 1103515245 + 12345;
+    std::string key(seed % (max_length + 1), 'a');
+    for (auto& c : key) {
+        seed = seed * 1103515245 + 12345;
+        // few letters make long common prefixes
+        c = static_cast<char>('a' + (seed >> 16) % 3);
+    }
+    return key;
+}
+
+// a stored key and a key of the set are equal, the stored one may be a view
+template <typename A, typename B>
+bool same_key(const A& a, const B& b) {
+    if constexpr (std::ranges::range<A>) {
+        return std::ranges::equal(a, b);
+    } else {
+        return a == b;
+    }
+}
+
+template <typename KEY, typename KeyStorage = patricia_keys::by_value>
+void check_random_operations(const std::vector<KEY>& keys) {
+    patricia_tree<KEY, std::allocator<KEY>, KeyStorage> trie;
+    std::set<KEY> expected;
+    auto same = [](const auto& a, const auto& b) { return same_key(a, b); };
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        trie.insert(keys[i]);
+        expected.insert(keys[i]);
+        if (i % 3 == 2) {
+            trie.erase(keys[i / 2]);
+            expected.erase(keys[i / 2]);
+        }
+    }
+    BOOST_REQUIRE(trie.verify_test());
+    BOOST_REQUIRE(std::equal(trie.begin(), trie.end(), expected.begin(), expected.end(), same));
+    for (const auto& key : keys) {
+        BOOST_REQUIRE_EQUAL(trie.contains(key), expected.count(key) != 0);
+    }
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        trie.erase(keys[i]);
+        expected.erase(keys[i]);
+        BOOST_REQUIRE(!trie.contains(keys[i]));
+        // the interned keys move when the arena is rebuilt
+        if (i % 500 == 0) {
+            BOOST_REQUIRE(trie.verify_test());
+            BOOST_REQUIRE(std::equal(trie.begin(), trie.end(), expected.begin(), expected.end(), same));
+        }
+    }
+    BOOST_REQUIRE(trie.verify_test());
+    BOOST_REQUIRE(trie.empty());
+    BOOST_REQUIRE(trie.begin() == trie.end());
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( BitStreamTest )
+{
+    check_mismatch<std::string>("", "");
+    check_mismatch<std::string>("", "A");
+    check_mismatch<std::string>("AA", "AAA");
+    check_mismatch<std::string>("A", "B");
+    check_mismatch<std::string>("a", "\xff");
+    check_mismatch<std::string>(std::string("\0", 1), "");
+
+    // the difference in every byte of long keys: SSE2 blocks, words and the tail
+    std::string base(70, 'x');
+    for (std::size_t i = 0; i < base.size(); ++i) {
+        auto other = base;
+        other[i] = 'y';
+        check_mismatch(base, other);
+        check_mismatch(base, base.substr(0, i));
+    }
+    check_mismatch(base, base);
+
+    std::vector<uint16_t> wide(21, 0x1234);
+    for (std::size_t i = 0; i < wide.size(); ++i) {
+        auto other = wide;
+        other[i] = 0x1334;
+        check_mismatch(wide, other);
+        other[i] = 0x1235;
+        check_mismatch(wide, other);
+    }
+    check_mismatch(std::vector<uint64_t>{1, 2, 3}, std::vector<uint64_t>{1, 2, 1ull << 63});
+
+    // containers without contiguous storage are compared item by item
+    check_mismatch(std::list<unsigned char>{1, 2, 3}, std::list<unsigned char>{1, 2, 4});
+
+    std::string searching("SEARCHING");
+    BOOST_REQUIRE(util::BitStreamAdaptor<std::string>(searching).bit(0));
+    BOOST_REQUIRE_EQUAL(util::BitStreamAdaptor<std::string>(searching).size(), 1 + 9 * 9);
+}
+
+BOOST_AUTO_TEST_CASE( PatriciaTest )
+{
+    patricia_tree<std::string>  trie;
+    BOOST_REQUIRE(trie.empty());
+    BOOST_REQUIRE(!trie.contains("S"));
+
+    std::string str("SEARCHING");
+    for(auto c : str) {
+        trie.insert(std::string(1, c));
+    }
+    BOOST_REQUIRE(trie.verify_test());
+    for(auto c : str) {
+        BOOST_REQUIRE(trie.contains(std::string(1, c)));
+    }
+    BOOST_REQUIRE(!trie.contains("X"));
+    BOOST_REQUIRE(!trie.contains("SE"));
+
+    trie.erase("E");
+    trie.erase("A");
+    trie.erase("X");
+    BOOST_REQUIRE(trie.verify_test());
+    BOOST_REQUIRE(!trie.contains("E"));
+    BOOST_REQUIRE(!trie.contains("A"));
+    BOOST_REQUIRE(trie.contains("S"));
+    BOOST_REQUIRE(trie.contains("G"));
+
+    trie.clear();
+    BOOST_REQUIRE(trie.empty());
+    BOOST_REQUIRE(!trie.contains("S"));
+}
+
+BOOST_AUTO_TEST_CASE( PatriciaPrefixKeysTest )
+{
+    // keys that are prefixes of each other and the empty key in any order
+    std::vector<std::string> keys = {"AAA", "AA", "", "A", "AAAA", "AAB", std::string("A\0", 2)};
+    for (std::size_t shift = 0; shift < keys.size(); ++shift) {
+        patricia_tree<std::string> trie;
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            trie.insert(keys[(i + shift) % keys.size()]);
+        }
+        BOOST_REQUIRE(trie.verify_test());
+        for (const auto& key : keys) {
+            BOOST_REQUIRE(trie.contains(key));
+        }
+        BOOST_REQUIRE(!trie.contains("AB"));
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            trie.erase(keys[(i * 3 + shift) % keys.size()]);
+            BOOST_REQUIRE(trie.verify_test());
+            BOOST_REQUIRE(!trie.contains(keys[(i * 3 + shift) % keys.size()]));
+        }
+        BOOST_REQUIRE(trie.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( PatriciaIteratorTest )
+{
+    patricia_tree<std::string> trie;
+    BOOST_REQUIRE(trie.begin() == trie.end());
+
+    trie.insert("S");
+    BOOST_REQUIRE_EQUAL(*trie.begin(), "S");
+    BOOST_REQUIRE(std::next(trie.begin()) == trie.end());
+
+    std::set<std::string> expected = {"S"};
+    for (const auto& key : {"SEARCH", "", "SEA", "A", "SEARCHING", "Z", "SEAT"}) {
+        trie.insert(key);
+        expected.insert(key);
+        BOOST_REQUIRE(std::equal(trie.begin(), trie.end(), expected.begin(), expected.end()));
+    }
+    auto it = trie.begin();
+    BOOST_REQUIRE(it->empty());
+    BOOST_REQUIRE_EQUAL(*++it, "A");
+    BOOST_REQUIRE_EQUAL(*it++, "A");
+    BOOST_REQUIRE_EQUAL(*it, "S");
+    BOOST_REQUIRE_EQUAL(std::distance(trie.begin(), trie.end()), expected.size());
+
+    // every key is a prefix of the next one, so the tree is as deep as it is large
+    patricia_tree<std::string> chain;
+    std::string key;
+    for (int i = 0; i < 3000; ++i) {
+        chain.insert(key);
+        key += 'x';
+    }
+    BOOST_REQUIRE(chain.verify_test());
+    BOOST_REQUIRE_EQUAL(std::distance(chain.begin(), chain.end()), 3000);
+    BOOST_REQUIRE(std::is_sorted(chain.begin(), chain.end()));
+    chain.clear();
+    BOOST_REQUIRE(chain.begin() == chain.end());
+}
+
+BOOST_AUTO_TEST_CASE( PatriciaRandomTest )
+{
+    unsigned seed = 17;
+    std::vector<std::string> short_keys;
+    std::vector<std::string> long_keys;
+    std::vector<std::vector<uint32_t>> vector_keys;
+    for (int i = 0; i < 3000; ++i) {
+        short_keys.push_back(random_key(seed, 6));
+        // the common prefix makes the keys differ in SSE2 blocks and words
+        long_keys.push_back(std::string(40, 'p') + random_key(seed, 30));
+        auto key = random_key(seed, 5);
+        vector_keys.emplace_back(key.begin(), key.end());
+    }
+    check_random_operations(short_keys);
+    check_random_operations(long_keys);
+    check_random_operations(vector_keys);
+}
+
+BOOST_AUTO_TEST_CASE( PatriciaInternedKeysTest )
+{
+    using interned_trie = patricia_tree<std::string, std::allocator<std::string>, patricia_keys::interned>;
+    interned_trie trie;
+    BOOST_REQUIRE(!trie.longest_prefix_match("abc"));
+    for (const auto& key : {"ab", "", "abcd", "b", "abc"}) {
+        trie.insert(key);
+    }
+    trie.insert("abc");
+    BOOST_REQUIRE(trie.verify_test());
+    BOOST_REQUIRE(trie.contains("abcd"));
+    BOOST_REQUIRE(!trie.contains("a"));
+    std::vector<std::string_view> keys(trie.begin(), trie.end());
+    std::vector<std::string_view> expected = {"", "ab", "abc", "abcd", "b"};
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(keys.begin(), keys.end(), expected.begin(), expected.end());
+
+    auto match = trie.longest_prefix_match("abca");
+    BOOST_REQUIRE(match);
+    BOOST_REQUIRE_EQUAL(*match, "abc");
+    std::vector<std::string_view> found;
+    trie.for_each_with_prefix("ab", [&found](std::string_view key) { found.push_back(key); });
+    BOOST_REQUIRE_EQUAL(found.size(), 3);
+    BOOST_REQUIRE_EQUAL(found.back(), "abcd");
+
+    trie.erase("abcd");
+    trie.erase("ab");
+    BOOST_REQUIRE(trie.verify_test());
+    BOOST_REQUIRE(!trie.contains("ab"));
+    BOOST_REQUIRE(trie.contains("abc"));
+    trie.clear();
+    BOOST_REQUIRE(trie.empty());
+
+    unsigned seed = 29;
+    std::vector<std::string> string_keys;
+    std::vector<std::vector<uint8_t>> byte_keys;
+    std::vector<std::vector<uint32_t>> vector_keys;
+    for (int i = 0; i < 3000; ++i) {
+        string_keys.push_back(std::string(20, 'p') + random_key(seed, 12));
+        auto key = random_key(seed, 6);
+        byte_keys.emplace_back(key.begin(), key.end());
+        vector_keys.emplace_back(key.begin(), key.end());
+    }
+    check_random_operations<std::string, patricia_keys::interned>(string_keys);
+    check_random_operations<std::vector<uint8_t>, patricia_keys::interned>(byte_keys);
+    check_random_operations<std::vector<uint32_t>, patricia_keys::interned>(vector_keys);
+
+    patricia_tree<std::vector<uint8_t>, std::allocator<std::vector<uint8_t>>, patricia_keys::interned> bytes;
+    bytes.insert({1, 2, 3});
+    std::ostringstream dump;
+    bytes.dump(dump);
+    BOOST_REQUIRE(dump.str().find("pos=0") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE( PatriciaIntegerKeysTest )
+{
+    std::vector<uint32_t> keys32;
+    std::vector<uint64_t> keys64;
+    std::vector<util::uint128_t> keys128;
+    uint64_t seed = 1;
+    for (int i = 0; i < 3000; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        // small values share the high zero bits
+        keys32.push_back(static_cast<uint32_t>(i % 2 == 0 ? seed >> 32 : seed >> 52));
+        keys64.push_back(i % 3 == 0 ? seed : seed >> (i % 64));
+        keys128.push_back((static_cast<util::uint128_t>(seed) << 64) | keys64.back());
+    }
+    keys32.push_back(0);
+    keys64.push_back(~uint64_t{0});
+    check_random_operations(keys32);
+    check_random_operations(keys64);
+    check_random_operations(keys128);
+
+    patricia_tree<uint32_t> trie;
+    trie.insert(7);
+    BOOST_REQUIRE_EQUAL(*trie.longest_prefix_match(7), 7u);
+    BOOST_REQUIRE(trie.longest_prefix_match(6) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE( PatriciaLongestPrefixMatchTest )
+{
+    patricia_tree<std::string> trie;
+    BOOST_REQUIRE(trie.longest_prefix_match("abc") == nullptr);
+    for (const auto& key : {"", "a", "abc", "abd", "b", "abcdef"}) {
+        trie.insert(key);
+    }
+    BOOST_REQUIRE_EQUAL(*trie.longest_prefix_match("abcde"), "abc");
+    BOOST_REQUIRE_EQUAL(*trie.longest_prefix_match("abcdefgh"), "abcdef");
+    BOOST_REQUIRE_EQUAL(*trie.longest_prefix_match("abd"), "abd");
+    BOOST_REQUIRE_EQUAL(*trie.longest_prefix_match("ab"), "a");
+    BOOST_REQUIRE_EQUAL(*trie.longest_prefix_match("c"), "");
+    trie.erase("");
+    BOOST_REQUIRE(trie.longest_prefix_match("c") == nullptr);
+
+    // all prefixes of random keys are found as the brute force finds them
+    unsigned seed = 5;
+    patricia_tree<std::string> random_trie;
+    std::set<std::string> stored;
+    for (int i = 0; i < 2000; ++i) {
+        auto key = random_key(seed, 8);
+        random_trie.insert(key);
+        stored.insert(key);
+    }
+    for (int i = 0; i < 2000; ++i) {
+        auto key = random_key(seed, 12);
+        const std::string* expected = nullptr;
+        for (std::size_t length = 0; length <= key.size(); ++length) {
+            if (auto it = stored.find(key.substr(0, length)); it != stored.end())
+                expected = &*it;
+        }
+        auto found = random_trie.longest_prefix_match(key);
+        BOOST_REQUIRE_EQUAL(found == nullptr, expected == nullptr);
+        if (found != nullptr)
+            BOOST_REQUIRE_EQUAL(*found, *expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( PatriciaForEachWithPrefixTest )
+{
+    unsigned seed = 9;
+    patricia_tree<std::string> trie;
+    std::set<std::string> stored;
+    for (int i = 0; i < 2000; ++i) {
+        auto key = random_key(seed, 8);
+        trie.insert(key);
+        stored.insert(key);
+    }
+    for (const std::string prefix : {"", "a", "ab", "abc", "cccc", "abcabca", "abcabcab", "abcabcabc", "d"}) {
+        std::vector<std::string> expected;
+        std::copy_if(stored.begin(), stored.end(), std::back_inserter(expected), [&prefix](const std::string& key) {
+            return key.compare(0, prefix.size(), prefix) == 0;
+        });
+        std::vector<std::string> found;
+        trie.for_each_with_prefix(prefix, [&found](const std::string& key) {
+            found.push_back(key);
+        });
+        BOOST_REQUIRE_EQUAL_COLLECTIONS(found.begin(), found.end(), expected.begin(), expected.end());
+    }
+
+    patricia_tree<std::string> single;
+    single.insert("abc");
+    int calls = 0;
+    single.for_each_with_prefix("ab", [&calls](const std::string&) { ++calls; });
+    single.for_each_with_prefix("abd", [&calls](const std::string&) { ++calls; });
+    BOOST_REQUIRE_EQUAL(calls, 1);
+}
+
+BOOST_AUTO_TEST_CASE( PatriciaRoutingTest )
+{
+    using prefix = util::bit_prefix<uint32_t>;
+    BOOST_REQUIRE(prefix(0x0A0B0C0D, 8) == prefix(0x0AFFFFFF, 8));
+    BOOST_REQUIRE(prefix(0x0A0B0C0D, 0) == prefix());
+
+    patricia_tree<prefix> routes;
+    std::vector<prefix> table;
+    uint64_t seed = 3;
+    for (int i = 0; i < 1000; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        // the addresses are concentrated in few networks to make nested routes
+        auto address = static_cast<uint32_t>(seed >> 32) & 0x0F0F0FFF;
+        table.emplace_back(address, static_cast<unsigned>(seed % 33));
+        routes.insert(table.back());
+    }
+    BOOST_REQUIRE(routes.verify_test());
+    for (int i = 0; i < 3000; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        auto address = static_cast<uint32_t>(seed >> 32) & 0x0F0F0FFF;
+        const prefix* expected = nullptr;
+        for (const auto& route : table) {
+            if (prefix(address, route.length) == route && (expected == nullptr || route.length > expected->length))
+                expected = &route;
+        }
+        auto found = routes.longest_prefix_match({address, 32});
+        BOOST_REQUIRE_EQUAL(found == nullptr, expected == nullptr);
+        if (found != nullptr)
+            BOOST_REQUIRE(*found == *expected);
+    }
+
+    // the routes inside of a network, the table has duplicates that the trie keeps once
+    std::sort(table.begin(), table.end(), [](const prefix& a, const prefix& b) {
+        return std::tie(a.value, a.length) < std::tie(b.value, b.length);
+    });
+    table.erase(std::unique(table.begin(), table.end()), table.end());
+    for (const auto& network : {prefix(0x0A000000, 8), prefix(0x0F0F0000, 16), prefix(0, 0)}) {
+        auto expected = std::count_if(table.begin(), table.end(), [&network](const prefix& route) {
+            return route.length >= network.length && prefix(route.value, network.length) == network;
+        });
+        std::vector<prefix> found;
+        routes.for_each_with_prefix(network, [&found](const prefix& route) {
+            found.push_back(route);
+        });
+        BOOST_REQUIRE_EQUAL(found.size(), static_cast<std::size_t>(expected));
+        BOOST_REQUIRE(std::all_of(found.begin(), found.end(), [&network](const prefix& route) {
+            return route.length >= network.length && prefix(route.value, network.length) == network;
+        }));
+    }
+}
@@ -0,0 +1,190 @@
+/**
+ * tree_benchmark runs the same generated workloads against every tree container and reports the time of one
+ * operation as the mean and percentiles over batches of operations.
+ *
+ * Usage: tree_benchmark [--sizes 1000,100000] [--repetitions 5] [--batch 256] [--seed 1]
+ *                       [--workloads random,sorted,reverse,zipf,mixed] [--containers avl,std_set,...]
+ *                       [--zipf-skew 0.99] [--mix 50:25:25] [--json results.json]
+ *
+ * Workloads:
+ *  - random, sorted, reverse: insert n distinct keys in that order, look up 2n keys (a half of them are found)
+ *    and erase the keys in the same order. Every phase is reported separately.
+ *  - zipf: look up the tree of n keys with Zipfian distributed keys, a few keys are hot.
+ *  - mixed: the tree starts with n/2 keys, then n random lookups, inserts and erases in the --mix proportion.
+ *
+ * The JSON output is stable (containers, workloads and phases go in the order of the arguments),
+ * so two runs can be diffed or compared by a script.
+ */
+
+#include <binary_tree/binary_tree.h>
+#include <binary_tree/compact_tree.h>
+#include <binary_tree/concurrent_tree.h>
+#include <binary_tree/persistent_tree.h>
+#include <binary_tree/rb_balancer.h>
+#include <binary_tree/wavl_balancer.h>
+#include <bplus_tree/bplus_tree.h>
+#include <util/arena_allocator.h>
+
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
+
+#include "benchmark_common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using key_type = int;
+using operation = benchmark::operation<key_type>;
+using workload = benchmark::workload<key_type>;
+using benchmark::op_kind;
+using benchmark::operations_of;
+
+struct config : benchmark::config {
+    using key_type = ::key_type;
+    static constexpr std::string_view benchmark_name = "tree_benchmark";
+    static constexpr std::string_view usage_options = " [--zipf-skew 0.99] [--mix lookup:insert:erase]";
+
+    double   zipf_skew = 0.99;
+    unsigned mix[3]    = {50, 25, 25};
+
+    config() { workloads = {"random", "sorted", "reverse", "zipf", "mixed"}; }
+
+    workload make_workload(const std::string& name, std::size_t n) const;
+    bool parse_option(std::string_view option, const std::string& value);
+    void write_json_config(std::ostream& out) const;
+};
+
+//Workload generators
+/// distinct keys are even, so a lookup of an odd key misses
+std::vector<key_type> distinct_keys(std::size_t n, std::mt19937_64& random) {
+    std::vector<key_type> keys(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        keys[i] = static_cast<key_type>(2 * i);
+    }
+    std::shuffle(keys.begin(), keys.end(), random);
+    return keys;
+}
+
+workload ordered_workload(const std::string& name, std::size_t n, std::mt19937_64& random) {
+    auto keys = distinct_keys(n, random);
+    if (name == "sorted") {
+        std::sort(keys.begin(), keys.end());
+    } else if (name == "reverse") {
+        std::sort(keys.begin(), keys.end(), std::greater<>());
+    }
+    std::uniform_int_distribution<key_type> any_key(0, static_cast<key_type>(2 * n));
+    std::vector<key_type> lookups(2 * n);
+    for (auto& key : lookups) {
+        key = any_key(random);
+    }
+    return {name, {}, {
+        {"insert", operations_of(op_kind::INSERT, keys)},
+        {"lookup", operations_of(op_kind::LOOKUP, lookups)},
+        {"erase",  operations_of(op_kind::ERASE, keys)},
+    }};
+}
+
+workload zipf_workload(std::size_t n, double skew, std::mt19937_64& random) {
+    auto keys = distinct_keys(n, random);
+    // the key of the rank r is looked up with the probability 1/r^skew, the ranks are scattered over the keys
+    std::vector<double> cdf(n);
+    double sum = 0;
+    for (std::size_t r = 0; r < n; ++r) {
+        sum += 1.0 / std::pow(static_cast<double>(r + 1), skew);
+        cdf[r] = sum;
+    }
+    std::uniform_real_distribution<double> uniform(0, sum);
+    std::vector<key_type> lookups(2 * n);
+    for (auto& key : lookups) {
+        auto rank = std::lower_bound(cdf.begin(), cdf.end(), uniform(random)) - cdf.begin();
+        key = keys[std::min<std::size_t>(rank, n - 1)];
+    }
+    return {"zipf", keys, {{"lookup", operations_of(op_kind::LOOKUP, lookups)}}};
+}
+
+workload mixed_workload(std::size_t n, const unsigned (&mix)[3], std::mt19937_64& random) {
+    auto keys = distinct_keys(n, random);
+    keys.resize(n / 2);
+    std::uniform_int_distribution<key_type> any_key(0, static_cast<key_type>(2 * n));
+    std::uniform_int_distribution<unsigned> any_kind(0, mix[0] + mix[1] + mix[2] - 1);
+    std::vector<operation> operations(n);
+    for (auto& op : operations) {
+        auto kind = any_kind(random);
+        op.kind = kind < mix[0] ? op_kind::LOOKUP : kind < mix[0] + mix[1] ? op_kind::INSERT : op_kind::ERASE;
+        op.key = any_key(random);
+    }
+    return {"mixed", keys, {{"mixed", std::move(operations)}}};
+}
+
+workload config::make_workload(const std::string& name, std::size_t n) const {
+    // every workload has its own stream, so the keys don't depend on the list of workloads
+    std::mt19937_64 random(seed ^ std::hash<std::string>{}(name) ^ n);
+    if (name == "zipf")
+        return zipf_workload(n, zipf_skew, random);
+    if (name == "mixed")
+        return mixed_workload(n, mix, random);
+    return ordered_workload(name, n, random);
+}
+
+bool config::parse_option(std::string_view option, const std::string& value) {
+    if (option == "--zipf-skew") {
+        zipf_skew = std::stod(value);
+    } else if (option == "--mix") {
+        auto parts = benchmark::split_list(value, ':');
+        if (parts.size() != 3)
+            return false;
+        for (int k = 0; k < 3; ++k) {
+            mix[k] = static_cast<unsigned>(std::stoul(parts[k]));
+        }
+        if (mix[0] + mix[1] + mix[2] == 0)
+            return false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void config::write_json_config(std::ostream& out) const {
+    out << ", \"zipf_skew\": " << zipf_skew << ", \"mix\": {\"lookup\": " << mix[0] << ", \"insert\": " << mix[1]
+        << ", \"erase\": " << mix[2] << "}";
+}
+
+//Containers
+using ordered_set = __gnu_pbds::tree<key_type, __gnu_pbds::null_type, std::less<key_type>,
+                                     __gnu_pbds::rb_tree_tag, __gnu_pbds::tree_order_statistics_node_update>;
+
+using arena_tree = binary_tree::tree<key_type, void, binary_tree::avl_balancer, std::compare_three_way, util::arena_allocator>;
+
+template <typename Set>
+constexpr auto measure = benchmark::measure<Set, config>;
+
+const std::vector<benchmark::container_entry<config>>& all_containers() {
+    static const std::vector<benchmark::container_entry<config>> containers = {
+        {"std_set",    measure<std::set<key_type>>},
+        {"pbds",       measure<ordered_set>},
+        {"avl",        measure<binary_tree::tree<key_type>>},
+        {"avl_arena",  measure<arena_tree>},
+        {"rb",         measure<binary_tree::tree<key_type, void, binary_tree::rb_balancer>>},
+        {"wavl",       measure<binary_tree::tree<key_type, void, binary_tree::wavl_balancer>>},
+        {"compact",    measure<binary_tree::compact_tree<key_type>>},
+        {"bplus",      measure<bplus_tree::tree<key_type>>},
+        {"persistent", measure<binary_tree::persistent_tree<key_type>>},
+        {"concurrent", measure<binary_tree::concurrent_tree<key_type>>},
+    };
+    return containers;
+}
+
+}
+
+int main(int argc, char** argv) {
+    config cfg;
+    return benchmark::run(argc, argv, cfg, all_containers());
+}
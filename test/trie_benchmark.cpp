@@ -0,0 +1,111 @@
+/**
+ * trie_benchmark runs the same generated string keys against the tries and the ordered sets of strings
+ * and reports the time of one operation as the mean and percentiles over batches of operations.
+ *
+ * Usage: trie_benchmark [--sizes 1000,100000] [--repetitions 5] [--batch 256] [--seed 1]
+ *                       [--workloads random,url] [--containers patricia,patricia_interned,art,...] [--json results.json]
+ *
+ * Workloads insert n distinct keys, look up 2n keys (a half of them are found) and erase the keys.
+ * Every phase is reported separately.
+ *  - random: short keys of random letters.
+ *  - url: keys like "https://host7.example.com/path/12/item345", they share long prefixes.
+ *
+ * The JSON output has the same layout as the output of tree_benchmark.
+ */
+
+#include <binary_tree/binary_tree.h>
+#include <patricia_trie/art_tree.h>
+#include <patricia_trie/patricia_trie.h>
+
+#include "benchmark_common.h"
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using key_type = std::string;
+using workload = benchmark::workload<key_type>;
+using benchmark::op_kind;
+using benchmark::operations_of;
+
+struct config : benchmark::config {
+    using key_type = ::key_type;
+    static constexpr std::string_view benchmark_name = "trie_benchmark";
+    static constexpr std::string_view usage_options = "";
+
+    config() { workloads = {"random", "url"}; }
+
+    workload make_workload(const std::string& name, std::size_t n) const;
+    bool parse_option(std::string_view, const std::string&) { return false; }
+    void write_json_config(std::ostream&) const {}
+};
+
+//Workload generators
+key_type random_key(std::mt19937_64& random) {
+    std::uniform_int_distribution<std::size_t> length(4, 16);
+    std::uniform_int_distribution<int> letter('a', 'z');
+    key_type key(length(random), 'a');
+    for (auto& c : key) {
+        c = static_cast<char>(letter(random));
+    }
+    return key;
+}
+
+key_type url_key(std::mt19937_64& random, std::size_t n) {
+    // few hosts and paths, so the keys differ near their ends
+    std::uniform_int_distribution<std::size_t> host(0, 15);
+    std::uniform_int_distribution<std::size_t> path(0, 63);
+    std::uniform_int_distribution<std::size_t> item(0, 4 * n);
+    return "https://host" + std::to_string(host(random)) + ".example.com/path/" + std::to_string(path(random))
+           + "/item" + std::to_string(item(random));
+}
+
+workload config::make_workload(const std::string& name, std::size_t n) const {
+    // every workload has its own stream, so the keys don't depend on the list of workloads
+    std::mt19937_64 random(seed ^ std::hash<std::string>{}(name) ^ n);
+    auto generate = [&]() { return name == "url" ? url_key(random, n) : random_key(random); };
+
+    // the first n distinct keys are stored, the others are looked up and miss
+    std::set<key_type> seen;
+    std::vector<key_type> keys;
+    while (keys.size() < 2 * n) {
+        auto key = generate();
+        if (seen.insert(key).second)
+            keys.push_back(std::move(key));
+    }
+    std::vector<key_type> stored(keys.begin(), keys.begin() + static_cast<std::ptrdiff_t>(n));
+    std::shuffle(keys.begin(), keys.end(), random);
+    return {name, {}, {
+        {"insert", operations_of(op_kind::INSERT, stored)},
+        {"lookup", operations_of(op_kind::LOOKUP, keys)},
+        {"erase",  operations_of(op_kind::ERASE, stored)},
+    }};
+}
+
+//Containers
+template <typename Set>
+constexpr auto measure = benchmark::measure<Set, config>;
+
+const std::vector<benchmark::container_entry<config>>& all_containers() {
+    static const std::vector<benchmark::container_entry<config>> containers = {
+        {"patricia",          measure<patricia_tree<key_type>>},
+        {"patricia_interned", measure<patricia_tree<key_type, std::allocator<key_type>, patricia_keys::interned>>},
+        {"art",               measure<art_tree<key_type>>},
+        {"std_set",           measure<std::set<key_type>>},
+        {"avl",               measure<binary_tree::tree<key_type>>},
+    };
+    return containers;
+}
+
+}
+
+int main(int argc, char** argv) {
+    config cfg;
+    return benchmark::run(argc, argv, cfg, all_containers());
+}
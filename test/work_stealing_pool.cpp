@@ -0,0 +1,83 @@
+#include <util/work_stealing_pool.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#define BOOST_TEST_MODULE Work_stealing_pool
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(Work_stealing_pool)
+
+long fibonacci(util::work_stealing_pool& pool, int n) {
+    if (n < 2)
+        return n;
+    if (n < 10)
+        return fibonacci(pool, n - 1) + fibonacci(pool, n - 2);
+    long left = 0;
+    util::work_stealing_pool::task_group group;
+    pool.spawn(group, [&] {
+        left = fibonacci(pool, n - 1);
+    });
+    auto right = fibonacci(pool, n - 2);
+    pool.wait(group);
+    return left + right;
+}
+
+BOOST_AUTO_TEST_CASE(Work_stealing_pool_fork_join)
+{
+    for (unsigned workers : {0u, 1u, 3u}) {
+        util::work_stealing_pool pool(workers);
+        BOOST_REQUIRE_EQUAL(pool.concurrency(), workers + 1);
+        BOOST_REQUIRE_EQUAL(fibonacci(pool, 25), 75025);
+
+        std::atomic<int> sum = 0;
+        util::work_stealing_pool::task_group group;
+        for (int i = 1; i <= 1000; ++i) {
+            pool.spawn(group, [&sum, i] {
+                sum += i;
+            });
+        }
+        pool.wait(group);
+        BOOST_REQUIRE_EQUAL(sum.load(), 500500);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Work_stealing_pool_exception)
+{
+    util::work_stealing_pool pool(2);
+    std::atomic<int> finished = 0;
+    util::work_stealing_pool::task_group group;
+    for (int i = 0; i < 100; ++i) {
+        pool.spawn(group, [&finished, i] {
+            if (i == 50)
+                throw std::runtime_error("task failed");
+            ++finished;
+        });
+    }
+    BOOST_REQUIRE_THROW(pool.wait(group), std::runtime_error);
+    // the other tasks are finished anyway
+    BOOST_REQUIRE_EQUAL(finished.load(), 99);
+    pool.wait(group);
+}
+
+BOOST_AUTO_TEST_CASE(Work_stealing_pool_external_threads)
+{
+    // several threads outside of the pool share it
+    util::work_stealing_pool pool(2);
+    std::vector<std::thread> threads;
+    std::vector<long> results(4);
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&pool, &results, t] {
+            results[t] = fibonacci(pool, 20 + t);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    BOOST_REQUIRE_EQUAL(results[0], 6765);
+    BOOST_REQUIRE_EQUAL(results[3], 28657);
+}
+
+BOOST_AUTO_TEST_SUITE_END()